@@ -0,0 +1,161 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+
+/*
+ * The batched transforms against the same frames transformed one at
+ * a time: forwardPolarBatch and inversePolarBatch over count frames,
+ * and count calls of forwardPolar and inversePolar, on one FFT of the
+ * implementation the library would pick.  Reports the time per frame
+ * each way and the largest difference between the two results.  Only
+ * FFTW batches (see FFT.h), so elsewhere the two should match.
+ *
+ * Usage: bench-fftbatch [trials]
+ */
+
+#include "dsp/FFT.h"
+#include "system/Allocators.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+// Mean time per frame for the best of several trials, as the
+// differences can be swamped by scheduling noise
+template <typename F>
+static double
+timeFrames(int trials, int frames, F f)
+{
+    double best = 1e18;
+    for (int trial = 0; trial < trials; ++trial) {
+        auto start = Clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double, std::nano>
+                        (Clock::now() - start).count() / frames);
+    }
+    return best;
+}
+
+struct Frames
+{
+    Frames(int count, int n) : count(count), n(n) {
+        for (int k = 0; k < count; ++k) {
+            rows.push_back(allocate_and_zero<float>(n));
+        }
+    }
+    ~Frames() {
+        for (auto r : rows) deallocate(r);
+    }
+    double maxDifference(const Frames &other) const {
+        double e = 0;
+        for (int k = 0; k < count; ++k) {
+            for (int i = 0; i < n; ++i) {
+                e = std::max(e, double(fabsf(rows[k][i] - other.rows[k][i])));
+            }
+        }
+        return e;
+    }
+    int count;
+    int n;
+    std::vector<float *> rows;
+};
+
+static void
+run(int fftSize, int count, int trials)
+{
+    const int hs1 = fftSize / 2 + 1;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    Frames in(count, fftSize), out(count, fftSize), bout(count, fftSize);
+    Frames mag(count, hs1), phase(count, hs1), bmag(count, hs1), bphase(count, hs1);
+    for (int k = 0; k < count; ++k) {
+        for (int i = 0; i < fftSize; ++i) in.rows[k][i] = dist(rng);
+    }
+
+    FFT fft(fftSize);
+    fft.initFloatBatch(count);
+
+    // Enough repeats for each trial to take a while at small sizes
+    const int repeats = std::max(1, 65536 / (fftSize * count));
+    const int frames = repeats * count;
+
+    double tf = timeFrames(trials, frames, [&]() {
+            for (int r = 0; r < repeats; ++r) {
+                for (int k = 0; k < count; ++k) {
+                    fft.forwardPolar(in.rows[k], mag.rows[k], phase.rows[k]);
+                }
+            }
+        });
+    double tfb = timeFrames(trials, frames, [&]() {
+            for (int r = 0; r < repeats; ++r) {
+                fft.forwardPolarBatch(count, in.rows.data(), bmag.rows.data(),
+                                      bphase.rows.data());
+            }
+        });
+    double ef = std::max(mag.maxDifference(bmag), phase.maxDifference(bphase));
+
+    double ti = timeFrames(trials, frames, [&]() {
+            for (int r = 0; r < repeats; ++r) {
+                for (int k = 0; k < count; ++k) {
+                    fft.inversePolar(mag.rows[k], phase.rows[k], out.rows[k]);
+                }
+            }
+        });
+    double tib = timeFrames(trials, frames, [&]() {
+            for (int r = 0; r < repeats; ++r) {
+                fft.inversePolarBatch(count, bmag.rows.data(), bphase.rows.data(),
+                                      bout.rows.data());
+            }
+        });
+    double ei = out.maxDifference(bout);
+
+    cout << "    " << count << " frames: forward " << tf << " -> " << tfb
+         << " ns/frame (" << tf / tfb << "x), inverse " << ti << " -> " << tib
+         << " ns/frame (" << ti / tib << "x); max difference "
+         << ef << ", " << ei << endl;
+}
+
+int main(int argc, char **argv)
+{
+    int trials = (argc > 1 ? atoi(argv[1]) : 20);
+
+    cout << "compiled in:";
+    for (const auto &i : FFT::getImplementations()) cout << " " << i;
+    cout << endl;
+    for (int size = 512; size <= 8192; size *= 2) {
+        cout << size << "-point frames" << endl;
+        for (int count = 2; count <= 32; count *= 2) {
+            run(size, count, trials);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+/*
+ * Compare the per-hop cost of discarding written samples from the
+ * overlap-add accumulators by shifting them down (as writeChunk used
+ * to) with that of advancing them through a larger buffer and
+ * compacting only occasionally (as ChannelData::advanceAccumulators
+ * does), for the window sizes the stretcher uses, then time a whole
+ * stretch with OptionWindowLong.
+ *
+ * Each figure is the best of several interleaved trials, as the
+ * differences are small next to scheduling noise.
+ *
+ * Usage: bench-overlapadd [hops [overlap [seconds]]]
+ */
+
+#include "rubbers/RubbersStretcher.h"
+#include "system/VectorOps.h"
+#include "system/Allocators.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+static double
+since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+struct Accumulators
+{
+    Accumulators(int size) :
+        size(size),
+        acc(allocate_and_zero<float>(size)),
+        wacc(allocate_and_zero<float>(size)),
+        head(0) { }
+    ~Accumulators() {
+        deallocate(acc);
+        deallocate(wacc);
+    }
+    int size;
+    float *acc;
+    float *wacc;
+    int head;
+};
+
+static void
+synthesise(float *acc, float *wacc, const float *frame, const float *window, int wsz)
+{
+    v_add(acc, frame, wsz);
+    v_add(wacc, window, wsz);
+}
+
+static double
+runShift(Accumulators &a, int wsz, int si, int hops, const float *frame, const float *window)
+{
+    auto start = Clock::now();
+    for (int h = 0; h < hops; ++h) {
+        synthesise(a.acc, a.wacc, frame, window, wsz);
+        v_move(a.acc, a.acc + si, wsz - si);
+        v_zero(a.acc + wsz - si, si);
+        v_move(a.wacc, a.wacc + si, wsz - si);
+        v_zero(a.wacc + wsz - si, si);
+    }
+    return since(start) / hops;
+}
+
+static double
+runSlide(Accumulators &a, int wsz, int si, int hops, const float *frame, const float *window)
+{
+    auto start = Clock::now();
+    for (int h = 0; h < hops; ++h) {
+        synthesise(a.acc + a.head, a.wacc + a.head, frame, window, wsz);
+        a.head += si;
+        if (a.head + wsz > a.size) {
+            v_move(a.acc, a.acc + a.head, a.size - a.head);
+            v_zero(a.acc + a.size - a.head, a.head);
+            v_move(a.wacc, a.wacc + a.head, a.size - a.head);
+            v_zero(a.wacc + a.size - a.head, a.head);
+            a.head = 0;
+        }
+    }
+    return since(start) / hops;
+}
+
+static double
+runStretch(RubbersStretcher::Options options, int seconds)
+{
+    const int rate = 48000, channels = 2, block = 1024;
+    const size_t samples = size_t(rate) * seconds;
+    vector<vector<float> > input(channels, vector<float>(samples));
+    vector<vector<float> > output(channels, vector<float>(8192));
+    for (int c = 0; c < channels; ++c) {
+        for (size_t i = 0; i < samples; ++i) {
+            input[c][i] = 0.3f * sinf(2.f * float(M_PI) * (220.f + 110.f * c) * i / rate);
+        }
+    }
+    vector<const float *> in(channels);
+    vector<float *> out(channels);
+    for (int c = 0; c < channels; ++c) out[c] = output[c].data();
+    RubbersStretcher s(rate, channels, options | RubbersStretcher::OptionThreadingNever, 1.25);
+    s.setMaxProcessSize(block);
+    auto start = Clock::now();
+    for (size_t i = 0; i < samples; i += block) {
+        auto n = std::min(samples - i, size_t(block));
+        for (int c = 0; c < channels; ++c) in[c] = &input[c][i];
+        s.process(in.data(), n, i + n >= samples);
+        ssize_t avail;
+        while ((avail = s.available()) > 0) {
+            s.retrieve(out.data(), std::min(size_t(avail), size_t(8192)));
+        }
+    }
+    return since(start) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int hops = (argc > 1 ? atoi(argv[1]) : 5000);
+    int overlap = (argc > 2 ? atoi(argv[2]) : 8);
+    int seconds = (argc > 3 ? atoi(argv[3]) : 20);
+    const int trials = 40;
+
+    cout << trials << " x " << hops << " hops per size, hop = window / " << overlap << " + 1" << endl;
+    for (int wsz = 1024; wsz <= 8192; wsz *= 2) {
+        vector<float> frame(wsz, 0.25f), window(wsz, 0.5f);
+        int si = wsz / overlap + 1; // an odd hop, as the accumulators rarely stay aligned
+        Accumulators a(wsz * 2), b(wsz * 2);
+        double shift = 1e18, slide = 1e18;
+        for (int trial = 0; trial < trials; ++trial) {
+            // alternate which goes first, as that alone can skew the result
+            if (trial % 2) slide = std::min(slide, runSlide(b, wsz, si, hops, frame.data(), window.data()));
+            shift = std::min(shift, runShift(a, wsz, si, hops, frame.data(), window.data()));
+            if (!(trial % 2)) slide = std::min(slide, runSlide(b, wsz, si, hops, frame.data(), window.data()));
+        }
+        cout << "window " << wsz << ": shift " << shift << " ns/hop, advance "
+             << slide << " ns/hop (" << shift / slide << "x)" << endl;
+    }
+
+    cout << seconds << "s stereo at 1.25x, real-time:" << endl;
+    cout << "standard window: " << runStretch(RubbersStretcher::OptionProcessRealTime, seconds) << " ms" << endl;
+    cout << "long window:     " << runStretch(RubbersStretcher::OptionProcessRealTime |
+                                              RubbersStretcher::OptionWindowLong, seconds) << " ms" << endl;
+    return 0;
+}
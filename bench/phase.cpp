@@ -0,0 +1,243 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+/*
+ * A/B test of the phase update in modifyChunk: the bin-at-a-time
+ * loop it used to run, reproduced here, against PhaseAdvance, on
+ * the same sequence of random frames.  Reports the time per frame
+ * for each and the largest difference between their outputs.
+ *
+ * Built without -ffast-math and with -ffp-contract=off the two agree
+ * exactly.  With the library's usual flags the compiler is free to
+ * contract and reassociate each of them differently, so expect
+ * differences of a float ulp or so: in the phase error, about one
+ * ulp of the expected advance omega (1.2e-4 rad at the top bin of a
+ * 4096-point FFT with a 512-sample hop), and a relative difference
+ * of around 1e-5 in the output phases.
+ *
+ * Usage: bench-phase [frames [fftsize]]
+ */
+
+#include "dsp/PhaseAdvance.h"
+#include "system/Allocators.h"
+#include "system/VectorOps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+struct State
+{
+    State(int n) : n(n) {
+        phase = allocate_and_zero<float>(n);
+        prevPhase = allocate_and_zero<float>(n);
+        prevError = allocate_and_zero<float>(n);
+        unwrappedPhase = allocate_and_zero<float>(n);
+        delta = allocate_and_zero<float>(n);
+    }
+    ~State() {
+        deallocate(phase);
+        deallocate(prevPhase);
+        deallocate(prevError);
+        deallocate(unwrappedPhase);
+        deallocate(delta);
+    }
+    int n;
+    float *phase;
+    float *prevPhase;
+    float *prevError;
+    float *unwrappedPhase;
+    float *delta;
+};
+
+// The loop modifyChunk used before PhaseAdvance
+static bool
+reference(const PhaseAdvance &a, State &s, float &distacc)
+{
+    const int count = a.fftSize / 2;
+    auto fullReset = a.reset;
+    auto prevInstability = 0.0f;
+    auto prevDirection = false;
+    auto distance = 0.0f;
+    const auto maxdist = 8.0f;
+    for (int i = count; i >= 0; --i) {
+        auto resetThis = a.reset;
+        if (a.bandlimited && resetThis && i > a.bandlow && i < a.bandhigh) {
+            resetThis = false;
+            fullReset = false;
+        }
+        auto p = s.phase[i];
+        auto perr = 0.0f;
+        auto outphase = p;
+        auto mi = maxdist;
+        if (i <= a.limit0) mi = 0.0f;
+        else if (i <= a.limit1) mi = 1.0f;
+        else if (i <= a.limit2) mi = 3.0f;
+        if (!resetThis) {
+            auto omega = (static_cast<float>(2 * M_PI) * float(a.increment) * i) / float(a.fftSize);
+            auto ep = s.prevPhase[i] + omega;
+            perr = princarg(p - ep);
+            auto instability = fabsf(perr - s.prevError[i]);
+            auto direction = (perr > s.prevError[i]);
+            auto inherit = false;
+            if (a.laminar) {
+                if (distance >= mi || i == count) {inherit = false;}
+                else if (a.bandlimited && (i == a.bandhigh || i == a.bandlow)) {inherit = false;}
+                else if (instability > prevInstability && direction == prevDirection) {inherit = true;}
+            }
+            auto advance = float(a.outputIncrement) * ((omega + perr) / float(a.increment));
+            if (inherit) {
+                auto inherited = s.unwrappedPhase[i + 1] - s.prevPhase[i + 1];
+                advance = ((advance * distance) + (inherited * (maxdist - distance))) / maxdist;
+                outphase = p + advance;
+                distacc += distance;
+                distance += 1;
+            } else {
+                outphase = s.unwrappedPhase[i] + advance;
+                distance = 0;
+            }
+            prevInstability = instability;
+            prevDirection = direction;
+        } else {
+            distance = 0.0f;
+        }
+        s.prevError[i] = perr;
+        s.prevPhase[i] = p;
+        s.phase[i] = outphase;
+        s.unwrappedPhase[i] = outphase;
+    }
+    return fullReset;
+}
+
+static float
+maxDiff(const float *a, const float *b, int n)
+{
+    float d = 0.f;
+    for (int i = 0; i < n; ++i) d = std::max(d, fabsf(a[i] - b[i]));
+    return d;
+}
+
+static double
+timeFrames(const PhaseAdvance &a0, const vector<vector<float> > &input,
+           int resetEvery, bool vectorised)
+{
+    const int n = a0.fftSize / 2 + 1;
+    auto a = a0;
+    State s(n);
+    float acc = 0;
+    auto start = Clock::now();
+    for (size_t f = 0; f < input.size(); ++f) {
+        a.reset = (resetEvery > 0 && int(f) % resetEvery == resetEvery - 1);
+        v_copy(s.phase, input[f].data(), n);
+        if (vectorised) {
+            a.process(s.phase, s.prevPhase, s.prevError, s.unwrappedPhase, s.delta, acc);
+        } else {
+            reference(a, s, acc);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / input.size();
+}
+
+static void
+run(const char *name, PhaseAdvance a, int frames, int resetEvery)
+{
+    const int n = a.fftSize / 2 + 1;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-float(M_PI), float(M_PI));
+    vector<vector<float> > input(frames, vector<float>(n));
+    for (auto &f : input) for (auto &x : f) x = dist(rng);
+
+    // Best of several alternating trials, as the difference can be
+    // swamped by scheduling noise
+    double tref = 1e18, tvec = 1e18;
+    for (int trial = 0; trial < 10; ++trial) {
+        tref = std::min(tref, timeFrames(a, input, resetEvery, false));
+        tvec = std::min(tvec, timeFrames(a, input, resetEvery, true));
+    }
+
+    State ref(n), vec(n);
+    float dphase = 0, dunwrapped = 0, derror = 0, accref = 0, accvec = 0;
+    for (int f = 0; f < frames; ++f) {
+        a.reset = (resetEvery > 0 && f % resetEvery == resetEvery - 1);
+        v_copy(ref.phase, input[f].data(), n);
+        v_copy(vec.phase, input[f].data(), n);
+        bool rr = reference(a, ref, accref);
+        bool vr = a.process(vec.phase, vec.prevPhase, vec.prevError,
+                            vec.unwrappedPhase, vec.delta, accvec);
+        if (rr != vr) {
+            cerr << name << ": full reset flag differs at frame " << f << endl;
+        }
+        // The output phases are unwrapped and grow without bound, so
+        // compare them relative to their size
+        derror = std::max(derror, maxDiff(ref.prevError, vec.prevError, n));
+        for (int i = 0; i < n; ++i) {
+            auto scale = std::max(1.f, fabsf(ref.unwrappedPhase[i]));
+            dphase = std::max(dphase, fabsf(ref.phase[i] - vec.phase[i]) / scale);
+            dunwrapped = std::max(dunwrapped, fabsf(ref.unwrappedPhase[i] - vec.unwrappedPhase[i]) / scale);
+        }
+    }
+    cout << name << ": reference " << tref / 1000 << " us/frame, vectorised "
+         << tvec / 1000 << " us/frame (" << tref / tvec << "x)" << endl
+         << "    max difference: phase error " << derror << " rad, phase (relative) "
+         << std::max(dphase, dunwrapped) << "; mean inheritance distance "
+         << accref / frames / n << " / " << accvec / frames / n << endl;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = (argc > 1 ? atoi(argv[1]) : 2000);
+    int fftSize = (argc > 2 ? atoi(argv[2]) : 4096);
+    const int rate = 48000;
+
+    PhaseAdvance a;
+    a.fftSize = fftSize;
+    a.increment = fftSize / 8;
+    a.outputIncrement = (fftSize / 8) * 3 / 2;
+    a.laminar = true;
+    a.reset = false;
+    a.bandlimited = false;
+    a.bandlow = int(lrint((150.0 * fftSize) / rate));
+    a.bandhigh = int(lrint((1000.0 * fftSize) / rate));
+    a.limit0 = int(lrint((600.0 * fftSize) / rate));
+    a.limit1 = int(lrint((1200.0 * fftSize) / rate));
+    a.limit2 = int(lrint((12000.0 * fftSize) / rate));
+
+    cout << frames << " frames of " << fftSize << "-point FFT" << endl;
+    run("laminar", a, frames, 0);
+    run("laminar, resets", a, frames, 50);
+    a.bandlimited = true;
+    run("laminar, band-limited resets", a, frames, 50);
+    a.bandlimited = false;
+    a.laminar = false;
+    run("independent", a, frames, 0);
+    return 0;
+}
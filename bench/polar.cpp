@@ -0,0 +1,204 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+
+/*
+ * The polar conversions behind forwardPolar and inversePolar, one
+ * frame of fftsize/2+1 bins at a time: the scalar libm loops the
+ * builtin and FFTW implementations used to run, against the fast and
+ * accurate kernels at each instruction set this CPU supports.
+ * Reports the time per frame and the largest error in the phase or
+ * the cartesian output, measured against double precision.
+ *
+ * Usage: bench-polar [frames]
+ */
+
+#include "system/Allocators.h"
+#include "system/VectorOps.h"
+#include "system/VectorOpsDispatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Frame
+{
+    Frame(int n) : n(n) {
+        real = allocate_and_zero<float>(n);
+        imag = allocate_and_zero<float>(n);
+        mag = allocate_and_zero<float>(n);
+        phase = allocate_and_zero<float>(n);
+    }
+    ~Frame() {
+        deallocate(real);
+        deallocate(imag);
+        deallocate(mag);
+        deallocate(phase);
+    }
+    int n;
+    float *real;
+    float *imag;
+    float *mag;
+    float *phase;
+};
+
+static void
+referenceToPolar(Frame &f)
+{
+    for (int i = 0; i < f.n; ++i) {
+        f.mag[i] = sqrtf(f.real[i] * f.real[i] + f.imag[i] * f.imag[i]);
+        f.phase[i] = atan2f(f.imag[i], f.real[i]);
+    }
+}
+
+static void
+referenceToCartesian(Frame &f)
+{
+    for (int i = 0; i < f.n; ++i) {
+        f.real[i] = f.mag[i] * cosf(f.phase[i]);
+        f.imag[i] = f.mag[i] * sinf(f.phase[i]);
+    }
+}
+
+// Mean time per frame for the best of several trials, as the
+// differences can be swamped by scheduling noise
+template <typename F>
+static double
+timeFrames(int frames, F f)
+{
+    double best = 1e18;
+    for (int trial = 0; trial < 10; ++trial) {
+        auto start = Clock::now();
+        for (int i = 0; i < frames; ++i) f();
+        best = std::min(best, std::chrono::duration<double, std::nano>
+                        (Clock::now() - start).count() / frames);
+    }
+    return best;
+}
+
+static double
+phaseError(const Frame &f)
+{
+    double e = 0;
+    for (int i = 0; i < f.n; ++i) {
+        double d = fabs(f.phase[i] - atan2(double(f.imag[i]), double(f.real[i])));
+        if (d > M_PI) d = fabs(d - 2 * M_PI);
+        e = std::max(e, d);
+    }
+    return e;
+}
+
+static double
+cartesianError(const Frame &f, const float *phase)
+{
+    double e = 0;
+    for (int i = 0; i < f.n; ++i) {
+        e = std::max(e, fabs(f.real[i] - f.mag[i] * cos(double(phase[i]))));
+        e = std::max(e, fabs(f.imag[i] - f.mag[i] * sin(double(phase[i]))));
+    }
+    return e;
+}
+
+static void
+report(const char *name, double tpolar, double tcart, double epolar, double ecart)
+{
+    cout << "    " << name << ": to polar " << tpolar / 1000 << " us/frame, "
+         << "to cartesian " << tcart / 1000 << " us/frame; "
+         << "max error " << epolar << " rad, " << ecart << endl;
+}
+
+static void
+run(int fftSize, int frames)
+{
+    const int n = fftSize / 2 + 1;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    Frame cart(n), polar(n), f(n);
+    for (int i = 0; i < n; ++i) {
+        cart.real[i] = dist(rng);
+        cart.imag[i] = dist(rng);
+        // unit magnitudes, and unwrapped phases of the size the
+        // stretcher accumulates
+        polar.mag[i] = 1.f;
+        polar.phase[i] = dist(rng) * 1000.f;
+    }
+
+    cout << fftSize << "-point frames (" << n << " bins)" << endl;
+
+    auto setCartesian = [&]() {
+        v_copy(f.real, cart.real, n);
+        v_copy(f.imag, cart.imag, n);
+    };
+    auto setPolar = [&]() {
+        v_copy(f.mag, polar.mag, n);
+        v_copy(f.phase, polar.phase, n);
+    };
+
+    setCartesian();
+    double tp = timeFrames(frames, [&]() { referenceToPolar(f); });
+    double ep = phaseError(f);
+    setPolar();
+    double tc = timeFrames(frames, [&]() { referenceToCartesian(f); });
+    double ec = cartesianError(f, polar.phase);
+    report("libm", tp, tc, ep, ec);
+
+    for (int level = VectorLevelBaseline; level <= VectorLevelAVX512; ++level) {
+        for (int accuracy = VectorAccuracyFast; accuracy <= VectorAccuracyAccurate; ++accuracy) {
+            auto k = vector_kernels_for(VectorLevel(level), VectorAccuracy(accuracy));
+            if (!k) continue;
+            setCartesian();
+            tp = timeFrames(frames, [&]() {
+                    k->cartesianToPolar(f.mag, f.phase, f.real, f.imag, n);
+                });
+            ep = phaseError(f);
+            setPolar();
+            tc = timeFrames(frames, [&]() {
+                    k->polarToCartesian(f.real, f.imag, f.mag, f.phase, n);
+                });
+            ec = cartesianError(f, polar.phase);
+            string name = string(vector_level_name(VectorLevel(level))) + " " +
+                vector_accuracy_name(VectorAccuracy(accuracy));
+            report(name.c_str(), tp, tc, ep, ec);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = (argc > 1 ? atoi(argv[1]) : 2000);
+
+    cout << "selected: " << vector_level_name(vector_level()) << " "
+         << vector_accuracy_name(vector_accuracy()) << endl;
+    run(1024, frames);
+    run(2048, frames);
+    run(4096, frames);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+/*
+ * Compare the cost of constructing a stretcher for each short clip
+ * with that of acquiring one from a RubbersStretcherPool.
+ *
+ * Usage: bench-pool [iterations [clip-ms [channels [realtime]]]]
+ */
+
+#include "rubbers/RubbersStretcher.h"
+#include "rubbers/RubbersStretcherPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+static double
+since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static void
+runClip(RubbersStretcher &s, const vector<const float *> &in, vector<float *> &out,
+        size_t samples, size_t outSize, bool realtime)
+{
+    if (!realtime) {
+        s.setExpectedInputDuration(samples);
+        s.study(in.data(), samples, true);
+    }
+    s.process(in.data(), samples, true);
+    ssize_t avail;
+    while ((avail = s.available()) > 0) {
+        s.retrieve(out.data(), std::min(size_t(avail), outSize));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1 ? atoi(argv[1]) : 200);
+    int clipMs = (argc > 2 ? atoi(argv[2]) : 250);
+    int channels = (argc > 3 ? atoi(argv[3]) : 2);
+    bool realtime = (argc > 4 ? atoi(argv[4]) != 0 : false);
+
+    const size_t rate = 48000;
+    const double ratio = 1.25;
+    const size_t samples = rate * clipMs / 1000;
+    const size_t outSize = samples * 4 + 16384;
+    RubbersStretcher::Options options = RubbersStretcher::OptionThreadingNever;
+    if (realtime) options |= RubbersStretcher::OptionProcessRealTime;
+
+    vector<vector<float> > input(channels, vector<float>(samples));
+    vector<vector<float> > output(channels, vector<float>(outSize));
+    for (int c = 0; c < channels; ++c) {
+        for (size_t i = 0; i < samples; ++i) {
+            input[c][i] = 0.3f * sinf(2.f * float(M_PI) * (220.f + 110.f * c) * i / rate);
+        }
+    }
+    vector<const float *> in(channels);
+    vector<float *> out(channels);
+    for (int c = 0; c < channels; ++c) {
+        in[c] = input[c].data();
+        out[c] = output[c].data();
+    }
+
+    cout << iterations << " clips of " << clipMs << "ms, " << channels
+         << " channel(s), " << (realtime ? "real-time" : "offline") << endl;
+
+    double construct = 0, constructTotal = 0;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = Clock::now();
+        RubbersStretcher s(rate, channels, options, ratio);
+        construct += since(start);
+        runClip(s, in, out, samples, outSize, realtime);
+        constructTotal += since(start);
+    }
+
+    RubbersStretcherPool pool;
+    pool.reserve(rate, channels, options, 1);
+    double acquire = 0, acquireTotal = 0;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = Clock::now();
+        RubbersStretcher *s = pool.acquire(rate, channels, options, ratio);
+        acquire += since(start);
+        runClip(*s, in, out, samples, outSize, realtime);
+        pool.release(s);
+        acquireTotal += since(start);
+    }
+
+    cout << "construct: " << construct / iterations << " us setup, "
+         << constructTotal / iterations << " us per clip" << endl;
+    cout << "acquire:   " << acquire / iterations << " us setup, "
+         << acquireTotal / iterations << " us per clip (including release)" << endl;
+    return 0;
+}
@@ -0,0 +1,261 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+/*
+ * Quality and speed of OptionPhaseSparse.  Stretches synthetic music
+ * and speech offline, at the 2048-point FFT of the standard window
+ * and the 4096-point one of the long window, with and without the
+ * option.  Reports the time for each, and two measures of quality.
+ *
+ * Waveforms can't be compared, as any change in the phases leaves
+ * the output waveform quite different from sample to sample even
+ * where it sounds the same, so both measures compare magnitude
+ * spectrograms, as the ratio of the energy of one to that of the
+ * difference between them.  "Fidelity" compares each output with
+ * the input's spectrogram stretched in time, so that a drop from the
+ * full output to the sparse one is a loss of quality.  "Difference"
+ * compares the sparse output with the full one, and for scale the
+ * full output is also compared with that of an input differing only
+ * by noise at the level of a 24-bit LSB.
+ *
+ * The music is a sequence of chords of decaying harmonic notes over
+ * bass and noise percussion, with content up to 16kHz.  The speech
+ * is a glottal pulse train of wandering pitch through moving formant
+ * resonances, with fricative noise between syllables, band-limited
+ * to 8kHz as if it had been recorded at 16kHz.
+ *
+ * Usage: bench-sparse [seconds [ratio [runs]]]
+ */
+
+#include "rubbers/RubbersStretcher.h"
+#include "dsp/FFT.h"
+#include "dsp/Window.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+static const int rate = 48000;
+
+// Two-pole resonator, as a formant
+struct Resonator
+{
+    Resonator() : y1(0), y2(0) { }
+    float process(float x, float freq, float bw) {
+        float r = expf(-float(M_PI) * bw / rate);
+        float c = 2 * r * cosf(2 * float(M_PI) * freq / rate);
+        float y = (1 - r) * x + c * y1 - r * r * y2;
+        y2 = y1;
+        y1 = y;
+        return y;
+    }
+    float y1, y2;
+};
+
+// One-pole low-pass applied several times, for a band limit
+struct LowPass
+{
+    LowPass(float cutoff) : a(expf(-2 * float(M_PI) * cutoff / rate)) {
+        for (auto &s : state) s = 0;
+    }
+    float process(float x) {
+        for (auto &s : state) x = s = (1 - a) * x + a * s;
+        return x;
+    }
+    float a;
+    float state[4];
+};
+
+static vector<float>
+music(int n)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-1.f, 1.f);
+    const float chords[][3] = {
+        { 261.63f, 329.63f, 392.00f }, { 220.00f, 261.63f, 329.63f },
+        { 174.61f, 220.00f, 261.63f }, { 196.00f, 246.94f, 293.66f }
+    };
+    const int beat = rate / 4;
+    vector<float> out(n);
+    LowPass lp(16000);
+    for (int i = 0; i < n; ++i) {
+        int b = i / beat, t = i % beat;
+        float ts = float(t) / rate;
+        const float *chord = chords[(b / 8) % 4];
+        float v = 0;
+        for (int k = 0; k < 3; ++k) {
+            float f0 = chord[k];
+            for (int h = 1; h * f0 < 16000; ++h) {
+                v += 0.08f / h * sinf(2 * float(M_PI) * f0 * h * (float(i) / rate)) *
+                    expf(-ts * (1.5f + h * 0.4f));
+            }
+        }
+        v += 0.2f * sinf(2 * float(M_PI) * (chord[0] / 4) * (float(i) / rate));
+        if (b % 2 == 0) v += 0.3f * noise(rng) * expf(-ts * 40);
+        out[i] = lp.process(v);
+    }
+    return out;
+}
+
+static vector<float>
+speech(int n)
+{
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> noise(-1.f, 1.f);
+    const float vowels[][3] = {
+        { 730, 1090, 2440 }, { 270, 2290, 3010 }, { 530, 1840, 2480 },
+        { 570, 840, 2410 }, { 300, 870, 2240 }
+    };
+    const int syllable = rate / 5;
+    vector<float> out(n);
+    Resonator f1, f2, f3;
+    LowPass lp(8000);
+    float phase = 0;
+    for (int i = 0; i < n; ++i) {
+        int s = i / syllable, t = i % syllable;
+        float pitch = 120 + 30 * sinf(2 * float(M_PI) * 0.7f * (float(i) / rate));
+        const float *v = vowels[s % 5];
+        const float *w = vowels[(s + 1) % 5];
+        float x = float(t) / syllable;
+        float g = 0;
+        if (t < syllable / 6) {
+            g = 0.3f * noise(rng);
+        } else {
+            phase += pitch / rate;
+            if (phase >= 1) phase -= 1;
+            g = (phase < 0.1f ? 1.f - phase * 10 : 0.f);
+        }
+        float y = f1.process(g, v[0] + (w[0] - v[0]) * x, 90) +
+            0.5f * f2.process(g, v[1] + (w[1] - v[1]) * x, 110) +
+            0.25f * f3.process(g, v[2] + (w[2] - v[2]) * x, 170);
+        out[i] = lp.process(y * 4);
+    }
+    return out;
+}
+
+static vector<float>
+stretch(const vector<float> &input, double ratio, RubbersStretcher::Options options,
+        double &ms)
+{
+    auto start = Clock::now();
+    RubbersStretcher s(rate, 1, options | RubbersStretcher::OptionThreadingNever, ratio);
+    const float *in = input.data();
+    s.setExpectedInputDuration(input.size());
+    s.study(&in, input.size(), true);
+    s.process(&in, input.size(), true);
+    vector<float> out(s.available());
+    float *op = out.data();
+    s.retrieve(&op, out.size());
+    ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return out;
+}
+
+// Magnitude spectrogram, with frames spaced hop apart
+static vector<vector<float> >
+spectrogram(const vector<float> &signal, double hop)
+{
+    const int size = 2048;
+    FFT fft(size);
+    Window<float> window(HanningWindow, size);
+    vector<float> frame(size);
+    vector<vector<float> > out;
+    for (int k = 0; ; ++k) {
+        size_t i = size_t(lrint(k * hop));
+        if (i + size > signal.size()) break;
+        window.cut(signal.data() + i, frame.data());
+        out.push_back(vector<float>(size / 2 + 1));
+        fft.forwardMagnitude(frame.data(), out.back().data());
+    }
+    return out;
+}
+
+// Energy of a's spectrogram over that of the difference from b's, in
+// dB, for a of a signal stretched by ratio from b
+static double
+compare(const vector<float> &a, const vector<float> &b, double ratio = 1.0)
+{
+    const int hop = 512;
+    auto sa = spectrogram(a, hop), sb = spectrogram(b, hop / ratio);
+    double signal = 0, diff = 0;
+    for (size_t i = 0; i < std::min(sa.size(), sb.size()); ++i) {
+        for (size_t j = 0; j < sa[i].size(); ++j) {
+            signal += double(sa[i][j]) * sa[i][j];
+            diff += double(sa[i][j] - sb[i][j]) * (sa[i][j] - sb[i][j]);
+        }
+    }
+    return 10 * log10(signal / std::max(diff, 1e-30));
+}
+
+static void
+run(const char *name, const vector<float> &input, double ratio, int runs)
+{
+    const struct { const char *name; RubbersStretcher::Options options; } sizes[] = {
+        { "2048", RubbersStretcher::OptionWindowStandard },
+        { "4096", RubbersStretcher::OptionWindowLong }
+    };
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> lsb(-0.5f / 8388608, 0.5f / 8388608);
+    auto dithered = input;
+    for (auto &x : dithered) x += lsb(rng);
+    for (const auto &size : sizes) {
+        double full = 1e18, sparse = 1e18, ms = 0;
+        vector<float> a, b;
+        for (int i = 0; i < runs; ++i) {
+            a = stretch(input, ratio, size.options, ms);
+            full = std::min(full, ms);
+            b = stretch(input, ratio, size.options | RubbersStretcher::OptionPhaseSparse, ms);
+            sparse = std::min(sparse, ms);
+        }
+        auto c = stretch(dithered, ratio, size.options, ms);
+        cout << setw(6) << name << " " << size.name << ": full " << fixed
+             << setprecision(1) << full << " ms, sparse " << sparse << " ms ("
+             << setprecision(3) << full / sparse << "x)" << endl
+             << "             fidelity " << setprecision(1) << compare(a, input, ratio)
+             << " dB full, " << compare(b, input, ratio) << " dB sparse; difference "
+             << compare(a, b) << " dB (noise " << compare(a, c) << " dB)" << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = (argc > 1 ? atof(argv[1]) : 10.0);
+    double ratio = (argc > 2 ? atof(argv[2]) : 1.5);
+    int runs = (argc > 3 ? atoi(argv[3]) : 3);
+    int n = int(seconds * rate);
+
+    cout << seconds << "s at " << rate << "Hz, ratio " << ratio
+         << ", best of " << runs << endl;
+    run("music", music(n), ratio, runs);
+    run("speech", speech(n), ratio, runs);
+    return 0;
+}
@@ -0,0 +1,189 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+/*
+ * Measure how long a worker takes to wake after being signalled, as
+ * the async real-time mode does on every process() call, and what
+ * process() itself costs the calling thread with and without
+ * OptionThreadingAsync.
+ *
+ * The signaller posts once per period, like an audio callback, and
+ * the worker records the time from just before the post to just after
+ * its wait returns.  This is done for the Semaphore with its adaptive
+ * spin, the Semaphore with no spin, and a mutex and condition
+ * variable for comparison.
+ *
+ * Usage: bench-wake [iterations [period-us [channels]]]
+ */
+
+#include "rubbers/RubbersStretcher.h"
+#include "system/Semaphore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace Rubbers;
+
+typedef std::chrono::steady_clock Clock;
+
+static double
+since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static void
+report(const char *name, vector<double> &times)
+{
+    sort(times.begin(), times.end());
+    auto at = [&](double p) { return times[size_t(p * (times.size() - 1))]; };
+    cout << setw(22) << left << name << right << fixed << setprecision(2)
+         << " p50 " << setw(8) << at(0.5)
+         << " p90 " << setw(8) << at(0.9)
+         << " p99 " << setw(8) << at(0.99)
+         << " p99.9 " << setw(8) << at(0.999)
+         << " max " << setw(8) << times.back() << " us" << endl;
+}
+
+// Run the worker on a thread of its own, signalling it once per
+// period, and return the wake latency of each signal
+static vector<double>
+measure(int iterations, int periodUs,
+        function<void()> signal, function<void()> wait)
+{
+    vector<double> latencies(iterations);
+    atomic<Clock::time_point> posted { Clock::now() };
+    atomic<int> woken { 0 };
+    thread worker([&] {
+            for (int i = 0; i < iterations; ++i) {
+                wait();
+                latencies[i] = since(posted.load());
+                woken = i + 1;
+            }
+        });
+    auto next = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        next += std::chrono::microseconds(periodUs);
+        this_thread::sleep_until(next);
+        posted = Clock::now();
+        signal();
+        // One signal in flight at a time, so each wait is timed alone
+        while (woken.load() <= i) this_thread::yield();
+    }
+    worker.join();
+    return latencies;
+}
+
+static vector<double>
+measureProcess(int iterations, int periodUs, int channels, bool async)
+{
+    const size_t rate = 48000;
+    const size_t block = 512;
+    RubbersStretcher::Options options = RubbersStretcher::OptionProcessRealTime;
+    if (async) options |= RubbersStretcher::OptionThreadingAsync;
+    RubbersStretcher s(rate, channels, options, 1.1, 1.05);
+    s.setMaxProcessSize(block);
+    vector<vector<float> > input(channels, vector<float>(block));
+    vector<vector<float> > output(channels, vector<float>(block * 8));
+    vector<const float *> in(channels);
+    vector<float *> out(channels);
+    for (int c = 0; c < channels; ++c) {
+        in[c] = input[c].data();
+        out[c] = output[c].data();
+    }
+    vector<double> times(iterations);
+    size_t t = 0;
+    auto next = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            for (size_t j = 0; j < block; ++j) {
+                input[c][j] = 0.3f * sinf(2.f * float(M_PI) * (220.f + 110.f * c) * (t + j) / rate);
+            }
+        }
+        t += block;
+        next += std::chrono::microseconds(periodUs);
+        this_thread::sleep_until(next);
+        auto start = Clock::now();
+        s.process(in.data(), block, false);
+        times[i] = since(start);
+        ssize_t avail;
+        while ((avail = s.available()) > 0) {
+            s.retrieve(out.data(), std::min(size_t(avail), block * 8));
+        }
+    }
+    return times;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1 ? atoi(argv[1]) : 2000);
+    int periodUs = (argc > 2 ? atoi(argv[2]) : 1000);
+    int channels = (argc > 3 ? atoi(argv[3]) : 2);
+
+    cout << iterations << " signals, one every " << periodUs << " us" << endl;
+
+    Semaphore spinning;
+    auto times = measure(iterations, periodUs,
+                         [&] { spinning.post(); }, [&] { spinning.wait(); });
+    report("semaphore, adaptive", times);
+
+    Semaphore sleeping(0, 0);
+    times = measure(iterations, periodUs,
+                    [&] { sleeping.post(); }, [&] { sleeping.wait(); });
+    report("semaphore, no spin", times);
+
+    mutex m;
+    condition_variable cv;
+    int pending = 0;
+    times = measure(iterations, periodUs,
+                    [&] {
+                        lock_guard<mutex> lock(m);
+                        ++pending;
+                        cv.notify_one();
+                    },
+                    [&] {
+                        unique_lock<mutex> lock(m);
+                        cv.wait(lock, [&] { return pending > 0; });
+                        --pending;
+                    });
+    report("mutex and condvar", times);
+
+    cout << endl << "process() of 512 samples, " << channels
+         << " channel(s), one block every " << periodUs << " us" << endl;
+    times = measureProcess(iterations, periodUs, channels, false);
+    report("synchronous", times);
+    times = measureProcess(iterations, periodUs, channels, true);
+    report("async", times);
+    return 0;
+}
@@ -104,6 +104,7 @@ int main(int argc, char **argv)
     bool help = false;
     bool version = false;
     bool quiet = false;
+    bool calibrate = false;
     bool haveRatio = false;
     std::string mapfile;
     enum {
@@ -148,6 +149,7 @@ int main(int argc, char **argv)
             { "threads",       0, 0, '@' },
             { "quiet",         0, 0, 'q' },
             { "timemap",       1, 0, 'M' },
+            { "calibrate-fft", 0, 0, '^' },
             { 0, 0, 0, 0 }
         };
 
@@ -181,10 +183,16 @@ int main(int argc, char **argv)
         case 'c': crispness = atoi(optarg); break;
         case 'q': quiet = true; break;
         case 'M': mapfile = optarg; break;
+        case '^': calibrate = true; break;
         default:  help = true; break;
         }
     }
     if (version) { cerr << RUBBERBAND_VERSION << endl; return 0; }
+    if (calibrate) {
+        if (!quiet) cerr << "Timing FFT implementations at each size, this may take a while..." << endl;
+        RubbersStretcher::calibrateFft();
+        return RubbersStretcher::saveFftTuning() ? 0 : 1;
+    }
     if (help || !haveRatio || optind + 1 != argc) {
         cerr << endl;
 	cerr << "Rubber Band" << endl;
@@ -242,6 +250,9 @@ int main(int argc, char **argv)
         cerr << "                          (N.B. debug level 3 includes audible ticks in output)" << endl;
         cerr << "  -q,    --quiet          Suppress progress output" << endl;
         cerr << endl;
+        cerr << "         --calibrate-fft  Time the FFT implementations on this host, save the" << endl;
+        cerr << "                          results to $RUBBERS_FFT_TUNING or ~/.rubbers.fft-tuning," << endl;
+        cerr << "                          and exit" << endl;
         cerr << "  -V,    --version        Show version number and exit" << endl;
         cerr << "  -h,    --help           Show this help" << endl;
         cerr << endl;
@@ -38,6 +38,7 @@
 #include <condition_variable>
 #include <vector>
 #include <map>
+#include <string>
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
@@ -188,16 +189,26 @@ public:
      *   frequency bin independently from its neighbours.  This
      *   usually results in a slightly softer, phasier sound.
      *
+     *   \li \c OptionPhaseSparse - In addition to either of the
+     *   above, skip the phase adjustment in frequency bins that are
+     *   far below the loudest bin in each analysis window (more than
+     *   70dB below it), above the highest bin that is not.  This
+     *   saves a little time on material that does not fill the whole
+     *   frequency range, at very little cost in quality.
+     *
      * 6. Flags prefixed \c OptionThreading control the threading
      * model of the stretcher.  These options may not be changed after
      * construction.
      *
      *   \li \c OptionThreadingAuto - Permit the stretcher to
-     *   determine its own threading model.  Usually this means using
-     *   one processing thread per audio channel in offline mode if
+     *   determine its own threading model.  Usually this means
+     *   processing the audio channels concurrently in offline mode if
      *   the stretcher is able to determine that more than one CPU is
      *   available, and one thread only in realtime mode.  This is the
-     *   defafult.
+     *   defafult.  Concurrent channels are run on a single pool of
+     *   worker threads shared by all stretcher instances in the
+     *   process, so many stretchers running at once do not each
+     *   start their own threads.
      *
      *   \li \c OptionThreadingNever - Never use more than one thread.
      *  
@@ -205,6 +216,43 @@ public:
      *   situation where \c OptionThreadingAuto would do so, except omit
      *   the check for multiple CPUs and instead assume it to be true.
      *
+     *   \li \c OptionThreadingPipelined - May be combined with either
+     *   of the above.  In offline mode, also run the analysis, phase
+     *   modification and synthesis of each channel as a pipeline on
+     *   three threads, so that even a mono stream can make use of
+     *   more than one CPU.  Each channel gets two threads of its own,
+     *   so this is intended for mono and low channel-count streams,
+     *   particularly with long windows.  The output is identical to
+     *   that without pipelining.  Ignored in real-time mode and with
+     *   \c OptionThreadingNever.
+     *
+     *   \li \c OptionThreadingSegmented - May be combined with any
+     *   of the above.  In offline mode, also split each channel at
+     *   the phase resets found during study into segments that are
+     *   rendered concurrently, and join the rendered segments back
+     *   together in order.  This suits long mono or stereo inputs
+     *   with frequent transients.  Output becomes available in
+     *   segment-sized steps as each segment is finished, and differs
+     *   from unsegmented output only by rounding where segments
+     *   meet.  Ignored in real-time mode, with \c
+     *   OptionTransientsMixed (whose resets are only partial) and
+     *   with \c OptionThreadingNever.
+     *
+     *   \li \c OptionThreadingAsync - May be combined with any of
+     *   the above.  In real-time mode, do all processing on a
+     *   background thread belonging to the stretcher.  process()
+     *   then only copies its input into a staging buffer, queues it
+     *   and wakes the worker, without blocking or taking a lock, and
+     *   output appears for available() and retrieve() once the
+     *   worker has got to it.  The output is the same as without
+     *   this option, and time ratio and pitch scale changes apply
+     *   at the same points in it.  Up to eight blocks of the
+     *   maximum process size are staged; if the worker falls
+     *   further behind than that, input is dropped, and counted for
+     *   getDroppedSamples().  reset() and the option setters wait
+     *   for the worker to finish the block it is processing.
+     *   Ignored in offline mode and with \c OptionThreadingNever.
+     *
      * 7. Flags prefixed \c OptionWindow control the window size for
      * FFT processing.  The window size actually used will depend on
      * many factors, but it can be influenced.  These options may not
@@ -249,6 +297,19 @@ public:
      *   note frequency without so substantially affecting the
      *   perceived pitch profile of the voice or instrument.
      *
+     *   \li \c OptionFormantReused - With OptionFormantPreserved,
+     *   keep the spectral envelope from one processing block to the
+     *   next for as long as the spectrum stays close to the one it
+     *   was estimated from, rather than estimating it afresh each
+     *   time.  This saves much of the cost of formant preservation
+     *   for sustained sounds.
+     *
+     *   \li \c OptionFormantLPC - With OptionFormantPreserved,
+     *   estimate the spectral envelope with linear prediction rather
+     *   than from the cepstrum.  This is cheaper, and follows
+     *   resonant peaks more closely, though the envelope is less
+     *   smooth.
+     *
      * 10. Flags prefixed \c OptionPitch control the method used for
      * pitch shifting.  These options may be changed at any time.
      * They are only effective in realtime mode; in offline mode, the
@@ -289,6 +350,18 @@ public:
      *   setting).  This usually leads to better focus in the centre
      *   but a loss of stereo space and width.  Any channels beyond
      *   the first two are processed individually.
+     *
+     *   \li \c OptionChannelsJoint - All channels are treated as one
+     *   multichannel bed (5.1, 7.1, ambisonics and so on): the phase
+     *   of each frequency bin is advanced for every channel at once,
+     *   and the decision whether a bin's phase follows its neighbour
+     *   is made once for the bed, from the channels' combined phase
+     *   behaviour, rather than once per channel.  This keeps the
+     *   channels' phase relationships more intact and is cheaper for
+     *   many channels.  The channels are always processed in step,
+     *   so in offline mode this rules out multi-threading.  It may
+     *   be combined with OptionChannelsTogether, and is not applied
+     *   to additional time ratios.
      */
     
     enum Option {
@@ -309,10 +382,14 @@ public:
 
         OptionPhaseLaminar         = 0x00000000,
         OptionPhaseIndependent     = 0x00002000,
+        OptionPhaseSparse          = 0x00004000,
     
         OptionThreadingAuto        = 0x00000000,
         OptionThreadingNever       = 0x00010000,
         OptionThreadingAlways      = 0x00020000,
+        OptionThreadingPipelined   = 0x00040000,
+        OptionThreadingSegmented   = 0x00080000,
+        OptionThreadingAsync       = 0x00400000,
 
         OptionWindowStandard       = 0x00000000,
         OptionWindowShort          = 0x00100000,
@@ -323,6 +400,8 @@ public:
 
         OptionFormantShifted       = 0x00000000,
         OptionFormantPreserved     = 0x01000000,
+        OptionFormantReused        = 0x08000000,
+        OptionFormantLPC           = 0x20000000,
 
         OptionPitchHighSpeed       = 0x00000000,
         OptionPitchHighQuality     = 0x02000000,
@@ -330,6 +409,7 @@ public:
 
         OptionChannelsApart        = 0x00000000,
         OptionChannelsTogether     = 0x10000000,
+        OptionChannelsJoint        = 0x40000000,
 
         // n.b. Options is int, so we must stop before 0x80000000
     };
@@ -338,6 +418,28 @@ public:
         DefaultOptions             = 0x00000000,
         PercussiveOptions          = 0x00102000
     };
+    /**
+     * An Executor lets the stretcher share an application's own
+     * scheduler (for example a TBB arena or a custom task system)
+     * instead of using threads of its own.  See setExecutor().
+     *
+     * Each work item handed to an Executor is small and bounded:
+     * typically the analysis or synthesis of a single processing
+     * chunk on a single channel.
+     */
+    class Executor
+    {
+    public:
+        typedef void (*WorkFunction)(void *context, size_t index);
+        virtual ~Executor() { }
+        /**
+         * Call work(context, i) once for every i from 0 to count-1.
+         * The calls are independent of one another and may be made
+         * in any order, on any threads, concurrently or not, but this
+         * function must not return until all of them have completed.
+         */
+        virtual void run(size_t count, WorkFunction work, void *context) = 0;
+    };
     /**
      * Construct a time and pitch stretcher object to run at the given
      * sample rate, with the given number of channels.  Processing
@@ -356,6 +458,11 @@ public:
      * Reset the stretcher's internal buffers.  The stretcher should
      * subsequently behave as if it had just been constructed
      * (although retaining the current time and pitch ratio).
+     *
+     * This does not allocate memory: everything sized on
+     * construction or by a change of ratio is kept for reuse, so
+     * resetting a stretcher is much cheaper than constructing a new
+     * one.  See also RubbersStretcherPool.
      */
     void reset();
     /**
@@ -378,6 +485,12 @@ public:
      * same thread as process(), or provide your own mutex or similar
      * mechanism to ensure that setTimeRatio and process() cannot be
      * run at once (there is no internal mutex for this purpose).
+     *
+     * In RealTime mode, while the time ratio and pitch scale are both
+     * exactly 1.0, the input is passed through to the output without
+     * being processed, at the same latency and at very little cost.
+     * The output crossfades into and out of this over about one
+     * analysis window as either of them moves to or from 1.0.
      */
     void setTimeRatio(double ratio);
     /**
@@ -497,6 +610,70 @@ public:
      * and from which there is no output).
      */
     void setMaxProcessSize(size_t samples);
+    /**
+     * Tell the stretcher the lowest and highest pitch scale that you
+     * will set with setPitchScale() during processing.  In RealTime
+     * mode, buffers, windows and FFTs are prepared up front for
+     * every pitch scale in this range at the maximum process size,
+     * so that neither processing nor a change of pitch scale within
+     * the range needs to allocate memory.  A pitch scale outside the
+     * range may still be set, but may cause allocation.
+     *
+     * The default range is 0.25 to 4.0 (two octaves either way),
+     * widened if necessary to include the initial pitch scale.
+     *
+     * This function has no effect in Offline mode.  Like
+     * setMaxProcessSize(), it may not be called after the first call
+     * to process().
+     */
+    void setPitchScaleRange(double minScale, double maxScale);
+    /**
+     * Tell the stretcher that the input has no content of interest
+     * above the given frequency in Hz, as for example with telephony
+     * or voice recordings that have been resampled up to the rate the
+     * stretcher is working at.  If the band is narrow enough for it
+     * to be worthwhile, the input is then resampled to a lower rate
+     * on its way in, processed at that rate, with correspondingly
+     * smaller FFTs and fewer chunks, and resampled back to the
+     * original rate on its way out.  Everything else about the
+     * stretcher, including the sample counts passed to and returned
+     * from its functions, stays at the original rate.
+     *
+     * Content above the bandwidth is lost, and a little below it may
+     * be attenuated by the resampling.  A bandwidth of zero, the
+     * default, processes the full band.
+     *
+     * Like setPitchScaleRange(), this may not be called after the
+     * first call to study() or process().
+     */
+    void setBandwidth(double frequency);
+    /**
+     * Set the peak input level below which a chunk is treated as
+     * silent.  A silent chunk skips the forward FFT, the phase update
+     * and synthesis altogether: it contributes nothing to the output
+     * but the decaying tail of the chunks before it, and its
+     * channel's phase history is cleared, as a phase reset on silence
+     * would leave it.
+     *
+     * The default is low enough that only a chunk whose spectrum the
+     * silence detector would find empty is skipped, so it does not
+     * change the output audibly.  Raising it to a noise floor skips
+     * more, and replaces that floor with silence.  Zero disables
+     * skipping.  This may be called at any time.
+     */
+    void setSilenceThreshold(float level);
+    /**
+     * Provide an Executor on which to run per-channel processing
+     * work, or 0 to revert to the stretcher's own threading model.
+     * When an executor is set, it is used for all multi-channel work
+     * in both offline and real-time mode, in place of the shared
+     * thread pool, and regardless of the OptionThreading flags.
+     *
+     * The executor is not owned by the stretcher and must remain
+     * valid until it is replaced or the stretcher is destroyed.  This
+     * function may not be called concurrently with process().
+     */
+    void setExecutor(Executor *executor);
     /**
      * Ask the stretcher how many audio sample frames should be
      * provided as input in order to ensure that some more output
@@ -566,6 +743,41 @@ public:
      * Set "last" to true if this is the last block of input data.
      */
     void process(const float *const *input, size_t samples, bool last);
+    /**
+     * Provide a block of "samples" sample frames for processing to
+     * each of "count" stretchers at once.  "input[i]" is the input
+     * for "stretchers[i]", in the form taken by process().  This is
+     * equivalent to calling process() on each stretcher in turn, and
+     * produces the same output, but is cheaper for a server running
+     * many RealTime mode stretchers with the same options: rather
+     * than each stretcher working through its own chunk in turn,
+     * each stage of a chunk (analysis, increment calculation and
+     * synthesis) is run for every stretcher in the batch before the
+     * next stage begins.
+     *
+     * Offline mode stretchers, and those with \c
+     * OptionThreadingAsync, are simply passed to process().  The
+     * first of the rest runs the batch.  If it has an executor (see
+     * setExecutor()), the analyses and syntheses of each stage are
+     * run on that executor, across all channels of all stretchers;
+     * the executors of the other stretchers are not used.  Otherwise
+     * the FFTs of each stage are done as one batched call for each
+     * FFT size, across every channel of the stretchers of that size.
+     * (This only saves time where the FFT implementation can batch,
+     * which at present means FFTW.)
+     *
+     * The stretcher that runs the batch keeps the scratch space for
+     * it, which only grows, so a batch of no more stretchers and
+     * channels than one it has run before allocates nothing.  With
+     * setRealTimeAudit(), each stretcher's counts cover its own part
+     * of the work, and that stretcher's also cover the shared
+     * scratch.  No stretcher may appear in the batch more than once,
+     * and none may be used concurrently from elsewhere during the
+     * call.
+     */
+    static void processBatch(RubbersStretcher *const *stretchers, size_t count,
+                             const float *const *const *input,
+                             size_t samples, bool last);
     /**
      * Ask the stretcher how many audio sample frames of output data
      * are available for reading (via retrieve()).
@@ -588,6 +800,45 @@ public:
      * retrieved.
      */
     size_t retrieve(float *const *output, size_t samples) const;
+    /**
+     * In Offline mode, render the same input at each of a list of
+     * further time ratios, alongside the time ratio of the stretcher
+     * itself.  The input is studied and analysed only once, and each
+     * further ratio shares that analysis, having only its own phase
+     * modification, synthesis and output buffer.  This is much
+     * cheaper than running a separate stretcher for each ratio.
+     *
+     * The pitch scale and all options are shared with the
+     * stretcher's own ratio.  The analysis block size is chosen to
+     * suit the largest of the ratios, so the output for a given
+     * ratio may differ slightly from that of a stretcher set to that
+     * ratio alone.  Pipelined and segmented threading are not used
+     * while further ratios are set, and a key frame map applies to
+     * the stretcher's own ratio only.
+     *
+     * Output for each ratio is read with the available() and
+     * retrieve() overloads taking a ratio index, where index 0 is
+     * the stretcher's own ratio and index n is the nth entry in
+     * "ratios".  Every ratio's output must be read: process() does
+     * not wait for output to be retrieved, so output that is never
+     * read simply accumulates.
+     *
+     * This function cannot be used in RealTime mode, and may only be
+     * called between construction (or a call to reset()) and the
+     * first call to study() or process().  Passing an empty list
+     * removes any further ratios.
+     */
+    void setAdditionalTimeRatios(const std::vector<double> &ratios);
+    /**
+     * As available(), for the output at the given ratio index (see
+     * setAdditionalTimeRatios()).
+     */
+    ssize_t available(size_t ratioIndex) const;
+    /**
+     * As retrieve(), for the output at the given ratio index (see
+     * setAdditionalTimeRatios()).
+     */
+    size_t retrieve(float *const *output, size_t samples, size_t ratioIndex) const;
 
     /**
      * Return the value of internal frequency cutoff value n.
@@ -642,6 +893,12 @@ public:
      * with.
      */
     size_t getChannelCount() const;
+    /**
+     * Return the proportion of chunks, over all channels, that have
+     * been skipped as silent (see setSilenceThreshold) since the
+     * stretcher was constructed or last reset.
+     */
+    double getSilenceSkipRate() const;
     /**
      * Force the stretcher to calculate a stretch profile.  Normally
      * this happens automatically for the first process() call in
@@ -665,6 +922,73 @@ public:
      * @see setDebugLevel
      */
     static void setDefaultDebugLevel(int level);
+    /**
+     * Time each compiled-in FFT implementation at every power-of-two
+     * size from minSize to maxSize, recording the results in the
+     * process-wide FFT tuning table.  Stretchers constructed
+     * afterwards use whichever implementation was fastest at each
+     * size.  This is slow, taking a second or more per size, and is
+     * meant to be run once on a representative host, followed by
+     * saveFftTuning().  The defaults cover the FFT sizes a
+     * stretcher uses at the usual sample rates.
+     *
+     * The table is loaded from the file named by the
+     * RUBBERS_FFT_TUNING environment variable, or else
+     * $HOME/.rubbers.fft-tuning, when the first FFT is constructed.
+     * Once a table has been loaded, FFTW plans for sizes with no
+     * saved wisdom are estimated rather than measured.
+     */
+    static void calibrateFft(size_t minSize = 64, size_t maxSize = 65536);
+    /**
+     * Save the FFT tuning table to the given file, or to the default
+     * location described for calibrateFft() if path is empty.  The
+     * file may then be shipped to hosts like the one it was measured
+     * on.  Return false if it could not be written.
+     */
+    static bool saveFftTuning(const std::string &path = "");
+    enum RealTimeAuditMode {
+        RealTimeAuditOff,
+        RealTimeAuditCount,
+        RealTimeAuditTrap
+    };
+    /**
+     * Check that the stretcher is real-time safe, for debugging.  In
+     * RealTime mode, with RealTimeAuditCount set, every heap
+     * allocation or deallocation and every lock taken within
+     * process(), available(), retrieve(), setTimeRatio() and
+     * setPitchScale() is counted, including any made on an
+     * executor's threads on the stretcher's behalf.  With
+     * RealTimeAuditTrap set, the first one is reported and the
+     * program aborted, so that it can be caught in a debugger.
+     * Setting the mode resets the counts.
+     *
+     * This is only available if the library was built with RT_AUDIT
+     * defined, which replaces the global operator new and delete for
+     * the whole program.  Otherwise the counts are always zero.
+     */
+    void setRealTimeAudit(RealTimeAuditMode mode);
+    /**
+     * Return the number of heap allocations and deallocations
+     * counted since the audit mode was last set.
+     *
+     * @see setRealTimeAudit
+     */
+    size_t getRealTimeAuditAllocations() const;
+    /**
+     * Return the number of locks counted since the audit mode was
+     * last set.
+     *
+     * @see setRealTimeAudit
+     */
+    size_t getRealTimeAuditLocks() const;
+    /**
+     * Return the number of input samples dropped, since construction
+     * or the last reset(), because the OptionThreadingAsync worker
+     * had fallen too far behind to take them.  Always zero without
+     * that option.  Unlike the audit counts, this is counted in every
+     * build.
+     */
+    size_t getDroppedSamples() const;
 protected:
     class Impl;
     Impl *m_d;
@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERS_RUBBERSSTRETCHERPOOL_H_
+#define _RUBBERS_RUBBERSSTRETCHERPOOL_H_
+
+#include "RubbersStretcher.h"
+
+namespace Rubbers
+{
+
+/**
+ * A pool of RubbersStretcher objects kept for reuse, for hosts that
+ * process many short clips and would otherwise construct and destroy
+ * a stretcher for each one.
+ *
+ * Construction is the dominant cost of a stretcher used for less
+ * than a second or so of audio.  A pool hands out stretchers that
+ * were constructed earlier with the same sample rate, channel count
+ * and options, and that have since been reset (see
+ * RubbersStretcher::reset()), constructing new ones only when none
+ * is idle.
+ *
+ * A stretcher returned to the pool is reset, and it gets its time and
+ * pitch ratios from the next acquire() call.  Any other settings made
+ * on it while it was acquired (debug level, expected input duration,
+ * maximum process size, executor, additional time ratios, or options
+ * changed after construction) stay with it.  Hosts sharing a pool
+ * should therefore make the same settings on every stretcher they
+ * acquire, or restore them before release.  The options passed to
+ * acquire() must still match the stretcher's own options on release.
+ *
+ * All functions are thread-safe.  A stretcher acquired from the pool
+ * is used exactly like any other, but by only one thread at a time.
+ */
+class RubbersStretcherPool
+{
+public:
+    /**
+     * Construct a pool that keeps at most maxIdle idle stretchers for
+     * each combination of sample rate, channel count and options.
+     * Stretchers released beyond that are destroyed.
+     */
+    RubbersStretcherPool(size_t maxIdle = 16);
+
+    /**
+     * Destroy the pool and every stretcher it owns.  All stretchers
+     * acquired from the pool must have been released first.
+     */
+    ~RubbersStretcherPool();
+
+    /**
+     * Return a stretcher in the state of one newly constructed with
+     * the given arguments, reusing an idle one if there is one.
+     * The stretcher still belongs to the pool: hand it back with
+     * release() rather than deleting it.
+     */
+    RubbersStretcher *acquire(size_t sampleRate,
+                              size_t channels,
+                              RubbersStretcher::Options options = RubbersStretcher::DefaultOptions,
+                              double initialTimeRatio = 1.0,
+                              double initialPitchScale = 1.0);
+
+    /**
+     * Reset a stretcher previously returned by acquire() and keep it
+     * for reuse.  The caller must not use it again afterwards.
+     */
+    void release(RubbersStretcher *stretcher);
+
+    /**
+     * Construct stretchers for the given sample rate, channel count
+     * and options ahead of time, until at least count of them are
+     * idle (up to the pool's maxIdle).
+     */
+    void reserve(size_t sampleRate,
+                 size_t channels,
+                 RubbersStretcher::Options options,
+                 size_t count);
+
+    /**
+     * Return the number of idle stretchers held by the pool, across
+     * all sample rates, channel counts and options.
+     */
+    size_t getIdleCount() const;
+
+protected:
+    class Impl;
+    Impl *m_d;
+
+private:
+    RubbersStretcherPool(const RubbersStretcherPool &) = delete;
+    RubbersStretcherPool &operator=(const RubbersStretcherPool &) = delete;
+};
+
+}
+
+#endif
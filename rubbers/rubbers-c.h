@@ -69,10 +69,14 @@ enum RubbersOption {
 
     RubbersOptionPhaseLaminar         = 0x00000000,
     RubbersOptionPhaseIndependent     = 0x00002000,
+    RubbersOptionPhaseSparse          = 0x00004000,
     
     RubbersOptionThreadingAuto        = 0x00000000,
     RubbersOptionThreadingNever       = 0x00010000,
     RubbersOptionThreadingAlways      = 0x00020000,
+    RubbersOptionThreadingPipelined   = 0x00040000,
+    RubbersOptionThreadingSegmented   = 0x00080000,
+    RubbersOptionThreadingAsync       = 0x00400000,
 
     RubbersOptionWindowStandard       = 0x00000000,
     RubbersOptionWindowShort          = 0x00100000,
@@ -83,6 +87,8 @@ enum RubbersOption {
 
     RubbersOptionFormantShifted       = 0x00000000,
     RubbersOptionFormantPreserved     = 0x01000000,
+    RubbersOptionFormantReused        = 0x08000000,
+    RubbersOptionFormantLPC           = 0x20000000,
 
     RubbersOptionPitchHighQuality     = 0x00000000,
     RubbersOptionPitchHighSpeed       = 0x02000000,
@@ -90,6 +96,7 @@ enum RubbersOption {
 
     RubbersOptionChannelsApart        = 0x00000000,
     RubbersOptionChannelsTogether     = 0x10000000,
+    RubbersOptionChannelsJoint        = 0x40000000,
 };
 
 typedef int RubbersOptions;
@@ -126,21 +133,85 @@ extern void rubbers_set_expected_input_duration(RubbersState, size_t samples);
 extern size_t rubbers_get_samples_required(const RubbersState);
 
 extern void rubbers_set_max_process_size(RubbersState, size_t samples);
+extern void rubbers_set_pitch_scale_range(RubbersState, double minScale, double maxScale);
+extern void rubbers_set_bandwidth(RubbersState, double frequency);
+extern void rubbers_set_silence_threshold(RubbersState, float level);
+extern double rubbers_get_silence_skip_rate(const RubbersState);
+/*
+ * A caller-supplied executor, as RubbersStretcher::Executor: run must
+ * call work(context, i) for every i in [0, count), on any threads and
+ * in any order, and return only when all have completed.  Pass a null
+ * run function to revert to the stretcher's own threading.
+ */
+typedef void (*RubbersWorkFunction)(void *context, size_t index);
+typedef void (*RubbersExecutorFunction)(void *executorData, size_t count,
+                                        RubbersWorkFunction work, void *context);
+
+extern void rubbers_set_executor(RubbersState, RubbersExecutorFunction run, void *executorData);
 extern void rubbers_set_key_frame_map(RubbersState, size_t keyframecount, size_t *from, size_t *to);
 
 extern void rubbers_study(RubbersState, const float *const *input, size_t samples, bool flush);
 extern void rubbers_process(RubbersState, const float *const *input, size_t samples,bool flush);
+extern void rubbers_process_batch(RubbersState *states, size_t count, const float *const *const *input, size_t samples, bool flush);
 
 extern ssize_t  rubbers_available(const RubbersState);
 extern size_t   rubbers_retrieve(const RubbersState, float *const *output, size_t samples);
 
+/*
+ * Further time ratios rendered from the same analysis, as
+ * RubbersStretcher::setAdditionalTimeRatios.  Ratio index 0 is the
+ * stretcher's own ratio and index n the nth of the given ratios.
+ */
+extern void rubbers_set_additional_time_ratios(RubbersState, const double *ratios, size_t count);
+extern ssize_t  rubbers_available_for_ratio(const RubbersState, size_t ratioIndex);
+extern size_t   rubbers_retrieve_for_ratio(const RubbersState, float *const *output, size_t samples, size_t ratioIndex);
+
 extern unsigned int rubbers_get_channel_count(const RubbersState);
 
+/*
+ * A pool of stretchers kept for reuse, as RubbersStretcherPool.
+ * States returned by rubbers_pool_acquire must be handed back with
+ * rubbers_pool_release, not rubbers_delete.
+ */
+struct RubbersPool_;
+typedef struct RubbersPool_ *RubbersPool;
+
+extern RubbersPool rubbers_pool_new(size_t maxIdle);
+extern void rubbers_pool_delete(RubbersPool);
+extern RubbersState rubbers_pool_acquire(RubbersPool,
+                                         unsigned int sampleRate,
+                                         unsigned int channels,
+                                         RubbersOptions options,
+                                         double initialTimeRatio,
+                                         double initialPitchScale);
+extern void rubbers_pool_release(RubbersPool, RubbersState);
+extern void rubbers_pool_reserve(RubbersPool,
+                                 unsigned int sampleRate,
+                                 unsigned int channels,
+                                 RubbersOptions options,
+                                 size_t count);
+
 extern void rubbers_calculate_stretch(RubbersState);
 
 extern void rubbers_set_debug_level(RubbersState, int level);
 extern void rubbers_set_default_debug_level(int level);
 
+/*
+ * As RubbersStretcher::calibrateFft and saveFftTuning.  A null path
+ * saves to the default location.
+ */
+extern void rubbers_calibrate_fft(size_t minSize, size_t maxSize);
+extern bool rubbers_save_fft_tuning(const char *path);
+
+/*
+ * Mode is 0 (off), 1 (count) or 2 (trap), as
+ * RubbersStretcher::RealTimeAuditMode.
+ */
+extern void rubbers_set_realtime_audit(RubbersState, int mode);
+extern size_t rubbers_get_realtime_audit_allocations(const RubbersState);
+extern size_t rubbers_get_realtime_audit_locks(const RubbersState);
+extern size_t rubbers_get_dropped_samples(const RubbersState);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,7 @@
 */
 
 #include "StretcherImpl.h"
+#include "dsp/FFT.h"
 using namespace std;
 namespace Rubbers {
 RubbersStretcher::RubbersStretcher(size_t sampleRate,
@@ -59,6 +60,14 @@ RubbersStretcher::setExpectedInputDuration(size_t samples) {m_d->setExpectedInpu
 void
 RubbersStretcher::setMaxProcessSize(size_t samples){m_d->setMaxProcessSize(samples);}
 void
+RubbersStretcher::setPitchScaleRange(double minScale, double maxScale){m_d->setPitchScaleRange(minScale, maxScale);}
+void
+RubbersStretcher::setBandwidth(double frequency){m_d->setBandwidth(frequency);}
+void
+RubbersStretcher::setExecutor(Executor *executor){m_d->setExecutor(executor);}
+void
+RubbersStretcher::setSilenceThreshold(float level){m_d->setSilenceThreshold(level);}
+void
 RubbersStretcher::setKeyFrameMap(const map<size_t, size_t> &mapping){m_d->setKeyFrameMap(mapping);}
 size_t
 RubbersStretcher::getSamplesRequired() const{return m_d->getSamplesRequired();}
@@ -70,6 +79,17 @@ ssize_t
 RubbersStretcher::available() const{return m_d->available();}
 size_t
 RubbersStretcher::retrieve(float *const *output, size_t samples) const{return m_d->retrieve(output, samples);}
+void
+RubbersStretcher::processBatch(RubbersStretcher *const *stretchers, size_t count,
+                               const float *const *const *input, size_t samples, bool final){
+    Impl::processBatch(stretchers, count, input, samples, final);
+}
+void
+RubbersStretcher::setAdditionalTimeRatios(const vector<double> &ratios){m_d->setAdditionalTimeRatios(ratios);}
+ssize_t
+RubbersStretcher::available(size_t ratioIndex) const{return m_d->available(ratioIndex);}
+size_t
+RubbersStretcher::retrieve(float *const *output, size_t samples, size_t ratioIndex) const{return m_d->retrieve(output, samples, ratioIndex);}
 float
 RubbersStretcher::getFrequencyCutoff(int n) const{return m_d->getFrequencyCutoff(n);}
 void
@@ -86,10 +106,28 @@ size_t
 RubbersStretcher::getChannelCount() const{return m_d->getChannelCount();}
 void
 RubbersStretcher::calculateStretch(){m_d->calculateStretch();}
+double
+RubbersStretcher::getSilenceSkipRate() const{return m_d->getSilenceSkipRate();}
 void
 RubbersStretcher::setDebugLevel(int level){m_d->setDebugLevel(level);}
 void
 RubbersStretcher::setDefaultDebugLevel(int level){Impl::setDefaultDebugLevel(level);}
+void
+RubbersStretcher::calibrateFft(size_t minSize, size_t maxSize){
+    for (auto size = size_t{2}; size <= maxSize; size *= 2) {
+        if (size >= minSize) FFT::calibrate(int(size));
+    }
+}
+bool
+RubbersStretcher::saveFftTuning(const string &path){return FFT::saveTuning(path);}
+void
+RubbersStretcher::setRealTimeAudit(RealTimeAuditMode mode){m_d->setRealTimeAudit(mode);}
+size_t
+RubbersStretcher::getRealTimeAuditAllocations() const{return m_d->getRealTimeAuditAllocations();}
+size_t
+RubbersStretcher::getRealTimeAuditLocks() const{return m_d->getRealTimeAuditLocks();}
+size_t
+RubbersStretcher::getDroppedSamples() const{return m_d->getDroppedSamples();}
 
 }
 
@@ -0,0 +1,153 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "rubbers/RubbersStretcherPool.h"
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace Rubbers
+{
+
+class RubbersStretcherPool::Impl
+{
+public:
+    typedef std::tuple<size_t, size_t, RubbersStretcher::Options> Key;
+
+    Impl(size_t maxIdle) : m_maxIdle(maxIdle) { }
+
+    RubbersStretcher *acquire(const Key &key, double ratio, double scale) {
+        std::unique_ptr<RubbersStretcher> s;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            auto &idle = m_idle[key];
+            if (!idle.empty()) {
+                s = std::move(idle.back());
+                idle.pop_back();
+            }
+        }
+        if (s) {
+            // no-ops, without reconfiguring, if the ratios are the
+            // ones the stretcher was last used with
+            s->setTimeRatio(ratio);
+            s->setPitchScale(scale);
+        } else {
+            s = std::make_unique<RubbersStretcher>
+                (std::get<0>(key), std::get<1>(key), std::get<2>(key), ratio, scale);
+        }
+        auto p = s.get();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_lent[p] = std::make_pair(key, std::move(s));
+        return p;
+    }
+
+    void release(RubbersStretcher *p) {
+        std::pair<Key, std::unique_ptr<RubbersStretcher> > entry;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            auto i = m_lent.find(p);
+            if (i == m_lent.end()) {
+                std::cerr << "RubbersStretcherPool::release: stretcher " << p
+                          << " was not acquired from this pool" << std::endl;
+                return;
+            }
+            entry = std::move(i->second);
+            m_lent.erase(i);
+        }
+        entry.second->reset();
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto &idle = m_idle[entry.first];
+        // If the pool is full, the stretcher is destroyed on return
+        // instead, after the lock has been released
+        if (idle.size() < m_maxIdle) idle.push_back(std::move(entry.second));
+    }
+
+    void reserve(const Key &key, size_t count) {
+        if (count > m_maxIdle) count = m_maxIdle;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                if (m_idle[key].size() >= count) return;
+            }
+            auto s = std::make_unique<RubbersStretcher>
+                (std::get<0>(key), std::get<1>(key), std::get<2>(key));
+            std::lock_guard<std::mutex> guard(m_mutex);
+            auto &idle = m_idle[key];
+            if (idle.size() >= count) return;
+            idle.push_back(std::move(s));
+        }
+    }
+
+    size_t getIdleCount() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        size_t n = 0;
+        for (const auto &i : m_idle) n += i.second.size();
+        return n;
+    }
+
+    ~Impl() {
+        if (!m_lent.empty()) {
+            std::cerr << "RubbersStretcherPool::~RubbersStretcherPool: "
+                      << m_lent.size() << " stretcher(s) still acquired" << std::endl;
+        }
+    }
+
+protected:
+    size_t m_maxIdle;
+    mutable std::mutex m_mutex;
+    std::map<Key, std::vector<std::unique_ptr<RubbersStretcher> > > m_idle;
+    std::map<RubbersStretcher *, std::pair<Key, std::unique_ptr<RubbersStretcher> > > m_lent;
+};
+
+RubbersStretcherPool::RubbersStretcherPool(size_t maxIdle) :
+    m_d(new Impl(maxIdle))
+{}
+RubbersStretcherPool::~RubbersStretcherPool(){delete m_d;}
+RubbersStretcher *
+RubbersStretcherPool::acquire(size_t sampleRate,
+                              size_t channels,
+                              RubbersStretcher::Options options,
+                              double initialTimeRatio,
+                              double initialPitchScale)
+{
+    return m_d->acquire(Impl::Key(sampleRate, channels, options),
+                        initialTimeRatio, initialPitchScale);
+}
+void
+RubbersStretcherPool::release(RubbersStretcher *stretcher){m_d->release(stretcher);}
+void
+RubbersStretcherPool::reserve(size_t sampleRate,
+                              size_t channels,
+                              RubbersStretcher::Options options,
+                              size_t count)
+{
+    m_d->reserve(Impl::Key(sampleRate, channels, options), count);
+}
+size_t
+RubbersStretcherPool::getIdleCount() const{return m_d->getIdleCount();}
+
+}
@@ -273,6 +273,11 @@ void
 StretchCalculator::reset(){
     m_prevDf = 0;
     m_divergence = 0;
+    m_recovery = 0;
+    m_prevRatio = 1.0f;
+    m_transientAmnesty = 0;
+    m_keyFrameMap.clear();
+    m_peaks.clear();
 }
 std::vector<StretchCalculator::Peak>
 StretchCalculator::findPeaks(const std::vector<float> &rawDf){
@@ -0,0 +1,237 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "StretcherAsyncWorker.h"
+
+#ifndef NO_THREADING
+
+#include "base/Profiler.h"
+#include "system/Allocators.h"
+
+using std::cerr;
+using std::endl;
+
+namespace Rubbers
+{
+
+RubbersStretcher::Impl::AsyncWorker::AsyncWorker(Impl &stretcher) :
+    m_s(stretcher),
+    m_maxProcessSize(0),
+    m_requests(m_requestCount),
+    m_timeRatio(stretcher.m_timeRatio),
+    m_pitchScale(stretcher.m_pitchScale),
+    m_final(false),
+    m_dropped(0),
+    m_latency(0),
+    m_samplesRequired(0),
+    m_hold(Running),
+    m_exiting(false)
+{
+    m_input.resize(m_s.m_channels, nullptr);
+    m_scratch.resize(m_s.m_channels, nullptr);
+    setMaxProcessSize(m_s.m_maxProcessSize);
+    publish();
+    m_thread = std::thread(&AsyncWorker::run, this);
+}
+RubbersStretcher::Impl::AsyncWorker::~AsyncWorker()
+{
+    stop();
+    for (auto c = size_t{0}; c < m_input.size(); ++c) {
+        delete m_input[c];
+        deallocate(m_scratch[c]);
+    }
+}
+void
+RubbersStretcher::Impl::AsyncWorker::stop()
+{
+    if (!m_thread.joinable()) return;
+    m_exiting = true;
+    m_work.post();
+    m_thread.join();
+}
+void
+RubbersStretcher::Impl::AsyncWorker::publish()
+{
+    m_latency = m_s.calculateLatency();
+    m_samplesRequired = m_s.calculateSamplesRequired();
+}
+size_t
+RubbersStretcher::Impl::AsyncWorker::getSamplesRequired() const
+{
+    // Input already staged will reach the stretcher without being
+    // asked for again
+    auto required = m_samplesRequired.load();
+    auto staged = m_input.empty() ? 0 : m_input[0]->getReadSpace();
+    return required > staged ? required - staged : 0;
+}
+void
+RubbersStretcher::Impl::AsyncWorker::setMaxProcessSize(size_t samples)
+{
+    // The worker only looks at the staging buffers when it has
+    // requests to take, and before processing there are none
+    if (samples <= m_maxProcessSize) return;
+    for (auto c = size_t{0}; c < m_input.size(); ++c) {
+        delete m_input[c];
+        m_input[c] = new RingBuffer<float>(samples * m_blockCount);
+        m_scratch[c] = reallocate<float>(m_scratch[c], m_maxProcessSize, samples);
+    }
+    m_maxProcessSize = samples;
+}
+bool
+RubbersStretcher::Impl::AsyncWorker::enqueue(const Request &request)
+{
+    if (m_requests.getWriteSpace() == 0) {
+        if (m_s.m_debugLevel > 0) {
+            cerr << "RubbersStretcher::Impl::AsyncWorker::enqueue: WARNING: request queue full, worker is not keeping up" << endl;
+        }
+        return false;
+    }
+    m_requests.write(&request, 1);
+    m_work.post();
+    return true;
+}
+void
+RubbersStretcher::Impl::AsyncWorker::process(const float *const *input, size_t samples, bool final)
+{
+    if (m_final) {
+        cerr << "RubbersStretcher::Impl::process: Cannot process again after final chunk" << endl;
+        return;
+    }
+    // Input staged without a request to go with it would be read in
+    // place of the next block, so a full queue drops it too
+    auto full = (m_requests.getWriteSpace() == 0);
+    for (auto c = size_t{0}; c < m_input.size(); ++c) {
+        if (m_input[c]->getWriteSpace() < samples) full = true;
+    }
+    if (full && samples > 0) {
+        // Dropping the block keeps the channels in step; the final
+        // flag must still reach the worker
+        if (m_s.m_debugLevel > 0) {
+            cerr << "RubbersStretcher::Impl::AsyncWorker::process: WARNING: staging buffer full, worker is not keeping up: dropping " << samples << " samples" << endl;
+        }
+        m_dropped += samples;
+        samples = 0;
+        if (!final) return;
+    }
+    for (auto c = size_t{0}; c < m_input.size(); ++c) {
+        m_input[c]->write(input[c], samples);
+    }
+    auto type = final ? Request::FinalInput : Request::Input;
+    if (enqueue(Request{samples, type, 0.0}) && final) m_final = true;
+}
+void
+RubbersStretcher::Impl::AsyncWorker::setTimeRatio(double ratio)
+{
+    if (enqueue(Request{0, Request::TimeRatio, ratio})) m_timeRatio = ratio;
+}
+void
+RubbersStretcher::Impl::AsyncWorker::setPitchScale(double scale)
+{
+    if (enqueue(Request{0, Request::PitchScale, scale})) m_pitchScale = scale;
+}
+void
+RubbersStretcher::Impl::AsyncWorker::hold()
+{
+    if (onWorkerThread()) return;
+    m_hold = HoldRequested;
+    m_work.post();
+    m_parked.wait();
+}
+void
+RubbersStretcher::Impl::AsyncWorker::release()
+{
+    if (onWorkerThread()) return;
+    // Whatever was done while held may have changed these
+    publish();
+    m_hold = Running;
+    m_work.post();
+}
+void
+RubbersStretcher::Impl::AsyncWorker::clear()
+{
+    // A reset keeps the ratios, so those still queued are applied
+    // now rather than lost with the input
+    auto changed = false;
+    while (m_requests.getReadSpace() > 0) {
+        auto request = m_requests.readOne();
+        if (request.type == Request::TimeRatio) m_s.m_timeRatio = request.value;
+        else if (request.type == Request::PitchScale) m_s.m_pitchScale = request.value;
+        else continue;
+        changed = true;
+    }
+    if (changed) m_s.reconfigure();
+    for (auto buf : m_input) buf->reset();
+    m_final = false;
+    m_dropped = 0;
+}
+void
+RubbersStretcher::Impl::AsyncWorker::run()
+{
+    for (;;) {
+        m_work.wait();
+        if (m_exiting) return;
+        // Acknowledge a hold exactly once, however many posts are
+        // outstanding when it arrives
+        auto requested = int(HoldRequested);
+        if (m_hold.compare_exchange_strong(requested, Held)) m_parked.post();
+        if (m_hold != Running) continue;
+        RTAudit::Section audit(m_s.m_audit);
+        while (m_requests.getReadSpace() > 0) {
+            handle(m_requests.readOne());
+            publish();
+            if (m_hold != Running || m_exiting) break;
+        }
+    }
+}
+void
+RubbersStretcher::Impl::AsyncWorker::handle(const Request &request)
+{
+    Profiler profiler("RubbersStretcher::Impl::AsyncWorker::handle");
+    switch (request.type) {
+    case Request::TimeRatio:
+        m_s.setTimeRatio(request.value);
+        return;
+    case Request::PitchScale:
+        m_s.setPitchScale(request.value);
+        return;
+    case Request::Input:
+    case Request::FinalInput:
+        break;
+    }
+    auto final = (request.type == Request::FinalInput);
+    auto remaining = request.samples;
+    // Blocks larger than the max process size, which the caller
+    // should not send, are split
+    do {
+        auto n = std::min(remaining, m_maxProcessSize);
+        for (auto c = size_t{0}; c < m_input.size(); ++c) {
+            m_input[c]->read(m_scratch[c], n);
+        }
+        remaining -= n;
+        m_s.processInput(m_scratch.data(), n, final && remaining == 0);
+    } while (remaining > 0);
+}
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_STRETCHERASYNCWORKER_H_
+#define _RUBBERBAND_STRETCHERASYNCWORKER_H_
+
+#include "StretcherImpl.h"
+
+#ifndef NO_THREADING
+
+#include "system/Semaphore.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Rubbers
+{
+
+/**
+ * AsyncWorker does the processing of a real-time stretcher on a
+ * thread of its own, for OptionThreadingAsync.
+ *
+ * process() on the calling thread only copies the input into a
+ * staging ring buffer per channel, queues a request describing the
+ * block, and posts a Semaphore -- none of which blocks or takes a
+ * lock.  The worker takes the requests in order and passes each
+ * block to the stretcher just as a synchronous process() would have,
+ * so the output is the same; it only reaches the output buffers a
+ * little later.  Time ratio and pitch scale changes go through the
+ * same queue, so they take effect at the same point in the input as
+ * they would have done synchronously.
+ *
+ * Anything else that changes the stretcher's state (reset() and the
+ * option setters) holds the worker instead: it waits for the worker
+ * to finish the block in hand and park, makes its change, and
+ * releases it again.
+ *
+ * The values the caller may ask for that depend on the worker's
+ * state (the latency and the samples required) are published by the
+ * worker after each request, and on release, for the calling thread
+ * to read without touching the stretcher.
+ */
+class RubbersStretcher::Impl::AsyncWorker
+{
+public:
+    AsyncWorker(Impl &stretcher);
+    ~AsyncWorker();
+
+    /**
+     * Size the staging buffers for blocks of up to the given number
+     * of samples.  Only before processing has begun.
+     */
+    void setMaxProcessSize(size_t samples);
+
+    void process(const float *const *input, size_t samples, bool final);
+    void setTimeRatio(double ratio);
+    void setPitchScale(double scale);
+    // As last set, whether or not the worker has reached them yet
+    double getTimeRatio() const { return m_timeRatio; }
+    double getPitchScale() const { return m_pitchScale; }
+    // As last published by the worker, less any input staged since
+    size_t getLatency() const { return m_latency; }
+    size_t getSamplesRequired() const;
+    // Input samples process() has had to drop since the last clear()
+    size_t getDroppedSamples() const { return m_dropped; }
+
+    /**
+     * Let the worker finish the request in hand, and join it.  Any
+     * other requests are left unhandled.
+     */
+    void stop();
+
+    bool onWorkerThread() const {
+        return std::this_thread::get_id() == m_thread.get_id();
+    }
+
+    /**
+     * Wait for the worker to park, and keep it parked until
+     * release().  Does nothing on the worker thread itself, where
+     * the stretcher's state is already safe to change.
+     */
+    void hold();
+    void release();
+
+    /**
+     * Discard any queued input, ready for a reset stretcher, and
+     * apply any queued ratio changes.  Only while held.
+     */
+    void clear();
+
+    class Hold
+    {
+    public:
+        explicit Hold(AsyncWorker *worker) : m_worker(worker) {
+            if (m_worker) m_worker->hold();
+        }
+        ~Hold() { if (m_worker) m_worker->release(); }
+        Hold(const Hold &) = delete;
+        Hold &operator=(const Hold &) = delete;
+    private:
+        AsyncWorker *m_worker;
+    };
+
+protected:
+    struct Request {
+        size_t samples;
+        enum Type { Input, FinalInput, TimeRatio, PitchScale } type;
+        double value;
+    };
+    enum HoldState { Running, HoldRequested, Held };
+    static const size_t m_requestCount = 256;
+    static const size_t m_blockCount = 8; // of max process size, staged
+    void run();
+    void handle(const Request &request);
+    bool enqueue(const Request &request);
+    void publish(); // on the worker, or while it is held
+    Impl &m_s;
+    size_t m_maxProcessSize;
+    std::vector<RingBuffer<float> *> m_input;
+    std::vector<float *> m_scratch;
+    RingBuffer<Request> m_requests;
+    // Belonging to the calling thread
+    double m_timeRatio;
+    double m_pitchScale;
+    bool m_final;
+    size_t m_dropped;
+    std::atomic<size_t> m_latency;
+    std::atomic<size_t> m_samplesRequired;
+    Semaphore m_work;
+    Semaphore m_parked;
+    std::atomic<int> m_hold;
+    std::atomic<bool> m_exiting;
+    std::thread m_thread;
+};
+
+}
+
+#endif
+
+#endif
@@ -70,12 +70,18 @@ RubbersStretcher::Impl::ChannelData::construct(const std::set<size_t> &sizes,
     prevError = allocate_and_zero<float>(realSize);
     unwrappedPhase = allocate_and_zero<float>(realSize);
     envelope = allocate_and_zero<float>(realSize);
+    envelopeMag = allocate_and_zero<float>(realSize);
+    envelopeWarp = allocate_and_zero<int>(realSize);
+    spare = allocate_and_zero<float>(realSize);
+    errorDelta = allocate_and_zero<float>(realSize);
     fltbuf = allocate_and_zero<float>(maxSize);
+    savedFltbuf = allocate_and_zero<float>(maxSize);
     dblbuf = allocate_and_zero<float>(maxSize);
-    accumulator = allocate_and_zero<float>(maxSize);
-    windowAccumulator = allocate_and_zero<float>(maxSize);
+    accumulator = accumulatorBuffer = allocate_and_zero<float>(maxSize);
+    windowAccumulator = windowAccumulatorBuffer = allocate_and_zero<float>(maxSize);
     ms = allocate_and_zero<float>(maxSize);
     interpolator = allocate_and_zero<float>(maxSize);
+    bufferSize = maxSize;
     interpolatorScale = 0;
     for ( auto size : sizes )
     {
@@ -86,6 +92,10 @@ RubbersStretcher::Impl::ChannelData::construct(const std::set<size_t> &sizes,
     resampler = nullptr;
     resamplebuf = 0;
     resamplebufSize = 0;
+    lpcFftSize = 0;
+    bandResampler = nullptr;
+    bandbuf = 0;
+    bandbufSize = 0;
     reset();
     // Avoid dividing opening sample (which will be discarded anyway) by zero
     windowAccumulator[0] = 1.f;
@@ -96,7 +106,21 @@ RubbersStretcher::Impl::ChannelData::setSizes(size_t windowSize,size_t fftSize){
     auto  maxSize = 2 * std::max(windowSize, fftSize);
     auto  realSize = maxSize / 2 + 1;
     auto  oldMax = static_cast<decltype(maxSize)>(inbuf->size());
-    auto  oldReal = oldMax / 2 + 1;
+    auto  oldBufferSize = bufferSize;
+    auto  oldReal = oldBufferSize / 2 + 1;
+    compactAccumulators();
+    envelopeSize = 0;
+    envelopeWarpSize = 0;
+    if (oldMax < maxSize && maxSize <= oldBufferSize) {
+        // The buffers are big enough already (see reserve()), and
+        // the inbuf has room to grow in place
+        if (inbuf->grow(maxSize)) {
+            v_zero(accumulator + oldMax, maxSize - oldMax);
+            v_zero(windowAccumulator + oldMax, maxSize - oldMax);
+            interpolatorScale = 0;
+            oldMax = static_cast<decltype(maxSize)>(inbuf->size());
+        }
+    }
     if (oldMax >= maxSize) {
         // no need to reallocate buffers, just reselect fft
         //!!! we can't actually do this without locking against the
@@ -134,13 +158,19 @@ RubbersStretcher::Impl::ChannelData::setSizes(size_t windowSize,size_t fftSize){
     prevError = reallocate_and_zero(prevError, oldReal, realSize);
     unwrappedPhase = reallocate_and_zero(unwrappedPhase, oldReal, realSize);
     envelope = reallocate_and_zero(envelope, oldReal, realSize);
-    fltbuf = reallocate_and_zero(fltbuf, oldMax, maxSize);
-    dblbuf = reallocate_and_zero(dblbuf, oldMax, maxSize);
-    ms = reallocate_and_zero(ms, oldMax, maxSize);
-    interpolator = reallocate_and_zero(interpolator, oldMax, maxSize);
+    envelopeMag = reallocate_and_zero(envelopeMag, oldReal, realSize);
+    envelopeWarp = reallocate_and_zero(envelopeWarp, oldReal, realSize);
+    spare = reallocate_and_zero(spare, oldReal, realSize);
+    errorDelta = reallocate_and_zero(errorDelta, oldReal, realSize);
+    fltbuf = reallocate_and_zero(fltbuf, oldBufferSize, maxSize);
+    savedFltbuf = reallocate_and_zero(savedFltbuf, oldBufferSize, maxSize);
+    dblbuf = reallocate_and_zero(dblbuf, oldBufferSize, maxSize);
+    ms = reallocate_and_zero(ms, oldBufferSize, maxSize);
+    interpolator = reallocate_and_zero(interpolator, oldBufferSize, maxSize);
     // But we do want to preserve data in these
-    accumulator = reallocate_and_zero_extension (accumulator, oldMax, maxSize);
-    windowAccumulator = reallocate_and_zero_extension (windowAccumulator, oldMax, maxSize);
+    accumulator = accumulatorBuffer = reallocate_and_zero_extension (accumulatorBuffer, oldBufferSize, maxSize);
+    windowAccumulator = windowAccumulatorBuffer = reallocate_and_zero_extension (windowAccumulatorBuffer, oldBufferSize, maxSize);
+    bufferSize = maxSize;
     interpolatorScale = 0;
     //!!! and resampler?
     if (ffts.find(fftSize) == ffts.end()) {
@@ -150,6 +180,62 @@ RubbersStretcher::Impl::ChannelData::setSizes(size_t windowSize,size_t fftSize){
     fft = ffts[fftSize].get();
 }
 void
+RubbersStretcher::Impl::ChannelData::reserve(const std::set<size_t> &fftSizes, size_t maxWindowSize){
+    for (auto size : fftSizes) {
+        if (ffts.find(size) != ffts.end()) continue;
+        ffts[size] = std::make_unique<FFT>(size);
+        ffts[size]->initFloat();
+    }
+    auto maxSize = 2 * maxWindowSize;
+    if (!fftSizes.empty()) maxSize = std::max(maxSize, 2 * *fftSizes.rbegin());
+    if (maxSize <= bufferSize) return;
+    auto realSize = maxSize / 2 + 1;
+    auto oldReal = bufferSize / 2 + 1;
+    auto newbuf = new RingBuffer<float>(inbuf->size(), maxSize);
+    delete inbuf;
+    inbuf = newbuf;
+    mag = reallocate_and_zero(mag, oldReal, realSize);
+    phase = reallocate_and_zero(phase, oldReal, realSize);
+    prevPhase = reallocate_and_zero(prevPhase, oldReal, realSize);
+    prevError = reallocate_and_zero(prevError, oldReal, realSize);
+    unwrappedPhase = reallocate_and_zero(unwrappedPhase, oldReal, realSize);
+    envelope = reallocate_and_zero(envelope, oldReal, realSize);
+    envelopeMag = reallocate_and_zero(envelopeMag, oldReal, realSize);
+    envelopeWarp = reallocate_and_zero(envelopeWarp, oldReal, realSize);
+    spare = reallocate_and_zero(spare, oldReal, realSize);
+    errorDelta = reallocate_and_zero(errorDelta, oldReal, realSize);
+    fltbuf = reallocate_and_zero(fltbuf, bufferSize, maxSize);
+    savedFltbuf = reallocate_and_zero(savedFltbuf, bufferSize, maxSize);
+    dblbuf = reallocate_and_zero(dblbuf, bufferSize, maxSize);
+    ms = reallocate_and_zero(ms, bufferSize, maxSize);
+    interpolator = reallocate_and_zero(interpolator, bufferSize, maxSize);
+    accumulator = accumulatorBuffer = reallocate_and_zero(accumulatorBuffer, bufferSize, maxSize);
+    windowAccumulator = windowAccumulatorBuffer = reallocate_and_zero(windowAccumulatorBuffer, bufferSize, maxSize);
+    bufferSize = maxSize;
+    reset();
+}
+void
+RubbersStretcher::Impl::ChannelData::advanceAccumulators(size_t n, size_t liveSize){
+    // Everything in the buffers from liveSize samples past the
+    // accumulators onwards is zero, so advancing exposes only zeros
+    accumulator += n;
+    windowAccumulator += n;
+    if (size_t(accumulator - accumulatorBuffer) + liveSize > bufferSize) {compactAccumulators();}
+}
+void
+RubbersStretcher::Impl::ChannelData::compactAccumulators(){
+    // Move whatever is left from the accumulators to the end of the
+    // buffers back to the start, and zero the space vacated
+    auto offset = static_cast<size_t>(accumulator - accumulatorBuffer);
+    if (!offset) return;
+    v_move(accumulatorBuffer, accumulator, bufferSize - offset);
+    v_zero(accumulatorBuffer + bufferSize - offset, offset);
+    v_move(windowAccumulatorBuffer, windowAccumulator, bufferSize - offset);
+    v_zero(windowAccumulatorBuffer + bufferSize - offset, offset);
+    accumulator = accumulatorBuffer;
+    windowAccumulator = windowAccumulatorBuffer;
+}
+void
 RubbersStretcher::Impl::ChannelData::setOutbufSize(size_t outbufSize){
     auto oldSize = static_cast<decltype(outbufSize)>(outbuf->size());
 //    std::cerr << "ChannelData::setOutbufSize(" << outbufSize << ") [from " << oldSize << "]" << std::endl;
@@ -166,8 +252,14 @@ RubbersStretcher::Impl::ChannelData::setResampleBufSize(size_t sz){
     resamplebuf = reallocate_and_zero<float>(resamplebuf, resamplebufSize, sz);
     resamplebufSize = sz;
 }
+void
+RubbersStretcher::Impl::ChannelData::setBandBufSize(size_t sz){
+    bandbuf = reallocate_and_zero<float>(bandbuf, bandbufSize, sz);
+    bandbufSize = sz;
+}
 RubbersStretcher::Impl::ChannelData::~ChannelData(){
     deallocate(resamplebuf);
+    deallocate(bandbuf);
     delete inbuf;
     delete outbuf;
     deallocate(mag);
@@ -176,11 +268,16 @@ RubbersStretcher::Impl::ChannelData::~ChannelData(){
     deallocate(prevError);
     deallocate(unwrappedPhase);
     deallocate(envelope);
+    deallocate(envelopeMag);
+    deallocate(envelopeWarp);
+    deallocate(spare);
+    deallocate(errorDelta);
     deallocate(interpolator);
     deallocate(ms);
-    deallocate(accumulator);
-    deallocate(windowAccumulator);
+    deallocate(accumulatorBuffer);
+    deallocate(windowAccumulatorBuffer);
     deallocate(fltbuf);
+    deallocate(savedFltbuf);
     deallocate(dblbuf);
 }
 void
@@ -188,9 +285,11 @@ RubbersStretcher::Impl::ChannelData::reset(){
     inbuf->reset();
     outbuf->reset();
     if (resampler) resampler->reset();
-    auto size = inbuf->size();
-    std::fill_n ( accumulator, size, 0 );
-    std::fill_n ( windowAccumulator, size, 0 );
+    if (bandResampler) bandResampler->reset();
+    accumulator = accumulatorBuffer;
+    windowAccumulator = windowAccumulatorBuffer;
+    v_zero(accumulator, bufferSize);
+    v_zero(windowAccumulator, bufferSize);
     // Avoid dividing opening sample (which will be discarded anyway) by zero
     windowAccumulator[0] = 1.f;
     accumulatorFill = 0;
@@ -200,8 +299,43 @@ RubbersStretcher::Impl::ChannelData::reset(){
     inputSize = -1;
     outCount = 0;
     interpolatorScale = 0;
+    envelopeSize = 0;
+    envelopeWarpScale = 0;
+    envelopeWarpSize = 0;
     unchanged = true;
+    silent = false;
     draining = false;
     outputComplete = false;
 }
+RubbersStretcher::Impl::JointData::JointData(size_t channels_, size_t maxFftSize)
+    : channels(channels_),
+      realSize(maxFftSize / 2 + 1){
+    const auto size = realSize * channels;
+    mag = allocate_and_zero<float>(size);
+    phase = allocate_and_zero<float>(size);
+    prevPhase = allocate_and_zero<float>(size);
+    prevError = allocate_and_zero<float>(size);
+    unwrappedPhase = allocate_and_zero<float>(size);
+    delta = allocate_and_zero<float>(size);
+    shared = allocate_and_zero<float>(realSize);
+    bins = allocate<float>(size);
+    for (auto i = size_t{0}; i < size; ++i) bins[i] = float(i / channels);
+}
+RubbersStretcher::Impl::JointData::~JointData(){
+    deallocate(mag);
+    deallocate(phase);
+    deallocate(prevPhase);
+    deallocate(prevError);
+    deallocate(unwrappedPhase);
+    deallocate(delta);
+    deallocate(shared);
+    deallocate(bins);
+}
+void
+RubbersStretcher::Impl::JointData::reset(){
+    const auto size = realSize * channels;
+    v_zero(prevPhase, size);
+    v_zero(prevError, size);
+    v_zero(unwrappedPhase, size);
+}
 }
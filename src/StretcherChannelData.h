@@ -26,6 +26,7 @@
 
 #include "StretcherImpl.h"
 
+#include <atomic>
 #include <set>
 
 //#define EXPERIMENT 1
@@ -78,6 +79,24 @@ public:
      * be required.
      */
     virtual void setSizes(size_t windowSize, size_t fftSizes);
+    /**
+     * Prepare for setSizes() to be called later with any of the
+     * given FFT sizes and any window size up to maxWindowSize,
+     * without allocating: create the FFTs now, and allocate the
+     * buffers (and room for the inbuf to grow) for the largest
+     * sizes.  The current sizes are unchanged.  This is for use in
+     * RT mode before processing starts; the buffer contents are
+     * cleared.
+     */
+    virtual void reserve(const std::set<size_t> &fftSizes, size_t maxWindowSize);
+    /**
+     * Discard n samples from the front of the overlap-add
+     * accumulators.  The accumulators are windows onto larger
+     * buffers, so this normally just advances them; only when fewer
+     * than liveSize samples would remain before the end of the
+     * buffers are the live samples moved back to the start.
+     */
+    void advanceAccumulators(size_t n, size_t liveSize);
     /**
      * Set the outbufSize for the channel data.  Reallocation will
      * occur.
@@ -88,6 +107,11 @@ public:
      * buffer allocated at all.
      */
     virtual void setResampleBufSize(size_t resamplebufSize);
+    /**
+     * Set the input resampler buffer size, as for
+     * setResampleBufSize.  This is only used when band-limited.
+     */
+    virtual void setBandBufSize(size_t bandbufSize);
     RingBuffer<float> *inbuf;
     RingBuffer<float> *outbuf;
     float *mag;
@@ -95,30 +119,81 @@ public:
     float *prevPhase;
     float *prevError;
     float *unwrappedPhase;
-    float *accumulator;
+    float *accumulator; // points into accumulatorBuffer, see advanceAccumulators
     size_t accumulatorFill;
-    float *windowAccumulator;
+    float *windowAccumulator; // points into windowAccumulatorBuffer at the same offset
     float *ms; // only used when mid-side processing
-    float *interpolator; // only used when time-domain smoothing is on
+    float *interpolator; // sinc interpolator times synthesis window, only used when time-domain smoothing is on
     int interpolatorScale;
     float *fltbuf;
+    float *savedFltbuf; // fltbuf as analysed, see processChunkInBits
     float *dblbuf; // owned by FFT object, only used for time domain FFT i/o
-    float *envelope; // for cepstral formant shift
+    float *envelope; // for formant shift, unshifted
+    float *envelopeMag; // the mag envelope was estimated from, with OptionFormantReused
+    size_t envelopeSize; // FFT size of envelopeMag, or 0 if it is not in use
+    int *envelopeWarp; // gather table for shifting envelope, see formantShiftChunk
+    double envelopeWarpScale; // pitch scale envelopeWarp was built for, or 0
+    size_t envelopeWarpSize; // FFT size envelopeWarp was built for
+    float *spare; // frequency-domain scratch, as for cepstral formant shift
+    float *errorDelta; // frequency-domain scratch for the phase update in modifyChunk
+    size_t bufferSize; // allocated size of fltbuf etc; realSize is half this plus one
     bool unchanged;
+    bool silent; // the current chunk is skipped as silent, see skipIfSilent
     size_t prevIncrement; // only used in RT mode
     size_t chunkCount;
     size_t inCount;
     long inputSize; // set only after known (when data ended); -1 previously
     size_t outCount;
     bool draining;
-    bool outputComplete;
+    std::atomic<bool> outputComplete; // read by available() on another thread in async mode
     FFT *fft;
     std::map<size_t, std::unique_ptr<FFT> > ffts;
     std::unique_ptr<Resampler> resampler;
     float *resamplebuf;
     size_t resamplebufSize;
+    std::unique_ptr<FFT> lpcFft; // for evaluating OptionFormantLPC envelopes
+    size_t lpcFftSize;
+    std::unique_ptr<Resampler> bandResampler; // input side, only when band-limited
+    float *bandbuf;
+    size_t bandbufSize;
 protected:
+    float *accumulatorBuffer;
+    float *windowAccumulatorBuffer;
+    void compactAccumulators();
     virtual void construct(const std::set<size_t> &sizes,size_t initialWindowSize, size_t initialFftSize,size_t outbufSize);
 };        
+
+/**
+ * The phase vocoder's per-bin state for all channels at once, for
+ * OptionChannelsJoint.  Each array holds the bins one after another
+ * with the channels of each bin next to one another, so that the
+ * phase update can work across channels in vector lanes.  The
+ * history here stands in for the prevPhase, prevError and
+ * unwrappedPhase of each ChannelData, which go unused.
+ */
+class RubbersStretcher::Impl::JointData
+{
+public:
+    /**
+     * Construct for the given number of channels and FFT sizes up to
+     * maxFftSize.
+     */
+    JointData(size_t channels, size_t maxFftSize);
+    ~JointData();
+    /**
+     * Clear the history, as for a new stream or FFT size.
+     */
+    void reset();
+    size_t channels;
+    size_t realSize; // bins allocated for, maxFftSize / 2 + 1
+    float *mag;
+    float *phase;
+    float *prevPhase;
+    float *prevError;
+    float *unwrappedPhase;
+    float *delta; // scratch for PhaseAdvance::processJoint
+    float *shared; // per-bin scratch, likewise
+    float *bins; // the bin number of each element
+};
 }
 #endif
@@ -0,0 +1,205 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "StretcherChannelPipeline.h"
+
+#ifndef NO_THREADING
+
+#include "StretcherChannelData.h"
+
+#include "base/Profiler.h"
+#include "system/Allocators.h"
+#include "system/VectorOps.h"
+
+using std::cerr;
+using std::endl;
+
+namespace Rubbers
+{
+
+RubbersStretcher::Impl::ChannelPipeline::ChannelPipeline(Impl &stretcher, size_t channel) :
+    m_s(stretcher),
+    m_channel(channel),
+    m_fft(std::make_unique<FFT>(stretcher.m_fftSize)),
+    m_dblbuf(allocate_and_zero<float>(std::max(stretcher.m_fftSize, stretcher.m_sWindowSize))),
+    m_unchanged(true),
+    m_synced(0),
+    m_analysed(0),
+    m_modified(0),
+    m_synthesised(0),
+    m_exiting(false),
+    m_sleepers(0)
+{
+    m_fft->initFloat();
+    auto wsz = std::max(m_s.m_aWindowSize, m_s.m_sWindowSize);
+    auto realSize = m_s.m_fftSize / 2 + 1;
+    for (auto &f : m_frames) {
+        f.fltbuf = allocate_and_zero<float>(wsz);
+        f.mag = allocate_and_zero<float>(realSize);
+        f.phase = allocate_and_zero<float>(realSize);
+    }
+    m_modifier = std::thread(&ChannelPipeline::modifyThread, this);
+    m_synthesiser = std::thread(&ChannelPipeline::synthesiseThread, this);
+}
+RubbersStretcher::Impl::ChannelPipeline::~ChannelPipeline()
+{
+    m_exiting = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_all();
+    }
+    m_modifier.join();
+    m_synthesiser.join();
+    for (auto &f : m_frames) {
+        deallocate(f.fltbuf);
+        deallocate(f.mag);
+        deallocate(f.phase);
+    }
+    deallocate(m_dblbuf);
+}
+void
+RubbersStretcher::Impl::ChannelPipeline::process(bool &any, bool &last)
+{
+    Profiler profiler("RubbersStretcher::Impl::ChannelPipeline::process");
+    // This is the analysis stage, and follows processNextChunk except
+    // that each frame is analysed into a buffer of its own and then
+    // handed on to the modify stage.
+    auto &cd = *m_s.m_channelData[m_channel];
+    auto n = m_analysed.load(std::memory_order_relaxed);
+    any = false;
+    last = false;
+    m_unchanged = cd.unchanged;
+    while (!last) {
+        if (!m_s.testInbufReadSpace(m_channel)) {
+            if (m_s.m_debugLevel > 2) {cerr << "processChunks: out of input" << endl;}
+            break;
+        }
+        any = true;
+        auto phaseReset = false;
+        auto phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
+        m_s.getIncrements(m_channel, phaseIncrement, shiftIncrement, phaseReset);
+        if (cd.draining ||
+            shiftIncrement > m_s.m_aWindowSize ||
+            cd.inbuf->getReadSpace() < m_s.m_aWindowSize) {
+            drain(n);
+            m_s.processNextChunk(m_channel, last);
+            m_unchanged = cd.unchanged;
+            continue;
+        }
+        if (n >= m_frameCount) wait(m_synthesised, n + 1 - m_frameCount);
+        auto &f = m_frames[n % m_frameCount];
+        cd.inbuf->peek(f.fltbuf, m_s.m_aWindowSize);
+        cd.inbuf->skip(m_s.m_increment);
+        f.silent = m_s.skipIfSilent(f.fltbuf, f.mag, f.phase);
+        if (!f.silent) m_s.analyseChunk(cd, f.fltbuf, f.mag, f.phase);
+        f.phaseIncrement = phaseIncrement;
+        f.shiftIncrement = shiftIncrement;
+        f.phaseReset = phaseReset;
+        cd.chunkCount++;
+        advance(m_analysed, ++n);
+    }
+    drain(n);
+}
+void
+RubbersStretcher::Impl::ChannelPipeline::drain(size_t frames)
+{
+    // Wait for every frame analysed so far to be written, then leave
+    // behind the state the serial code would have left: it reuses
+    // fltbuf as synthesis scratch space, and the tail of a short
+    // final chunk is read from there as it stands.
+    wait(m_synthesised, frames);
+    if (frames > m_synced) {
+        auto &cd = *m_s.m_channelData[m_channel];
+        v_copy(cd.fltbuf, m_frames[(frames - 1) % m_frameCount].fltbuf, m_s.m_sWindowSize);
+        cd.unchanged = m_unchanged;
+        m_synced = frames;
+    }
+}
+void
+RubbersStretcher::Impl::ChannelPipeline::modifyThread()
+{
+    auto &cd = *m_s.m_channelData[m_channel];
+    for (auto n = size_t{0}; wait(m_analysed, n + 1); ++n) {
+        auto &f = m_frames[n % m_frameCount];
+        if (f.silent) {
+            m_s.modifySilentChunk(cd);
+            f.unchanged = m_unchanged = true;
+            advance(m_modified, n + 1);
+            continue;
+        }
+        f.unchanged = m_s.modifyChunk(cd, f.mag, f.phase, f.phaseIncrement,
+                                      f.phaseReset, m_unchanged);
+        // The synthesis stage will mark any formant-shifted frame
+        // as changed, and the next frame must see it that way too
+        m_unchanged = f.unchanged && !m_s.formantShifting();
+        advance(m_modified, n + 1);
+    }
+}
+void
+RubbersStretcher::Impl::ChannelPipeline::synthesiseThread()
+{
+    auto &cd = *m_s.m_channelData[m_channel];
+    for (auto n = size_t{0}; wait(m_modified, n + 1); ++n) {
+        auto &f = m_frames[n % m_frameCount];
+        if (f.silent) {
+            m_s.accumulateChunk(cd, nullptr, nullptr, false, f.shiftIncrement);
+        } else {
+            m_s.synthesiseChunk(cd, f.mag, f.phase, f.fltbuf, m_dblbuf,
+                                *m_fft, f.unchanged, f.shiftIncrement);
+        }
+        m_s.writeChunkForChannel(m_channel, f.shiftIncrement, false);
+        advance(m_synthesised, n + 1);
+    }
+}
+bool
+RubbersStretcher::Impl::ChannelPipeline::wait(const std::atomic<size_t> &counter, size_t target)
+{
+    // Wait for counter to reach target, returning false if we are
+    // shutting down first.  Frames take tens of microseconds, so a
+    // short spin usually catches the next one without sleeping.
+    for (int i = 0; i < 100; ++i) {
+        if (counter.load(std::memory_order_acquire) >= target) return true;
+        if (m_exiting) return false;
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_sleepers;
+    m_condition.wait(lock, [&] { return counter >= target || m_exiting; });
+    --m_sleepers;
+    return counter >= target;
+}
+void
+RubbersStretcher::Impl::ChannelPipeline::advance(std::atomic<size_t> &counter, size_t value)
+{
+    // Sequentially consistent, so that either a stage about to sleep
+    // sees the new value or we see it counted in m_sleepers
+    counter = value;
+    if (m_sleepers > 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_all();
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_STRETCHERCHANNELPIPELINE_H_
+#define _RUBBERBAND_STRETCHERCHANNELPIPELINE_H_
+
+#include "StretcherImpl.h"
+
+#ifndef NO_THREADING
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Rubbers
+{
+
+/**
+ * ChannelPipeline runs the offline processing of a single channel as
+ * three overlapping stages: analysis (forward FFT) on the thread
+ * calling process(), phase modification on a second thread, and
+ * synthesis and overlap-add on a third.  Frames pass between the
+ * stages through a small ring of frame buffers, whose ownership is
+ * handed on by advancing one sequence counter per stage, so the
+ * steady state takes no locks.  A stage that finds nothing to do
+ * spins briefly and then sleeps until it is woken.
+ *
+ * Only frames with a full analysis window and an ordinary shift
+ * increment go through the pipeline.  On reaching anything else (the
+ * final draining chunks, or an overlong increment) the pipeline is
+ * emptied and the frame handed to the serial code, which then sees
+ * exactly the channel state it would have had without pipelining.
+ */
+class RubbersStretcher::Impl::ChannelPipeline
+{
+public:
+    ChannelPipeline(Impl &stretcher, size_t channel);
+    ~ChannelPipeline();
+    /**
+     * Process as many chunks as are available on the channel's input
+     * buffer, as Impl::processChunks, returning once all of them have
+     * been written to the output buffer.
+     */
+    void process(bool &any, bool &last);
+protected:
+    struct Frame {
+        float *fltbuf;
+        float *mag;
+        float *phase;
+        size_t phaseIncrement;
+        size_t shiftIncrement;
+        bool phaseReset;
+        bool unchanged;
+        bool silent;
+    };
+    static const size_t m_frameCount = 4;
+    void modifyThread();
+    void synthesiseThread();
+    void drain(size_t frames);
+    bool wait(const std::atomic<size_t> &counter, size_t target);
+    void advance(std::atomic<size_t> &counter, size_t value);
+    Impl &m_s;
+    size_t m_channel;
+    Frame m_frames[m_frameCount];
+    std::unique_ptr<FFT> m_fft; // synthesis must not share the analysis FFT
+    float *m_dblbuf;
+    bool m_unchanged; // belongs to the modify stage while frames are in flight
+    size_t m_synced; // frames analysed when the channel was last brought up to date
+    std::atomic<size_t> m_analysed;
+    std::atomic<size_t> m_modified;
+    std::atomic<size_t> m_synthesised;
+    std::atomic<bool> m_exiting;
+    std::atomic<int> m_sleepers;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_modifier;
+    std::thread m_synthesiser;
+};
+
+}
+
+#endif
+
+#endif
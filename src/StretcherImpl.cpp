@@ -34,11 +34,17 @@
 
 #include "StretchCalculator.h"
 #include "StretcherChannelData.h"
+#include "StretcherChannelPipeline.h"
+#include "StretcherSegment.h"
+#include "StretcherAsyncWorker.h"
 
 #include "base/Profiler.h"
+#include "system/ThreadPool.h"
+#include "system/VectorOpsDispatch.h"
 
 #include <alloca.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <set>
@@ -62,13 +68,13 @@ const size_t
 RubbersStretcher::Impl::m_defaultFftSize = 2048;
 int
 RubbersStretcher::Impl::m_defaultDebugLevel = 0;
-static bool _initialised = false;
 RubbersStretcher::Impl::Impl(size_t sampleRate,
                                 size_t channels,
                                 Options options,
                                 double initialTimeRatio,
                                 double initialPitchScale) :
     m_sampleRate(sampleRate),
+    m_inputRate(sampleRate),
     m_channels(channels),
     m_timeRatio(initialTimeRatio),
     m_pitchScale(initialPitchScale),
@@ -79,6 +85,8 @@ RubbersStretcher::Impl::Impl(size_t sampleRate,
     m_outbufSize(m_defaultFftSize * 2),
     m_maxProcessSize(m_defaultFftSize),
     m_expectedInputDuration(0),
+    m_minPitchScale(0.25),
+    m_maxPitchScale(4.0),
     m_realtime(false),
     m_options(options),
     m_debugLevel(m_defaultDebugLevel),
@@ -92,27 +100,20 @@ RubbersStretcher::Impl::Impl(size_t sampleRate,
     m_freq2(12000),
     m_baseFftSize(m_defaultFftSize)
 {
-    if (!_initialised) {
-        system_specific_initialise();
-        _initialised = true;
-    }
+    // once per process, safe against concurrent construction; this
+    // also selects the vector kernels, so that the first process()
+    // call doesn't
+    static const bool initialised = (system_specific_initialise(), vector_kernels(), true);
+    (void)initialised;
     if (m_debugLevel > 0) {
-        cerr << "RubbersStretcher::Impl::Impl: rate = " << m_sampleRate << ", options = " << options << endl;
+        cerr << "RubbersStretcher::Impl::Impl: rate = " << m_sampleRate << ", options = " << options
+             << ", vector kernels = " << vector_level_name(vector_level())
+             << " " << vector_accuracy_name(vector_accuracy()) << endl;
     }
-    // Window size will vary according to the audio sample rate, but
-    // we don't let it drop below the 48k default
-    m_rateMultiple = float(m_sampleRate) / 48000.f;
-//    if (m_rateMultiple < 1.f) m_rateMultiple = 1.f;
-    m_baseFftSize = roundUp(int(m_defaultFftSize * m_rateMultiple));
+    calculateBaseFftSize();
     if ((options & OptionWindowShort) || (options & OptionWindowLong)) {
         if ((options & OptionWindowShort) && (options & OptionWindowLong)) {
             cerr << "RubbersStretcher::Impl::Impl: Cannot specify OptionWindowLong and OptionWindowShort together; falling back to OptionWindowStandard" << endl;
-        } else if (options & OptionWindowShort) {
-            m_baseFftSize = m_baseFftSize / 2;
-            if (m_debugLevel > 0) {cerr << "setting baseFftSize to " << m_baseFftSize << endl;}
-        } else if (options & OptionWindowLong) {
-            m_baseFftSize = m_baseFftSize * 2;
-            if (m_debugLevel > 0) {cerr << "setting baseFftSize to " << m_baseFftSize << endl;}
         }
         m_fftSize = m_baseFftSize;
         m_aWindowSize = m_baseFftSize;
@@ -124,9 +125,51 @@ RubbersStretcher::Impl::Impl(size_t sampleRate,
         m_realtime = true;
         if (!(m_options & OptionStretchPrecise)) {m_options |= OptionStretchPrecise;}
     }
+#ifndef NO_THREADING
+    // Channels are only processed independently in offline mode; in
+    // RT mode they must advance in step for the onset detector
+    m_threaded = false;
+    if (m_channels > 1 && !m_realtime && !(m_options & OptionThreadingNever)) {
+        m_threaded = (m_options & OptionThreadingAlways) || system_is_multiprocessor();
+        if (m_threaded && m_debugLevel > 0) {
+            cerr << "Using shared thread pool (" << ThreadPool::instance().getWorkerCount() << " workers)" << endl;
+        }
+    }
+    m_pipelined = (!m_realtime &&
+                   (m_options & OptionThreadingPipelined) &&
+                   !(m_options & OptionThreadingNever));
+    if (m_pipelined && m_debugLevel > 0) {
+        cerr << "Using pipelined analysis and synthesis threads" << endl;
+    }
+    m_segmented = (!m_realtime &&
+                   (m_options & OptionThreadingSegmented) &&
+                   !(m_options & OptionThreadingNever));
+    // OptionChannelsJoint needs every channel's phases for each
+    // chunk, so the channels can't go their own ways
+    if ((m_options & OptionChannelsJoint) && m_channels > 1) {
+        m_threaded = false;
+        m_pipelined = false;
+        m_segmented = false;
+    }
+#endif
     configure();
+#ifndef NO_THREADING
+    if (m_realtime &&
+        (m_options & OptionThreadingAsync) &&
+        !(m_options & OptionThreadingNever)) {
+        if (m_debugLevel > 0) {cerr << "Using async worker thread" << endl;}
+        m_asyncWorker = std::make_unique<AsyncWorker>(*this);
+    }
+#endif
 }
 RubbersStretcher::Impl::~Impl(){
+#ifndef NO_THREADING
+    // The worker may still be using m_asyncWorker until it is joined
+    if (m_asyncWorker) m_asyncWorker->stop();
+    m_asyncWorker.reset();
+    m_segmentGroup.reset();
+    m_pipelines.clear();
+#endif
     for (size_t c = 0; c < m_channels; ++c) {delete m_channelData[c];}
     delete m_phaseResetAudioCurve;
     delete m_stretchAudioCurve;
@@ -134,19 +177,59 @@ RubbersStretcher::Impl::~Impl(){
 }
 void
 RubbersStretcher::Impl::reset(){
+    // Return to the state configure() leaves behind, without
+    // allocating: everything sized by configure() is kept as it is,
+    // and only state written during processing is cleared.
+#ifndef NO_THREADING
+    AsyncWorker::Hold hold(m_asyncWorker.get());
+    if (m_asyncWorker) m_asyncWorker->clear();
+#endif
     m_emergencyScavenger.scavenge();
-    if (m_stretchCalculator) {m_stretchCalculator->setKeyFrameMap(std::map<size_t, size_t>());}
+    if (m_stretchCalculator) {m_stretchCalculator->reset();}
+    if (m_studyResampler) m_studyResampler->reset();
+#ifndef NO_THREADING
+    // Pipelines are always drained between calls and carry nothing
+    // over, so they are kept (with their threads) for the next use
+    if (m_segmentGroup) m_segmentGroup->wait();
+    for (auto &s : m_openSegments) s.reset();
+    for (auto &s : m_renderingSegments) s.clear();
+    m_segmentStarts.clear();
+#endif
+    for (auto &f : m_followers) f->reset();
     for (size_t c = 0; c < m_channels; ++c) {m_channelData[c]->reset();}
+    if (m_joint) m_joint->reset();
     m_mode = JustCreated;
     if (m_phaseResetAudioCurve) m_phaseResetAudioCurve->reset();
     if (m_stretchAudioCurve) m_stretchAudioCurve->reset();
     if (m_silentAudioCurve) m_silentAudioCurve->reset();
+    m_phaseResetDf.clear();
+    m_stretchDf.clear();
+    m_silence.clear();
+    m_outputIncrements.clear();
+    m_lastProcessOutputIncrements.reset();
+    m_lastProcessPhaseResetDf.reset();
     m_inputDuration = 0;
     m_silentHistory = 0;
-    reconfigure();
+    m_chunksAnalysed = 0;
+    m_chunksSkipped = 0;
+    m_bypassGain = 0.f;
+    m_bypassTarget = false;
+    m_bypassHeld = 0;
+    m_bypassLeaving = false;
+    if (!m_realtime) {
+        // as in configure()
+        for (size_t c = 0; c < m_channels; ++c) {m_channelData[c]->inbuf->zero(m_aWindowSize/2);}
+    }
 }
 void
 RubbersStretcher::Impl::setTimeRatio(double ratio){
+    RTAudit::Section audit(m_audit);
+#ifndef NO_THREADING
+    if (m_asyncWorker && !m_asyncWorker->onWorkerThread()) {
+        m_asyncWorker->setTimeRatio(ratio);
+        return;
+    }
+#endif
     if (!m_realtime) {
         if (m_mode == Studying || m_mode == Processing) {
             cerr << "RubbersStretcher::Impl::setTimeRatio: Cannot set ratio while studying or processing in non-RT mode" << endl;
@@ -159,6 +242,13 @@ RubbersStretcher::Impl::setTimeRatio(double ratio){
 }
 void
 RubbersStretcher::Impl::setPitchScale(double fs){
+    RTAudit::Section audit(m_audit);
+#ifndef NO_THREADING
+    if (m_asyncWorker && !m_asyncWorker->onWorkerThread()) {
+        m_asyncWorker->setPitchScale(fs);
+        return;
+    }
+#endif
     if (!m_realtime) {
         if (m_mode == Studying || m_mode == Processing) {
             cerr << "RubbersStretcher::Impl::setPitchScale: Cannot set ratio while studying or processing in non-RT mode" << endl;
@@ -170,7 +260,10 @@ RubbersStretcher::Impl::setPitchScale(double fs){
     bool rbs = resampleBeforeStretching();
     m_pitchScale = fs;
     reconfigure();
+    // When band-limited the resamplers keep to their sides, and only
+    // their ratios change
     if (!(m_options & OptionPitchHighConsistency) &&
+        m_bandRatio == 1.0 &&
         (was1 || resampleBeforeStretching() != rbs) &&
         m_pitchScale != 1.f) {
         // resampling mode has changed
@@ -180,9 +273,19 @@ RubbersStretcher::Impl::setPitchScale(double fs){
     }
 }
 double
-RubbersStretcher::Impl::getTimeRatio() const{return m_timeRatio;}
+RubbersStretcher::Impl::getTimeRatio() const{
+#ifndef NO_THREADING
+    if (m_asyncWorker && !m_asyncWorker->onWorkerThread()) return m_asyncWorker->getTimeRatio();
+#endif
+    return m_timeRatio;
+}
 double
-RubbersStretcher::Impl::getPitchScale() const{return m_pitchScale;}
+RubbersStretcher::Impl::getPitchScale() const{
+#ifndef NO_THREADING
+    if (m_asyncWorker && !m_asyncWorker->onWorkerThread()) return m_asyncWorker->getPitchScale();
+#endif
+    return m_pitchScale;
+}
 void
 RubbersStretcher::Impl::setExpectedInputDuration(size_t samples){
     if (samples == m_expectedInputDuration) return;
@@ -194,6 +297,54 @@ RubbersStretcher::Impl::setMaxProcessSize(size_t samples){
     if (samples <= m_maxProcessSize) return;
     m_maxProcessSize = samples;
     reconfigure();
+#ifndef NO_THREADING
+    if (m_asyncWorker) m_asyncWorker->setMaxProcessSize(m_maxProcessSize);
+#endif
+}
+void
+RubbersStretcher::Impl::setPitchScaleRange(double minScale, double maxScale){
+    if (minScale <= 0.0 || maxScale < minScale) {
+        cerr << "RubbersStretcher::Impl::setPitchScaleRange: Invalid range " << minScale << " to " << maxScale << endl;
+        return;
+    }
+    if (!m_realtime) return;
+    if (m_mode != JustCreated) {
+        cerr << "RubbersStretcher::Impl::setPitchScaleRange: Cannot set range after process() has begun" << endl;
+        return;
+    }
+    m_minPitchScale = minScale;
+    m_maxPitchScale = maxScale;
+    configure();
+#ifndef NO_THREADING
+    if (m_asyncWorker) m_asyncWorker->setMaxProcessSize(m_maxProcessSize);
+#endif
+}
+void
+RubbersStretcher::Impl::setBandwidth(double frequency){
+    if (m_mode != JustCreated) {
+        cerr << "RubbersStretcher::Impl::setBandwidth: Cannot set bandwidth after study() or process() has begun" << endl;
+        return;
+    }
+    // Process at the lowest rate whose resampling keeps the band
+    // intact.  The resamplers pass 80% of the lower Nyquist frequency,
+    // so that is 2.5 times the bandwidth; and it isn't worth resampling
+    // to save less than a quarter of the rate.
+    auto rate = m_inputRate;
+    if (frequency > 0.0) {
+        auto reduced = size_t(ceil(frequency * 2.5));
+        if (reduced * 4 <= m_inputRate * 3) rate = reduced;
+    }
+    if (rate == m_sampleRate) return;
+    m_sampleRate = rate;
+    m_bandRatio = double(m_sampleRate) / double(m_inputRate);
+    if (m_debugLevel > 0) {
+        cerr << "RubbersStretcher::Impl::setBandwidth: processing at " << m_sampleRate << "Hz for bandwidth " << frequency << "Hz" << endl;
+    }
+    calculateBaseFftSize();
+    configure();
+#ifndef NO_THREADING
+    if (m_asyncWorker) m_asyncWorker->setMaxProcessSize(m_maxProcessSize);
+#endif
 }
 void
 RubbersStretcher::Impl::setKeyFrameMap(const std::map<size_t, size_t> &
@@ -206,7 +357,17 @@ RubbersStretcher::Impl::setKeyFrameMap(const std::map<size_t, size_t> &
         cerr << "RubbersStretcher::Impl::setKeyFrameMap: Cannot specify key frame map after process() has begun" << endl;
         return;
     }
-    if (m_stretchCalculator) {m_stretchCalculator->setKeyFrameMap(mapping);}
+    if (!m_stretchCalculator) return;
+    if (m_bandRatio == 1.0) {
+        m_stretchCalculator->setKeyFrameMap(mapping);
+        return;
+    }
+    // The stretch is calculated at our own rate
+    std::map<size_t, size_t> scaled;
+    for (const auto &m : mapping) {
+        scaled[size_t(lrint(m.first * m_bandRatio))] = size_t(lrint(m.second * m_bandRatio));
+    }
+    m_stretchCalculator->setKeyFrameMap(scaled);
 }
 
 float
@@ -228,6 +389,14 @@ RubbersStretcher::Impl::setFrequencyCutoff(int n, float f){
     }
 }
 
+double
+RubbersStretcher::Impl::getSilenceSkipRate() const
+{
+    size_t analysed = m_chunksAnalysed;
+    if (analysed == 0) return 0.0;
+    return double(m_chunksSkipped) / double(analysed);
+}
+
 double
 RubbersStretcher::Impl::getEffectiveRatio() const
 {
@@ -254,6 +423,22 @@ RubbersStretcher::Impl::roundUp(size_t value){
     return value;
 }
 
+void
+RubbersStretcher::Impl::calculateBaseFftSize(){
+    // Window size will vary according to the audio sample rate, but
+    // we don't let it drop below the 48k default
+    m_rateMultiple = float(m_sampleRate) / 48000.f;
+//    if (m_rateMultiple < 1.f) m_rateMultiple = 1.f;
+    m_baseFftSize = roundUp(int(m_defaultFftSize * m_rateMultiple));
+    if ((m_options & OptionWindowShort) && (m_options & OptionWindowLong)) return;
+    if (m_options & OptionWindowShort) {
+        m_baseFftSize = m_baseFftSize / 2;
+        if (m_debugLevel > 0) {cerr << "setting baseFftSize to " << m_baseFftSize << endl;}
+    } else if (m_options & OptionWindowLong) {
+        m_baseFftSize = m_baseFftSize * 2;
+        if (m_debugLevel > 0) {cerr << "setting baseFftSize to " << m_baseFftSize << endl;}
+    }
+}
 void
 RubbersStretcher::Impl::calculateSizes(){
     auto inputIncrement = m_defaultIncrement;
@@ -272,6 +457,9 @@ RubbersStretcher::Impl::calculateSizes(){
         m_timeRatio = 1.0;
     }
     auto r = getEffectiveRatio();
+    // Any additional time ratios share our analysis, so size it for
+    // whichever ratio needs the shortest increment
+    for (const auto &f : m_followers) r = std::max(r, f->m_timeRatio * m_pitchScale);
     if (m_realtime) {
         if (r < 1) {
             auto rsb = (m_pitchScale < 1.0 && !resampleBeforeStretching());
@@ -337,7 +525,13 @@ RubbersStretcher::Impl::calculateSizes(){
             if (r > 5) while (windowSize < 8192) windowSize *= 2;
         }
     }
-    if (m_expectedInputDuration > 0) {while (inputIncrement * 4 > m_expectedInputDuration && inputIncrement > 1) {inputIncrement /= 2;}}
+    if (m_expectedInputDuration > 0) {while (inputIncrement * 4 > m_expectedInputDuration * m_bandRatio && inputIncrement > 1) {inputIncrement /= 2;}}
+    if (m_leader) {
+        // A follower does no analysis of its own, so it must work
+        // with the same increment and window as its leader
+        inputIncrement = m_leader->m_increment;
+        windowSize = m_leader->m_fftSize;
+    }
     // m_fftSize can be almost anything, but it can't be greater than
     // 4 * m_baseFftSize unless ratio is less than 1/1024.
     m_fftSize = windowSize;
@@ -360,20 +554,47 @@ RubbersStretcher::Impl::calculateSizes(){
         cerr << "configure: analysis window size = " << m_aWindowSize << ", synthesis window size = " << m_sWindowSize << ", fft size = " << m_fftSize << ", increment = " << m_increment << " (approx output increment = " << int(lrint(m_increment * getEffectiveRatio())) << ")" << endl;
     }
     if (std::max(m_aWindowSize, m_sWindowSize) > m_maxProcessSize) {m_maxProcessSize = std::max(m_aWindowSize, m_sWindowSize);}
-    m_outbufSize =
+    auto processSize = m_maxProcessSize;
+    auto pitchScale = m_pitchScale;
+    if (m_realtime) {
+        // Size for the largest window and lowest pitch scale we are
+        // prepared for, so that the outbuf need not grow when they
+        // change
+        auto minFftSize = size_t{0}, maxWindowSize = size_t{0};
+        getRealTimeFftSizeRange(minFftSize, maxWindowSize);
+        if (m_options & OptionSmoothingOn) maxWindowSize *= 2;
+        processSize = std::max(processSize, maxWindowSize);
+        pitchScale = std::min(pitchScale, m_minPitchScale);
+    }
+    // The outbuf is at the caller's rate, so holds more when
+    // band-limited
+    auto outbufSize =
         size_t
         (ceil(max
-              (m_maxProcessSize / m_pitchScale,
-               m_maxProcessSize * 2 * (m_timeRatio > 1.f ? m_timeRatio : 1.f))));
+              (processSize / (pitchScale * m_bandRatio),
+               processSize * 2 * (m_timeRatio > 1.f ? m_timeRatio : 1.f) / m_bandRatio)));
     if (m_realtime) {
-        // This headroom is so as to try to avoid reallocation when
-        // the pitch scale changes
-        m_outbufSize = m_outbufSize * 16;
+        // Only ever grow, and then with headroom, so as to try to
+        // avoid reallocation when the time ratio changes
+        if (outbufSize > m_outbufSize) m_outbufSize = outbufSize * 4;
     } else {
+        m_outbufSize = outbufSize;
     }
     if (m_debugLevel > 0) {cerr << "configure: outbuf size = " << m_outbufSize << endl;}
 }
-
+void
+RubbersStretcher::Impl::getRealTimeFftSizeRange(size_t &minSize, size_t &maxSize){
+    // In RT mode, calculateSizes() starts from the base FFT size.  It
+    // doubles it, to no more than four times, for long stretches, and
+    // it reduces it, to no less than 512 (or the base size if that
+    // is smaller), for pitch shifts resampled before stretching.  All
+    // the sizes are powers of two.
+    auto maxPitchScale = std::max(m_pitchScale, m_maxPitchScale);
+    minSize = std::max(std::min(m_baseFftSize, size_t(512)),
+                       roundUp(lrint(m_baseFftSize / maxPitchScale)));
+    minSize = std::min(minSize, m_baseFftSize / 2);
+    maxSize = m_baseFftSize * 4;
+}
 void
 RubbersStretcher::Impl::configure(){
 //    std::cerr << "configure[" << this << "]: realtime = " << m_realtime << ", pitch scale = "
@@ -383,11 +604,13 @@ RubbersStretcher::Impl::configure(){
     auto prevAWindowSize = m_aWindowSize;
     auto prevSWindowSize = m_sWindowSize;
     auto prevOutbufSize  = m_outbufSize;
+    auto prevIncrement   = m_increment;
     if (m_windows.empty()) {
         prevFftSize = 0;
         prevAWindowSize = 0;
         prevSWindowSize = 0;
         prevOutbufSize = 0;
+        prevIncrement = 0;
     }
 
     calculateSizes();
@@ -414,11 +637,24 @@ RubbersStretcher::Impl::configure(){
     windowSizes.insert(m_fftSize);
     windowSizes.insert(m_aWindowSize);
     windowSizes.insert(m_sWindowSize);
-    if (windowSizeChanged) {
-        for (auto  i : windowSizes ){
-            if (m_windows.find(i) == m_windows.end()) {m_windows[i] = std::make_unique< Window<float> >(HanningWindow, i);}
-            if (m_sincs.find(i) == m_sincs.end()) {m_sincs[i] = std::make_unique<SincWindow<float> > (i, i);}
+    // In RT mode, everything that reconfigure() may switch to is made
+    // here, so that changing the ratios need not allocate
+    set<size_t> rtFftSizes;
+    auto rtWindowSizes = windowSizes;
+    if (m_realtime) {
+        auto minFftSize = size_t{0}, maxFftSize = size_t{0};
+        getRealTimeFftSizeRange(minFftSize, maxFftSize);
+        for (auto size = minFftSize; size <= maxFftSize; size *= 2) {
+            rtFftSizes.insert(size);
+            rtWindowSizes.insert(size);
+            if (m_options & OptionSmoothingOn) rtWindowSizes.insert(size * 2);
         }
+    }
+    for (auto  i : rtWindowSizes ){
+        if (m_windows.find(i) == m_windows.end()) {m_windows[i] = Window<float>::shared(HanningWindow, i);}
+        if (m_sincs.find(i) == m_sincs.end()) {m_sincs[i] = SincWindow<float>::shared(i, i);}
+    }
+    if (windowSizeChanged) {
         m_awindow = m_windows[m_aWindowSize].get();
         m_afilter = m_sincs[m_aWindowSize].get();
         m_swindow = m_windows[m_sWindowSize].get();
@@ -426,6 +662,20 @@ RubbersStretcher::Impl::configure(){
             cerr << "Window area: " << m_awindow->getArea() << "; synthesis window area: " << m_swindow->getArea() << endl;
         }
     }
+    m_sWindowScaled.reserve(*rtWindowSizes.rbegin());
+    m_sWindowWeights.reserve(*rtWindowSizes.rbegin());
+    if (fftSizeChanged || windowSizeChanged) {updateSynthesisWindow();}
+#ifndef NO_THREADING
+    // Pipelines are sized for the FFT and windows and refer to the
+    // channel data, and are started again on first use
+    if (fftSizeChanged || windowSizeChanged || outbufSizeChanged) {
+        m_pipelines.clear();
+        m_pipelines.resize(m_channels);
+    }
+    m_openSegments.clear();
+    m_openSegments.resize(m_channels);
+    m_renderingSegments = decltype(m_renderingSegments)(m_channels);
+#endif
     if (windowSizeChanged || outbufSizeChanged) {
         for (size_t c = 0; c < m_channelData.size(); ++c) {delete m_channelData[c];}
         m_channelData.clear();
@@ -437,44 +687,127 @@ RubbersStretcher::Impl::configure(){
                                  m_outbufSize));
         }
     }
+    if (m_realtime) {
+        for (size_t c = 0; c < m_channels; ++c) {m_channelData[c]->reserve(rtFftSizes, *rtWindowSizes.rbegin());}
+    }
+    // The first channel's FFTs also do the batched transforms of
+    // processOneChunk and processChunksInStep, for every size
+    // reconfigure() may pick
+    if (m_channels > 1) {
+        for (auto &f : m_channelData[0]->ffts) f.second->initFloatBatch(int(m_channels));
+    }
+    // The joint state is sized for the largest FFT reconfigure() may
+    // switch to
+    if ((m_options & OptionChannelsJoint) && m_channels > 1) {
+        auto jointFftSize = m_fftSize;
+        if (!rtFftSizes.empty()) jointFftSize = std::max(jointFftSize, *rtFftSizes.rbegin());
+        if (!m_joint || m_joint->realSize < jointFftSize / 2 + 1) {
+            m_joint = std::make_unique<JointData>(m_channels, jointFftSize);
+        } else if (fftSizeChanged) {
+            m_joint->reset();
+        }
+    }
+    // The OptionFormantLPC envelope's FFT is made whether or not the
+    // option is set, as the option may be changed at any time
+    for (size_t c = 0; c < m_channels; ++c) {
+        auto &cd = *m_channelData[c];
+        if (cd.lpcFftSize != lpcFftSize()) {
+            cd.lpcFft = std::make_unique<FFT>(int(lpcFftSize()), m_debugLevel);
+            cd.lpcFft->initFloat();
+            cd.lpcFftSize = lpcFftSize();
+        }
+    }
     if (!m_realtime && fftSizeChanged) {
         m_studyFFT = std::make_unique<FFT>(m_fftSize, m_debugLevel);
         m_studyFFT->initFloat();
     }
     if (m_pitchScale != 1.0 ||
         (m_options & OptionPitchHighConsistency) ||
-        m_realtime) {
+        m_realtime ||
+        m_bandRatio < 1.0) {
         auto rbs =  static_cast<size_t>(lrintf(ceil((m_increment * m_timeRatio * 2) / m_pitchScale)));
         if (rbs < m_increment * 16) rbs = m_increment * 16;
+        if (m_realtime) {
+            // Enough for a full inbuf resampled before stretching, or
+            // the longest shift increment resampled after, at any
+            // pitch scale we are prepared for
+            auto maxWindowSize = *rtWindowSizes.rbegin();
+            auto minPitchScale = std::min(m_pitchScale, m_minPitchScale);
+            rbs = std::max(rbs, std::max(size_t(ceil(maxWindowSize / minPitchScale)), maxWindowSize * 2) + 1);
+        }
+        if (m_bandRatio < 1.0) rbs = size_t(ceil(rbs / m_bandRatio));
 
         for (size_t c = 0; c < m_channels; ++c) {
-            if (!m_channelData[c]->resampler) ;
-            m_channelData[c]->resampler = std::make_unique<Resampler>(Resampler::FastestTolerable, 1, 4096 * 16, m_debugLevel);
+            auto &cd = *m_channelData[c];
+            if (!cd.resampler) {
+                cd.resampler = std::make_unique<Resampler>(Resampler::FastestTolerable, 1, 4096 * 16, m_debugLevel);
+            } else {
+                cd.resampler->reset();
+            }
 
             // rbs is the amount of buffer space we think we'll need
             // for resampling; but allocate a sensible amount in case
             // the pitch scale changes during use
-            m_channelData[c]->setResampleBufSize(rbs);
+            if (cd.resamplebufSize < rbs) cd.setResampleBufSize(rbs);
+            // When band-limited, the resampler above is always on the
+            // output side and this one on the input side
+            if (m_bandRatio < 1.0) {
+                if (!cd.bandResampler) {
+                    cd.bandResampler = std::make_unique<Resampler>(Resampler::FastestTolerable, 1, 4096 * 16, m_debugLevel);
+                } else {
+                    cd.bandResampler->reset();
+                }
+                if (cd.bandbufSize < rbs) cd.setBandBufSize(rbs);
+            }
+        }
+    }
+    if (!m_realtime && m_bandRatio < 1.0) {
+        if (!m_studyResampler) {
+            m_studyResampler = std::make_unique<Resampler>(Resampler::FastestTolerable, 1, 4096 * 16, m_debugLevel);
+        } else {
+            m_studyResampler->reset();
         }
     }
     // stretchAudioCurve is unused in RT mode; phaseResetAudioCurve,
     // silentAudioCurve and stretchCalculator however are used in all
-    // modes
-    delete m_phaseResetAudioCurve;
-    m_phaseResetAudioCurve = new CompoundAudioCurve (CompoundAudioCurve::Parameters(m_sampleRate, m_fftSize));
+    // modes.  They depend only on the sizes, so if those are
+    // unchanged we keep them and just start them afresh
+    if (fftSizeChanged || !m_phaseResetAudioCurve || m_realtime) {
+        delete m_phaseResetAudioCurve;
+        if (m_realtime) {
+            // Made at the largest size, so that reconfigure() can
+            // reduce it without allocating
+            m_phaseResetAudioCurve = new CompoundAudioCurve (CompoundAudioCurve::Parameters(m_sampleRate, *rtFftSizes.rbegin()));
+            m_phaseResetAudioCurve->setFftSize(m_fftSize);
+        } else {
+            m_phaseResetAudioCurve = new CompoundAudioCurve (CompoundAudioCurve::Parameters(m_sampleRate, m_fftSize));
+        }
+        delete m_silentAudioCurve;
+        m_silentAudioCurve = new SilentAudioCurve (SilentAudioCurve::Parameters(m_sampleRate, m_fftSize));
+    } else {
+        m_phaseResetAudioCurve->reset();
+        m_silentAudioCurve->reset();
+    }
     m_phaseResetAudioCurve->setType(m_detectorType);
-    delete m_silentAudioCurve;
-    m_silentAudioCurve = new SilentAudioCurve (SilentAudioCurve::Parameters(m_sampleRate, m_fftSize));
     if (!m_realtime) {
-        delete m_stretchAudioCurve;
-        if (!(m_options & OptionStretchPrecise)) {
-            m_stretchAudioCurve = new SpectralDifferenceAudioCurve
-                (SpectralDifferenceAudioCurve::Parameters(m_sampleRate, m_fftSize));
+        if (fftSizeChanged || !m_stretchAudioCurve) {
+            delete m_stretchAudioCurve;
+            if (!(m_options & OptionStretchPrecise)) {
+                m_stretchAudioCurve = new SpectralDifferenceAudioCurve
+                    (SpectralDifferenceAudioCurve::Parameters(m_sampleRate, m_fftSize));
+            } else {
+                m_stretchAudioCurve = new ConstantAudioCurve (ConstantAudioCurve::Parameters(m_sampleRate, m_fftSize));
+            }
         } else {
-            m_stretchAudioCurve = new ConstantAudioCurve (ConstantAudioCurve::Parameters(m_sampleRate, m_fftSize));
+            m_stretchAudioCurve->reset();
         }
     }
-    m_stretchCalculator = std::make_unique<StretchCalculator >(m_sampleRate, m_increment,!(m_options & OptionTransientsSmooth));
+    if (m_increment != prevIncrement || !m_stretchCalculator) {
+        m_stretchCalculator = std::make_unique<StretchCalculator >(m_sampleRate, m_increment,!(m_options & OptionTransientsSmooth));
+    } else {
+        m_stretchCalculator->reset();
+        m_stretchCalculator->setUseHardPeaks(!(m_options & OptionTransientsSmooth));
+    }
     m_stretchCalculator->setDebugLevel(m_debugLevel);
     m_inputDuration = 0;
     // Prepare the inbufs with half a chunk of emptiness.  The centre
@@ -494,6 +827,20 @@ RubbersStretcher::Impl::configure(){
             m_channelData[c]->inbuf->zero(m_aWindowSize/2);
         }
     }
+    configureFollowers();
+}
+void
+RubbersStretcher::Impl::updateSynthesisWindow(){
+    // Both tables are sized for the largest window in configure(), so
+    // that in RT mode refreshing them here does not allocate
+    const auto wsz = m_sWindowSize;
+    const auto window = m_swindow->getValues();
+    m_sWindowScaled.resize(wsz);
+    m_sWindowWeights.resize(wsz);
+    v_copy(m_sWindowScaled.data(), window, wsz);
+    v_scale(m_sWindowScaled.data(), 1.f / m_fftSize, wsz);
+    v_copy(m_sWindowWeights.data(), window, wsz);
+    v_scale(m_sWindowWeights.data(), m_awindow->getArea() * 1.5f, wsz);
 }
 void
 RubbersStretcher::Impl::reconfigure(){
@@ -524,13 +871,13 @@ RubbersStretcher::Impl::reconfigure(){
         m_sWindowSize != prevSWindowSize) {
         if (m_windows.find(m_aWindowSize) == m_windows.end()) {
             std::cerr << "WARNING: reconfigure(): window allocation (size " << m_aWindowSize << ") required in RT mode" << std::endl;
-            m_windows[m_aWindowSize] = std::make_unique< Window<float> > (HanningWindow, m_aWindowSize);
-            m_sincs[m_aWindowSize] = std::make_unique< SincWindow<float> > (m_aWindowSize, m_aWindowSize);
+            m_windows[m_aWindowSize] = Window<float>::shared(HanningWindow, m_aWindowSize);
+            m_sincs[m_aWindowSize] = SincWindow<float>::shared(m_aWindowSize, m_aWindowSize);
         }
         if (m_windows.find(m_sWindowSize) == m_windows.end()) {
             std::cerr << "WARNING: reconfigure(): window allocation (size " << m_sWindowSize << ") required in RT mode" << std::endl;
-            m_windows[m_sWindowSize] = std::make_unique< Window<float> > (HanningWindow, m_sWindowSize);
-            m_sincs[m_sWindowSize] = std::make_unique< SincWindow<float> > (m_sWindowSize, m_sWindowSize);
+            m_windows[m_sWindowSize] = Window<float>::shared(HanningWindow, m_sWindowSize);
+            m_sincs[m_sWindowSize] = SincWindow<float>::shared(m_sWindowSize, m_sWindowSize);
         }
         m_awindow = m_windows[m_aWindowSize].get();
         m_afilter = m_sincs[m_aWindowSize].get();
@@ -539,8 +886,13 @@ RubbersStretcher::Impl::reconfigure(){
             m_channelData[c]->setSizes(std::max(m_aWindowSize, m_sWindowSize), m_fftSize);
         }
     }
+    if (m_aWindowSize != prevAWindowSize ||
+        m_sWindowSize != prevSWindowSize ||
+        m_fftSize != prevFftSize) {
+        updateSynthesisWindow();
+    }
     if (m_outbufSize != prevOutbufSize) {for (size_t c = 0; c < m_channels; ++c) {m_channelData[c]->setOutbufSize(m_outbufSize);}}
-    if (m_pitchScale != 1.0) {
+    if (m_pitchScale != 1.0 || m_bandRatio < 1.0) {
         for (size_t c = 0; c < m_channels; ++c) {
             if (m_channelData[c]->resampler) continue;
             std::cerr << "WARNING: reconfigure(): resampler construction required in RT mode" << std::endl;
@@ -550,12 +902,22 @@ RubbersStretcher::Impl::reconfigure(){
             m_channelData[c]->setResampleBufSize(rbs);
         }
     }
-    if (m_fftSize != prevFftSize) {m_phaseResetAudioCurve->setFftSize(m_fftSize);}
+    if (m_fftSize != prevFftSize) {
+        m_phaseResetAudioCurve->setFftSize(m_fftSize);
+        if (m_joint) m_joint->reset();
+    }
 }
 size_t
 RubbersStretcher::Impl::getLatency() const{
+#ifndef NO_THREADING
+    if (m_asyncWorker && !m_asyncWorker->onWorkerThread()) return m_asyncWorker->getLatency();
+#endif
+    return calculateLatency();
+}
+size_t
+RubbersStretcher::Impl::calculateLatency() const{
     if (!m_realtime) return 0;
-    return int((m_aWindowSize/2) / m_pitchScale + 1);
+    return int((m_aWindowSize/2) / (m_pitchScale * m_bandRatio) + 1);
 }
 
 void
@@ -565,6 +927,9 @@ RubbersStretcher::Impl::setTransientsOption(Options options)
         cerr << "RubbersStretcher::Impl::setTransientsOption: Not permissible in non-realtime mode" << endl;
         return;
     }
+#ifndef NO_THREADING
+    AsyncWorker::Hold hold(m_asyncWorker.get());
+#endif
     auto mask = (OptionTransientsMixed | OptionTransientsSmooth | OptionTransientsCrisp);
     m_options &= ~mask;
     options &= mask;
@@ -578,6 +943,9 @@ RubbersStretcher::Impl::setDetectorOption(Options options){
         cerr << "RubbersStretcher::Impl::setDetectorOption: Not permissible in non-realtime mode" << endl;
         return;
     }
+#ifndef NO_THREADING
+    AsyncWorker::Hold hold(m_asyncWorker.get());
+#endif
     auto mask = (OptionDetectorPercussive | OptionDetectorCompound | OptionDetectorSoft);
     m_options &= ~mask;
     options &= mask;
@@ -591,7 +959,10 @@ RubbersStretcher::Impl::setDetectorOption(Options options){
 }
 void
 RubbersStretcher::Impl::setPhaseOption(Options options){
-    auto mask = (OptionPhaseLaminar | OptionPhaseIndependent);
+#ifndef NO_THREADING
+    AsyncWorker::Hold hold(m_asyncWorker.get());
+#endif
+    auto mask = (OptionPhaseLaminar | OptionPhaseIndependent | OptionPhaseSparse);
     m_options &= ~mask;
     options &= mask;
     m_options |= options;
@@ -600,7 +971,11 @@ RubbersStretcher::Impl::setPhaseOption(Options options){
 void
 RubbersStretcher::Impl::setFormantOption(Options options)
 {
-    auto mask = (OptionFormantShifted | OptionFormantPreserved);
+#ifndef NO_THREADING
+    AsyncWorker::Hold hold(m_asyncWorker.get());
+#endif
+    auto mask = (OptionFormantShifted | OptionFormantPreserved |
+                 OptionFormantReused | OptionFormantLPC);
     m_options &= ~mask;
     options &= mask;
     m_options |= options;
@@ -613,6 +988,9 @@ RubbersStretcher::Impl::setPitchOption(Options options)
         cerr << "RubbersStretcher::Impl::setPitchOption: Pitch option is not used in non-RT mode" << endl;
         return;
     }
+#ifndef NO_THREADING
+    AsyncWorker::Hold hold(m_asyncWorker.get());
+#endif
     auto  prior = m_options;
     auto mask = (OptionPitchHighQuality |
                 OptionPitchHighSpeed |
@@ -653,6 +1031,14 @@ RubbersStretcher::Impl::study(const float *const *input, size_t samples, bool fl
         std::for_each ( mdalloc, &mdalloc[samples], [=](auto & val){val *= invchannels;});
         mixdown = mdalloc;
     } else {mixdown = input[0];}
+    auto decimated = std::vector<float>();
+    if (m_studyResampler) {
+        // Study at our own rate, as process() will stretch
+        decimated.resize(size_t(ceil(samples * m_bandRatio)) + 1);
+        auto out = decimated.data();
+        samples = m_studyResampler->resample(&mixdown, &out, int(samples), float(m_bandRatio), flushing);
+        mixdown = out;
+    }
     while (consumed < samples) {
 	auto writable = static_cast<size_t>(inbuf.getWriteSpace());
 	writable = std::min(writable, samples - consumed);
@@ -688,8 +1074,8 @@ RubbersStretcher::Impl::study(const float *const *input, size_t samples, bool fl
                 // the penalty is nominal.
                 // Note that we can't do this in-place.  Pity
                 auto tmp = (float *)alloca (std::max(m_fftSize, m_aWindowSize) * sizeof(float));
-                if (m_aWindowSize > m_fftSize) {m_afilter->cut(cd.accumulator);}
-                cutShiftAndFold(tmp, m_fftSize, cd.accumulator, m_awindow);
+                cutShiftAndFold(tmp, m_fftSize, cd.accumulator, m_awindow,
+                                m_aWindowSize > m_fftSize ? m_afilter : nullptr);
                 std::copy_n ( tmp, m_fftSize, cd.accumulator );
             }
             m_studyFFT->forwardMagnitude(cd.accumulator, cd.fltbuf);
@@ -755,10 +1141,14 @@ RubbersStretcher::Impl::calculateStretch(){
     Profiler profiler("RubbersStretcher::Impl::calculateStretch");
     auto inputDuration = m_inputDuration;
     if (!m_realtime && m_expectedInputDuration > 0) {
-        if (m_expectedInputDuration != inputDuration) {
-            std::cerr << "RubbersStretcher: WARNING: Actual study() duration differs from duration set by setExpectedInputDuration (" << m_inputDuration << " vs " << m_expectedInputDuration << ", diff = " << (m_expectedInputDuration - m_inputDuration) << "), using the latter for calculation" << std::endl;
-            inputDuration = m_expectedInputDuration;
+        // When band-limited, the study duration is at our own rate
+        // and the resampling may round it either way
+        auto expected = size_t(lrint(m_expectedInputDuration * m_bandRatio));
+        auto slack = size_t(m_bandRatio < 1.0 ? 1 : 0);
+        if (expected + slack < inputDuration || inputDuration + slack < expected) {
+            std::cerr << "RubbersStretcher: WARNING: Actual study() duration differs from duration set by setExpectedInputDuration (" << m_inputDuration << " vs " << expected << ", diff = " << (expected - m_inputDuration) << "), using the latter for calculation" << std::endl;
         }
+        inputDuration = expected;
     }
     auto increments = m_stretchCalculator->calculate(getEffectiveRatio(),inputDuration,m_phaseResetDf,m_stretchDf);
     auto history = 0;
@@ -775,13 +1165,121 @@ RubbersStretcher::Impl::calculateStretch(){
     else std::copy(increments.begin(),increments.end(),std::back_inserter(m_outputIncrements));
     return;
 }
+#ifndef NO_THREADING
+void
+RubbersStretcher::Impl::chooseSegments(){
+    // A segment may only begin at a chunk where the phases of every
+    // bin are reset, as then nothing carries over from the chunks
+    // before it except the overlap-add tail.  With mixed transients
+    // some bins are never reset, so there are no such chunks.  Resets
+    // that would make for very short segments are passed over, since
+    // each segment has a fixed setup cost.
+    static const size_t minimumChunks = 64;
+    m_segmentStarts.clear();
+    if (!m_segmented || (m_options & OptionTransientsMixed) || !m_followers.empty()) return;
+    m_segmentStarts.push_back(0);
+    for (size_t i = 1; i < m_outputIncrements.size(); ++i) {
+        if (m_outputIncrements[i] < 0 &&
+            i - m_segmentStarts.back() >= minimumChunks) {
+            m_segmentStarts.push_back(i);
+        }
+    }
+    if (m_segmentStarts.size() < 2) m_segmentStarts.clear();
+    if (m_debugLevel > 0) {
+        cerr << "chooseSegments: " << m_segmentStarts.size() << " segments in " << m_outputIncrements.size() << " chunks" << endl;
+    }
+}
+#endif
+void
+RubbersStretcher::Impl::setAdditionalTimeRatios(const std::vector<double> &ratios){
+    if (m_realtime) {
+        cerr << "RubbersStretcher::Impl::setAdditionalTimeRatios: Not permissible in real-time mode" << endl;
+        return;
+    }
+    if (m_mode != JustCreated) {
+        cerr << "RubbersStretcher::Impl::setAdditionalTimeRatios: Cannot set ratios after study() or process() has begun" << endl;
+        return;
+    }
+    m_followers.clear();
+    for (auto ratio : ratios) {
+        // OptionChannelsJoint is for the main ratio only
+        m_followers.emplace_back(new Impl(m_sampleRate, m_channels, m_options & ~OptionChannelsJoint,
+                                          ratio, m_pitchScale));
+        m_followers.back()->m_leader = this;
+    }
+    // Our own sizes depend on the followers' ratios, and theirs on ours
+    configure();
+}
+const RubbersStretcher::Impl *
+RubbersStretcher::Impl::forRatio(size_t ratioIndex) const{
+    if (ratioIndex == 0) return this;
+    if (ratioIndex > m_followers.size()) {
+        cerr << "RubbersStretcher::Impl: ratio index " << ratioIndex << " out of range (" << m_followers.size() << " additional ratios)" << endl;
+        return nullptr;
+    }
+    return m_followers[ratioIndex - 1].get();
+}
+void
+RubbersStretcher::Impl::configureFollowers(){
+    // Called at the end of configure(), after our sizes are known
+    for (auto &f : m_followers) {
+        f->m_sampleRate = m_sampleRate;
+        f->m_inputRate = m_inputRate;
+        f->m_bandRatio = m_bandRatio;
+        f->m_rateMultiple = m_rateMultiple;
+        f->m_baseFftSize = m_baseFftSize;
+        f->m_pitchScale = m_pitchScale;
+        f->m_maxProcessSize = m_maxProcessSize;
+        f->m_expectedInputDuration = m_expectedInputDuration;
+        f->configure();
+    }
+}
+void
+RubbersStretcher::Impl::startFollowing(){
+    // Called as our leader begins to process.  Work out our own
+    // stretch from the leader's study of the input.
+    m_freq0 = m_leader->m_freq0;
+    m_freq1 = m_leader->m_freq1;
+    m_freq2 = m_leader->m_freq2;
+    if (m_leader->m_mode == Studying) {
+        m_phaseResetDf = m_leader->m_phaseResetDf;
+        m_stretchDf = m_leader->m_stretchDf;
+        m_silence = m_leader->m_silence;
+        m_inputDuration = m_leader->m_inputDuration;
+        calculateStretch();
+    }
+    m_mode = Processing;
+}
+void
+RubbersStretcher::Impl::setRealTimeAudit(RealTimeAuditMode mode){
+    // Offline processing allocates as it goes, so is never audited
+    auto auditMode = RTAudit::Off;
+    if (m_realtime) {
+        if (mode == RealTimeAuditCount) auditMode = RTAudit::Count;
+        else if (mode == RealTimeAuditTrap) auditMode = RTAudit::Trap;
+    }
+    m_audit.mode = auditMode;
+    m_audit.reset();
+}
+size_t
+RubbersStretcher::Impl::getDroppedSamples() const{
+    return m_asyncWorker ? m_asyncWorker->getDroppedSamples() : 0;
+}
 void
 RubbersStretcher::Impl::setDebugLevel(int level){
     m_debugLevel = level;
     if (m_stretchCalculator) m_stretchCalculator->setDebugLevel(level);
+    for (auto &f : m_followers) f->setDebugLevel(level);
 }	
 size_t
 RubbersStretcher::Impl::getSamplesRequired() const{
+#ifndef NO_THREADING
+    if (m_asyncWorker && !m_asyncWorker->onWorkerThread()) return m_asyncWorker->getSamplesRequired();
+#endif
+    return calculateSamplesRequired();
+}
+size_t
+RubbersStretcher::Impl::calculateSamplesRequired() const{
     Profiler profiler("RubbersStretcher::Impl::getSamplesRequired");
     auto reqd = size_t{0};
     for (auto c = decltype(m_channels){0}; c < m_channels; ++c) {
@@ -812,18 +1310,35 @@ RubbersStretcher::Impl::getSamplesRequired() const{
             }
         }
     }
+    // The input is taken at the caller's rate
+    if (m_bandRatio < 1.0) reqd = size_t(ceil(reqd / m_bandRatio));
     return reqd;
 }    
 void
 RubbersStretcher::Impl::process(const float *const *input, size_t samples, bool flushing){
     Profiler profiler("RubbersStretcher::Impl::process");
+    RTAudit::Section audit(m_audit);
+#ifndef NO_THREADING
+    if (m_asyncWorker) {
+        m_asyncWorker->process(input, samples, flushing);
+        return;
+    }
+#endif
+    processInput(input, samples, flushing);
+}
+void
+RubbersStretcher::Impl::processInput(const float *const *input, size_t samples, bool flushing){
     if (m_mode == Finished) {
         cerr << "RubbersStretcher::Impl::process: Cannot process again after final chunk" << endl;
         return;
     }
     if (m_mode == JustCreated || m_mode == Studying) {
+        for (auto &f : m_followers) f->startFollowing();
         if (m_mode == Studying) {
             calculateStretch();
+#ifndef NO_THREADING
+            chooseSegments();
+#endif
             if (!m_realtime) {
                 // See note in configure() above. Of course, we should
                 // never enter Studying unless we are non-RT anyway
@@ -855,11 +1370,23 @@ RubbersStretcher::Impl::process(const float *const *input, size_t samples, bool
                 if (flushing) {m_channelData[c]->inputSize = m_channelData[c]->inCount;}
 //                cerr << "process: happy with channel " << c << endl;
             }
-            if (!m_realtime) {
+            if (!m_realtime && !m_executor && !processesInStep()) {
+#ifndef NO_THREADING
+                if (!m_segmentStarts.empty()) {
+                    processSegments(c);
+                    continue;
+                }
+                if (m_threaded) continue;
+#endif
                 auto any = false, last = false;
                 processChunks(c, any, last);
             }
         }
+        if (processesInStep()) processChunksInStep();
+        else if (!m_realtime && m_executor) processChunksExecuted();
+#ifndef NO_THREADING
+        else if (m_threaded && m_segmentStarts.empty()) processChunksThreaded();
+#endif
         if (m_realtime) {
             // When running in real time, we need to process both
             // channels in step because we will need to use the sum of
@@ -872,5 +1399,224 @@ RubbersStretcher::Impl::process(const float *const *input, size_t samples, bool
     if (m_debugLevel > 2) {cerr << "process returning" << endl;}
     if (flushing) m_mode = Finished;
 }
+// The scratch of processBatch, kept by the stretcher that runs the
+// batch.  It only grows, so that once it has seen a batch with as many
+// stretchers and channels, the batch allocates nothing.
+struct RubbersStretcher::Impl::BatchState {
+    struct Stream {
+        Impl *impl;
+        const float *const *input;
+        size_t *consumed;     // per channel, in channels below
+        size_t *analysing;    // likewise
+        size_t *synthesising; // likewise
+        size_t analyseCount;
+        size_t synthesiseCount;
+        bool ready;
+        bool allConsumed;
+        size_t phaseIncrement;
+        size_t shiftIncrement;
+        bool phaseReset;
+        bool batched; // synthesis waiting on the batched FFTs
+    };
+    // An FFT prepared for batches of every frame of one size
+    struct Transform {
+        size_t size;
+        size_t frames; // of this size in the current batch
+        int prepared;
+        std::unique_ptr<FFT> fft;
+    };
+    std::vector<Stream> streams;
+    std::vector<size_t> channels;
+    std::vector<std::pair<Stream *, size_t> > jobs;
+    std::vector<float *> frames;
+    std::vector<float *> mags;
+    std::vector<float *> phases;
+    std::vector<const float *> inMags;
+    std::vector<const float *> inPhases;
+    std::vector<Transform> transforms;
+};
+bool
+RubbersStretcher::Impl::batchable() const{
+    // Whether processBatch takes this stretcher through its stages,
+    // rather than passing it to process()
+    if (!m_realtime) return false;
+#ifndef NO_THREADING
+    if (m_asyncWorker) return false;
+#endif
+    return true;
+}
+void
+RubbersStretcher::Impl::processBatch(RubbersStretcher *const *stretchers, size_t count,
+                                     const float *const *const *inputs,
+                                     size_t samples, bool flushing){
+    Profiler profiler("RubbersStretcher::Impl::processBatch");
+    // Stretchers that can't be batched go to process() now, and the
+    // first that can runs the rest as a batch
+    Impl *runner = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        auto impl = stretchers[i]->m_d;
+        if (!impl->batchable()) {
+            impl->process(inputs[i], samples, flushing);
+        } else if (impl->m_mode == Finished) {
+            cerr << "RubbersStretcher::Impl::processBatch: Cannot process again after final chunk" << endl;
+        } else if (!runner) {
+            runner = impl;
+        }
+    }
+    if (runner) runner->runBatch(stretchers, count, inputs, samples, flushing);
+}
+void
+RubbersStretcher::Impl::runBatch(RubbersStretcher *const *stretchers, size_t count,
+                                 const float *const *const *inputs,
+                                 size_t samples, bool flushing){
+    // As process() on each real-time stretcher in the batch, except
+    // that they are taken through processOneChunk one stage at a
+    // time across the whole batch: every analysis, then every
+    // increment calculation, then every synthesis.  Running a stage
+    // back to back for many stretchers keeps its windows and FFT
+    // tables in cache.  With an executor (ours, as we are the first
+    // of the batch), each stage goes to it as a single run over the
+    // batch rather than one per stretcher; without one, the FFTs of
+    // each stage are done as one batched call per FFT size, over the
+    // frames of every stretcher of that size.  Each stretcher's own
+    // work is audited as its own; the shared scratch and FFTs are
+    // ours.
+    RTAudit::Section audit(m_audit);
+    if (!m_batch) m_batch = std::make_unique<BatchState>();
+    auto &batch = *m_batch;
+    using Stream = BatchState::Stream;
+    auto &streams = batch.streams;
+    streams.clear();
+    auto total = size_t{0};
+    for (size_t i = 0; i < count; ++i) {
+        auto impl = stretchers[i]->m_d;
+        if (!impl->batchable() || impl->m_mode == Finished) continue;
+        impl->m_mode = Processing;
+        streams.push_back(Stream{impl, inputs[i], nullptr, nullptr, nullptr,
+                    0, 0, false, false, 0, 0, false, false});
+        total += impl->m_channels;
+    }
+    if (batch.channels.size() < 3 * total) batch.channels.resize(3 * total);
+    if (batch.frames.size() < total) {
+        batch.jobs.reserve(total);
+        batch.frames.resize(total);
+        batch.mags.resize(total);
+        batch.phases.resize(total);
+        batch.inMags.resize(total);
+        batch.inPhases.resize(total);
+    }
+    for (auto &t : batch.transforms) t.frames = 0;
+    auto offset = size_t{0};
+    for (auto &s : streams) {
+        const auto n = s.impl->m_channels;
+        s.consumed = batch.channels.data() + offset;
+        s.analysing = s.consumed + n;
+        s.synthesising = s.analysing + n;
+        std::fill(s.consumed, s.consumed + n, size_t{0});
+        offset += 3 * n;
+        const auto size = size_t(s.impl->m_fftSize);
+        auto t = std::find_if(batch.transforms.begin(), batch.transforms.end(),
+                              [size](const BatchState::Transform &t) { return t.size == size; });
+        if (t == batch.transforms.end()) {
+            batch.transforms.push_back(BatchState::Transform{size, 0, 0, std::make_unique<FFT>(int(size))});
+            t = batch.transforms.end() - 1;
+            t->fft->initFloat();
+        }
+        t->frames += n;
+    }
+    for (auto &t : batch.transforms) {
+        if (t.frames > size_t(t.prepared)) {
+            t.fft->initFloatBatch(int(t.frames));
+            t.prepared = int(t.frames);
+        }
+    }
+    auto &jobs = batch.jobs;
+    auto frames = batch.frames.data();
+    auto mags = batch.mags.data();
+    auto phases = batch.phases.data();
+    auto inMags = batch.inMags.data();
+    auto inPhases = batch.inPhases.data();
+    while (!streams.empty()) {
+        jobs.clear();
+        for (auto &s : streams) {
+            auto &impl = *s.impl;
+            RTAudit::Section section(impl.m_audit);
+            s.allConsumed = true;
+            for (size_t c = 0; c < impl.m_channels; ++c) {
+                s.consumed[c] += impl.consumeChannel(c, s.input, s.consumed[c], samples - s.consumed[c], flushing);
+                if (s.consumed[c] < samples) s.allConsumed = false;
+                else if (flushing) impl.m_channelData[c]->inputSize = impl.m_channelData[c]->inCount;
+            }
+            s.ready = impl.readOneChunk(s.analysing, s.analyseCount);
+            for (size_t k = 0; k < s.analyseCount; ++k) jobs.emplace_back(&s, s.analysing[k]);
+        }
+        if (m_executor) {
+            auto analyse = [&jobs](size_t j) {
+                auto &impl = *jobs[j].first->impl;
+                RTAudit::Section section(impl.m_audit);
+                impl.analyseChunk(*impl.m_channelData[jobs[j].second]);
+            };
+            execute(jobs.size(), analyse);
+        } else {
+            for (auto &t : batch.transforms) {
+                auto k = size_t{0};
+                for (auto &s : streams) {
+                    if (size_t(s.impl->m_fftSize) != t.size) continue;
+                    RTAudit::Section section(s.impl->m_audit);
+                    k += s.impl->prepareAnalysis(s.analysing, s.analyseCount,
+                                                 frames + k, mags + k, phases + k);
+                }
+                if (k > 0) t.fft->forwardPolarBatch(int(k), frames, mags, phases);
+            }
+        }
+        jobs.clear();
+        for (auto &s : streams) {
+            s.batched = false;
+            if (!s.ready) continue;
+            auto &impl = *s.impl;
+            RTAudit::Section section(impl.m_audit);
+            impl.getOneChunkIncrements(s.phaseIncrement, s.shiftIncrement, s.phaseReset);
+            if (m_executor) {
+                impl.modifyJointly(s.phaseIncrement, s.phaseReset);
+                for (size_t c = 0; c < impl.m_channels; ++c) jobs.emplace_back(&s, c);
+            } else if (impl.bypassing()) {
+                impl.writeOneChunks(s.phaseIncrement, s.shiftIncrement, s.phaseReset);
+            } else {
+                s.synthesiseCount = impl.modifyOneChunks(s.synthesising, s.phaseIncrement, s.phaseReset);
+                s.batched = true;
+            }
+        }
+        if (m_executor) {
+            auto synthesise = [&jobs](size_t j) {
+                auto &s = *jobs[j].first;
+                RTAudit::Section section(s.impl->m_audit);
+                s.impl->writeOneChunk(jobs[j].second, s.phaseIncrement, s.shiftIncrement, s.phaseReset);
+            };
+            execute(jobs.size(), synthesise);
+        } else {
+            for (auto &t : batch.transforms) {
+                auto k = size_t{0};
+                for (auto &s : streams) {
+                    if (!s.batched || size_t(s.impl->m_fftSize) != t.size) continue;
+                    RTAudit::Section section(s.impl->m_audit);
+                    k += s.impl->prepareSynthesis(s.synthesising, s.synthesiseCount,
+                                                  inMags + k, inPhases + k, frames + k);
+                }
+                if (k > 0) t.fft->inversePolarBatch(int(k), inMags, inPhases, frames);
+            }
+            for (auto &s : streams) {
+                if (!s.batched) continue;
+                RTAudit::Section section(s.impl->m_audit);
+                s.impl->accumulateChunks(s.synthesising, s.synthesiseCount, s.shiftIncrement);
+                s.impl->finishOneChunks(s.shiftIncrement);
+            }
+        }
+        for (auto &s : streams) {
+            if (s.allConsumed && flushing) s.impl->m_mode = Finished;
+        }
+        streams.erase(std::remove_if(streams.begin(), streams.end(),
+                                     [](const Stream &s) { return s.allConsumed; }),
+                      streams.end());
+    }
+}
 }
-
@@ -35,8 +35,12 @@
 #include "base/RingBuffer.h"
 #include "base/Scavenger.h"
 #include "system/Thread.h"
+#include "system/ThreadPool.h"
+#include "system/RTAudit.h"
 #include "system/sysutils.h"
 
+#include <atomic>
+#include <deque>
 #include <set>
 
 using namespace Rubbers;
@@ -45,6 +49,8 @@ namespace Rubbers
 {
 
 class AudioCurveCalculator;
+class Resampler;
+struct PhaseAdvance;
 
 class RubbersStretcher::Impl
 {
@@ -70,16 +76,27 @@ public:
 
     void setExpectedInputDuration(size_t samples);
     void setMaxProcessSize(size_t samples);
+    void setPitchScaleRange(double minScale, double maxScale);
+    void setBandwidth(double frequency);
     void setKeyFrameMap(const std::map<size_t, size_t> &);
+    void setExecutor(Executor *executor) { m_executor = executor; }
+    void setSilenceThreshold(float level) { m_silenceThreshold = level; }
 
     size_t getSamplesRequired() const;
 
     void study(const float *const *input, size_t samples, bool final);
     void process(const float *const *input, size_t samples, bool final);
+    static void processBatch(RubbersStretcher *const *stretchers, size_t count,
+                             const float *const *const *inputs,
+                             size_t samples, bool final);
 
     ssize_t available() const;
     size_t retrieve(float *const *output, size_t samples) const;
 
+    void setAdditionalTimeRatios(const std::vector<double> &ratios);
+    ssize_t available(size_t ratioIndex) const;
+    size_t retrieve(float *const *output, size_t samples, size_t ratioIndex) const;
+
     float getFrequencyCutoff(int n) const;
     void setFrequencyCutoff(int n, float f);
 
@@ -90,22 +107,116 @@ public:
     std::vector<int> getExactTimePoints() const;
 
     size_t getChannelCount() const {return m_channels;}
+    double getSilenceSkipRate() const;
     
     void calculateStretch();
 
     void setDebugLevel(int level);
     static void setDefaultDebugLevel(int level) { m_defaultDebugLevel = level; }
 
+    void setRealTimeAudit(RealTimeAuditMode mode);
+    size_t getRealTimeAuditAllocations() const { return m_audit.allocations; }
+    size_t getRealTimeAuditLocks() const { return m_audit.locks; }
+    size_t getDroppedSamples() const;
+
 protected:
+    class ChannelData;
+    class JointData;
+    class Segment;
+
+    // The rate we process at, which is lower than the caller's rate
+    // m_inputRate when setBandwidth has declared the input to be
+    // band-limited; m_bandRatio is the one over the other
     size_t m_sampleRate;
+    size_t m_inputRate;
+    double m_bandRatio { 1.0 };
     size_t m_channels;
 
+    // process() itself, on the calling thread or the async worker
+    void processInput(const float *const *input, size_t samples, bool flushing);
     void prepareChannelMS(size_t channel, const float *const *inputs,
                           size_t offset, size_t samples, float *prepared);
     size_t consumeChannel(size_t channel, const float *const *inputs,
                           size_t offset, size_t samples, bool final);
     void processChunks(size_t channel, bool &any, bool &last);
+    bool processNextChunk(size_t channel, bool &last);
+    bool processNextChunks(const size_t *channels, size_t n, bool &last);
+    void readChunk(ChannelData &cd);
+#ifndef NO_THREADING
+    void processChunksThreaded(); // all channels, on the shared pool
+#endif
+    void processChunksExecuted(); // all channels, on m_executor
+    bool processesInStep() const;
+    void processChunksInStep(); // all channels in step, see processesInStep
+#ifndef NO_THREADING
+    void chooseSegments();
+    void processSegments(size_t channel);
+    void submitSegment(size_t channel);
+    void renderSegment(Segment &segment);
+    void stitchSegments(size_t channel);
+#endif
+    template <typename F>
+    void execute(size_t count, F &f) {
+        // Call f(0) .. f(count-1) on the executor if there is one,
+        // otherwise in turn on this thread
+        if (!m_executor || count < 2) {
+            for (size_t i = 0; i < count; ++i) f(i);
+            return;
+        }
+#ifdef RT_AUDIT
+        // Work on the executor's threads belongs to any audited
+        // section open on this one
+        if (auto counts = RTAudit::current()) {
+            auto audited = [&f, counts](size_t i) {
+                RTAudit::Section section(*counts);
+                f(i);
+            };
+            m_executor->run(count, [](void *context, size_t i) {
+                    (*static_cast<decltype(audited) *>(context))(i);
+                }, &audited);
+            return;
+        }
+#endif
+        m_executor->run(count, [](void *context, size_t i) {
+                (*static_cast<F *>(context))(i);
+            }, &f);
+    }
     bool processOneChunk(); // across all channels, for real time use
+    // The stages of processOneChunk, which processBatch runs across a
+    // batch of stretchers one stage at a time
+    bool readOneChunk(size_t *analysing, size_t &n);
+    void getOneChunkIncrements(size_t &phaseIncrement, size_t &shiftIncrement,
+                               bool &phaseReset);
+    void modifyJointly(size_t phaseIncrement, bool phaseReset); // before writeOneChunk
+    size_t modifyOneChunks(size_t *synthesising, size_t phaseIncrement, bool phaseReset);
+    bool finishOneChunks(size_t shiftIncrement); // after synthesiseChunks
+    bool writeOneChunk(size_t channel, size_t phaseIncrement,
+                       size_t shiftIncrement, bool phaseReset);
+    bool writeOneChunks(size_t phaseIncrement, size_t shiftIncrement,
+                        bool phaseReset); // all channels, batched
+    // At unity ratio and pitch in real-time mode, chunks bypass the
+    // phase vocoder and their input is copied straight to the output,
+    // crossfading over one analysis window on the way in and out
+    bool canBypass() const;
+    bool bypassing() const {
+        return m_bypassTarget && m_bypassHeld * m_increment >= m_sWindowSize;
+    }
+    void updateBypass();
+    void bypassChunk(ChannelData &cd);
+    void primeAccumulators(ChannelData &cd);
+    // An additional time ratio is rendered by a follower Impl, which
+    // takes each chunk's analysis from its leader's channel instead of
+    // analysing the input itself
+    const Impl *forRatio(size_t ratioIndex) const;
+    void configureFollowers();
+    void startFollowing();
+    bool processFollowingChunk(size_t channel, const ChannelData &analysed);
+    bool processChunkInBits(const size_t *channels, size_t n,
+                            size_t phaseIncrement, size_t shiftIncrement,
+                            bool phaseReset);
+    bool processChunkForChannels(const size_t *channels, size_t n,
+                                 size_t phaseIncrement, size_t shiftIncrement,
+                                 bool phaseReset);
     bool processChunkForChannel(size_t channel, size_t phaseIncrement,
                                 size_t shiftIncrement, bool phaseReset);
     bool testInbufReadSpace(size_t channel);
@@ -113,37 +224,80 @@ protected:
                              size_t &shiftIncrement, bool &phaseReset);
     bool getIncrements(size_t channel, size_t &phaseIncrement,
                        size_t &shiftIncrement, bool &phaseReset);
-    void analyseChunk(size_t channel);
-    void modifyChunk(size_t channel, size_t outputIncrement, bool phaseReset);
-    void formantShiftChunk(size_t channel);
-    void synthesiseChunk(size_t channel, size_t shiftIncrement);
-    void writeChunk(size_t channel, size_t shiftIncrement, bool last);
+    bool getIncrements(ChannelData &cd, size_t &phaseIncrement,
+                       size_t &shiftIncrement, bool &phaseReset);
+    // The per-chunk stages take the ChannelData to work on, which is
+    // usually one of m_channelData but may belong to a segment being
+    // rendered separately (see renderSegment)
+    void analyseChunk(ChannelData &cd);
+    bool skipIfSilent(ChannelData &cd);
+    float silenceThreshold() const;
+    void modifyChunk(ChannelData &cd, size_t outputIncrement, bool phaseReset);
+    void synthesiseChunk(ChannelData &cd, size_t shiftIncrement);
+    // The same stages on explicit frame buffers, so that consecutive
+    // frames can be in different stages at once (see ChannelPipeline)
+    void analyseChunk(ChannelData &cd, float *fltbuf, float *mag, float *phase);
+    bool skipIfSilent(const float *fltbuf, float *mag, float *phase);
+    void modifySilentChunk(ChannelData &cd);
+    bool modifyChunk(ChannelData &cd, const float *mag, float *phase,
+                     size_t outputIncrement, bool phaseReset, bool wasUnchanged);
+    void formantShiftChunk(ChannelData &cd, float *mag, float *dblbuf, FFT &fft);
+    void cepstralEnvelope(ChannelData &cd, const float *mag, float *dblbuf, FFT &fft);
+    void lpcEnvelope(ChannelData &cd, const float *mag, float *dblbuf, FFT &fft);
+    void synthesiseChunk(ChannelData &cd, float *mag, float *phase,
+                         float *fltbuf, float *dblbuf, FFT &fft,
+                         bool unchanged, size_t shiftIncrement);
+    void accumulateChunk(ChannelData &cd, const float *fltbuf, const float *dblbuf,
+                         bool unchanged, size_t shiftIncrement);
+    // The stages across several of m_channelData at once, with the
+    // channels' FFTs done as a batch, and their phases advanced
+    // together with m_joint
+    void analyseChunks(const size_t *channels, size_t n);
+    void modifyChunks(const size_t *channels, size_t n,
+                      size_t outputIncrement, bool phaseReset);
+    void setUpPhaseAdvance(PhaseAdvance &advance, size_t outputIncrement,
+                           bool phaseReset) const;
+    void synthesiseChunks(const size_t *channels, size_t n, size_t shiftIncrement);
+    // The stages either side of the batched FFTs, for processBatch to
+    // batch them across stretchers as well
+    size_t prepareAnalysis(const size_t *channels, size_t n,
+                           float **frames, float **mags, float **phases);
+    size_t prepareSynthesis(const size_t *channels, size_t n,
+                            const float **mags, const float **phases, float **frames);
+    void accumulateChunks(const size_t *channels, size_t n, size_t shiftIncrement);
+    void shiftAccumulators(ChannelData &cd, size_t shiftIncrement);
+    bool writeChunkForChannel(size_t channel, size_t shiftIncrement, bool draining);
+    void writeChunk(size_t channel, size_t shiftIncrement, bool last, bool draining);
+    bool formantShifting() const {
+        return (m_options & OptionFormantPreserved) && (m_pitchScale != 1.0);
+    }
+    // The order of the OptionFormantLPC predictor, about one pole
+    // pair per kHz of bandwidth, and the size of the FFT its
+    // response is evaluated with
+    size_t lpcOrder() const {return m_sampleRate / 1000 + 4;}
+    size_t lpcFftSize() const {return roundup(lpcOrder() * 4);}
 
+    void calculateBaseFftSize();
     void calculateSizes();
+    void getRealTimeFftSizeRange(size_t &minSize, size_t &maxSize); // of all calculateSizes() may choose
     void configure();
+    void updateSynthesisWindow();
     void reconfigure();
 
     double getEffectiveRatio() const;
+    // As getLatency() and getSamplesRequired(), but never redirected
+    // to the async worker, which publishes these for other threads
+    size_t calculateLatency() const;
+    size_t calculateSamplesRequired() const;
     size_t roundUp(size_t value); // to next power of two
     template <typename T, typename S>
     void cutShiftAndFold(T *target, int targetSize,
                          S *src, // destructive to src
-                         Window<float> *window) {
-        window->cut(src);
-        const int windowSize = window->getSize();
-        const int hs = targetSize / 2;
-        if (windowSize == targetSize) {
-            v_convert(target, src + hs, hs);
-            v_convert(target + hs, src, hs);
-        } else {
-            v_zero(target, targetSize);
-            int j = targetSize - windowSize/2;
-            while (j < 0) j += targetSize;
-            for (int i = 0; i < windowSize; ++i) {
-                target[j] += src[i];
-                if (++j == targetSize) j = 0;
-            }
-        }
+                         const Window<float> *window,
+                         const SincWindow<float> *filter = nullptr) {
+        v_window_shift_and_fold(target, targetSize, src, window->getSize(),
+                                window->getValues(),
+                                filter ? filter->getValues() : nullptr);
     }
     bool inline resampleBeforeStretching() const{
         // We can't resample before stretching in offline mode, because
@@ -164,6 +318,9 @@ protected:
 
     size_t m_maxProcessSize;
     size_t m_expectedInputDuration;
+    // The pitch scales RT mode is prepared for without allocating
+    double m_minPitchScale;
+    double m_maxPitchScale;
 
 #ifndef NO_THREADING    
     bool m_threaded;
@@ -171,6 +328,9 @@ protected:
 
     bool m_realtime;
     Options m_options;
+    Executor *m_executor = nullptr;
+    std::vector<std::unique_ptr<Impl> > m_followers; // one per additional time ratio
+    const Impl *m_leader = nullptr; // set if we are a follower
     int m_debugLevel;
 
     enum ProcessMode {
@@ -182,44 +342,69 @@ protected:
 
     ProcessMode m_mode;
 
-    std::map<size_t, std::unique_ptr<Window<float> > > m_windows;
-    std::map<size_t, std::unique_ptr<SincWindow<float> > > m_sincs;
-    Window<float> *m_awindow;
-    SincWindow<float> *m_afilter;
-    Window<float> *m_swindow;
+    // Windows are shared read-only with all other stretchers in the
+    // process; these maps just keep the ones we use alive
+    std::map<size_t, std::shared_ptr<const Window<float> > > m_windows;
+    std::map<size_t, std::shared_ptr<const SincWindow<float> > > m_sincs;
+    const Window<float> *m_awindow;
+    const SincWindow<float> *m_afilter;
+    const Window<float> *m_swindow;
+    // m_swindow with the inverse FFT's 1/fftSize scale folded in, and
+    // the window accumulator's share of each synthesised frame; see
+    // updateSynthesisWindow
+    std::vector<float> m_sWindowScaled;
+    std::vector<float> m_sWindowWeights;
     std::unique_ptr<FFT> m_studyFFT;
-#ifndef NO_THREADING
-    Condition m_spaceAvailable;
-    class ProcessThread : public Thread
-    {
-    public:
-        ProcessThread(Impl *s, size_t c);
-        virtual void run();
-        void signalDataAvailable();
-        void abandon();
-    private:
-        Impl *m_s;
-        size_t m_channel;
-        Condition m_dataAvailable;
-        bool m_abandoning;
-    };
-
-    mutable std::mutex m_threadSetMutex;
-    typedef std::set<ProcessThread *> ThreadSet;
-    ThreadSet m_threadSet;
-#endif
+    std::unique_ptr<Resampler> m_studyResampler; // when band-limited
     size_t m_inputDuration;
     CompoundAudioCurve::Type m_detectorType;
     std::vector<float> m_phaseResetDf;
     std::vector<float> m_stretchDf;
     std::vector<bool>  m_silence;
     int m_silentHistory;
-    class ChannelData; 
+    // Peak input level below which a chunk is skipped as silent, or
+    // negative for the default (see silenceThreshold); and the counts
+    // behind getSilenceSkipRate, which channels may update
+    // concurrently
+    std::atomic<float> m_silenceThreshold { -1.f };
+    std::atomic<size_t> m_chunksAnalysed { 0 };
+    std::atomic<size_t> m_chunksSkipped { 0 };
+    // The share of the current chunk's frame taken from its input
+    // rather than the phase vocoder, from 0 when fully processed to 1
+    // when heading for bypass; whether it is heading for bypass; how
+    // many chunks have had all of their frame from the input since
+    // (see bypassing); and whether this chunk is the first after it
+    float m_bypassGain { 0.f };
+    bool m_bypassTarget { false };
+    size_t m_bypassHeld { 0 };
+    bool m_bypassLeaving { false };
     std::vector<ChannelData *> m_channelData;
+    std::unique_ptr<JointData> m_joint; // only with OptionChannelsJoint and several channels
+#ifndef NO_THREADING
+    class ChannelPipeline;
+    bool m_pipelined;
+    std::vector<std::unique_ptr<ChannelPipeline> > m_pipelines;
+    bool m_segmented;
+    std::vector<size_t> m_segmentStarts; // chunks at which segments may begin
+    std::vector<std::unique_ptr<Segment> > m_openSegments; // per channel, being gathered
+    std::vector<std::deque<std::unique_ptr<Segment> > > m_renderingSegments; // per channel, in order
+    std::unique_ptr<ThreadPool::TaskGroup> m_segmentGroup;
+    class AsyncWorker;
+    std::unique_ptr<AsyncWorker> m_asyncWorker;
+#endif
     std::vector<int> m_outputIncrements;
     mutable RingBuffer<int>       m_lastProcessOutputIncrements;
     mutable RingBuffer<float>     m_lastProcessPhaseResetDf;
     Scavenger<RingBuffer<float> > m_emergencyScavenger;
+    Mutex m_emergencyMutex; // channels may overrun concurrently
+    mutable RTAudit::Counts m_audit;
+    // processBatch's scratch, kept by the stretcher that runs a batch
+    struct BatchState;
+    std::unique_ptr<BatchState> m_batch;
+    bool batchable() const;
+    void runBatch(RubbersStretcher *const *stretchers, size_t count,
+                  const float *const *const *inputs,
+                  size_t samples, bool final);
 
     CompoundAudioCurve   *m_phaseResetAudioCurve = nullptr;
     AudioCurveCalculator *m_stretchAudioCurve    = nullptr;
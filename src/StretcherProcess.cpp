@@ -29,15 +29,20 @@
 
 #include "StretchCalculator.h"
 #include "StretcherChannelData.h"
+#include "StretcherChannelPipeline.h"
+#include "StretcherSegment.h"
 
 #include "dsp/Resampler.h"
+#include "dsp/PhaseAdvance.h"
 #include "base/Profiler.h"
+#include "system/ThreadPool.h"
 #include "system/VectorOps.h"
 
 #ifndef _WIN32
 #include <alloca.h>
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <set>
@@ -86,33 +91,46 @@ RubbersStretcher::Impl::consumeChannel(size_t c,
     auto &inbuf = *cd.inbuf;
     auto toWrite = samples;
     auto writable = static_cast<size_t>(inbuf.getWriteSpace());
-    auto resampling = resampleBeforeStretching();
+    // The input is resampled on its way in when the pitch shift is
+    // resampled before stretching, and when band-limited, in which
+    // case the band resampler does both at once.  scale is the number
+    // of input samples per sample written to the inbuf.
+    auto rsb = resampleBeforeStretching();
+    auto band = (m_bandRatio < 1.0);
+    auto resampling = rsb || band;
+    auto scale = (rsb ? m_pitchScale : 1.0) / m_bandRatio;
+    auto resampler = (band ? cd.bandResampler.get() : cd.resampler.get());
+    auto &resamplebuf = (band ? cd.bandbuf : cd.resamplebuf);
     const float *input = 0;
     auto useMidSide = ((m_options & OptionChannelsTogether) && (m_channels >= 2) && (c < 2));
     if (resampling) {
-        toWrite = int(ceil(samples / m_pitchScale));
+        toWrite = int(ceil(samples / scale));
         if (writable < toWrite) {
-            samples = int(floor(writable * m_pitchScale));
+            samples = int(floor(writable * scale));
             if (samples == 0) return 0;
         }
-        auto reqSize = static_cast<size_t>((ceil(samples / m_pitchScale)));
-        if (reqSize > cd.resamplebufSize) {
+        // The mid-side signal is prepared in a buffer of our own
+        if (useMidSide && samples > cd.bufferSize) samples = cd.bufferSize;
+        auto reqSize = static_cast<size_t>((ceil(samples / scale)));
+        auto bufSize = (band ? cd.bandbufSize : cd.resamplebufSize);
+        if (reqSize > bufSize) {
             cerr << "WARNING: RubbersStretcher::Impl::consumeChannel: resizing resampler buffer from "
-                 << cd.resamplebufSize << " to " << reqSize << endl;
-            cd.setResampleBufSize(reqSize);
+                 << bufSize << " to " << reqSize << endl;
+            if (band) cd.setBandBufSize(reqSize);
+            else cd.setResampleBufSize(reqSize);
         }
         if (useMidSide) {
             prepareChannelMS(c, inputs, offset, samples, cd.ms);
             input = cd.ms;
         } else {input = inputs[c] + offset;}
-        toWrite = cd.resampler->resample(&input,&cd.resamplebuf,samples,1.0f / m_pitchScale,final);
+        toWrite = resampler->resample(&input,&resamplebuf,samples,1.0f / scale,final);
     }
     if (writable < toWrite) {
         if (resampling) {return 0;}
         toWrite = writable;
     }
     if (resampling) {
-        inbuf.write(cd.resamplebuf, toWrite);
+        inbuf.write(resamplebuf, toWrite);
         cd.inCount += samples;
         return samples;
     } else {
@@ -132,49 +150,377 @@ RubbersStretcher::Impl::processChunks(size_t c, bool &any, bool &last){
     // buffer for channel c.  This requires that the increments have
     // already been calculated.
     // This is the normal process method in offline mode.
-    auto &cd = *m_channelData[c];
     last = false;
     any = false;
-    float *tmp = 0;
+#ifndef NO_THREADING
+    if (m_pipelined && m_followers.empty()) {
+        if (!m_pipelines[c]) m_pipelines[c].reset(new ChannelPipeline(*this, c));
+        m_pipelines[c]->process(any, last);
+        return;
+    }
+#endif
     while (!last) {
-        if (!testInbufReadSpace(c)) {
+        if (!processNextChunk(c, last)) break;
+        any = true;
+    }
+}
+bool
+RubbersStretcher::Impl::processNextChunk(size_t c, bool &last){
+    // Process a single chunk from the input buffer for channel c, if
+    // there is enough input for one, returning false if there is not.
+    // Increments must already have been calculated, as for
+    // processChunks.
+    return processNextChunks(&c, 1, last);
+}
+bool
+RubbersStretcher::Impl::processNextChunks(const size_t *channels, size_t n, bool &last){
+    // As processNextChunk, for n channels at once.  They read their
+    // input and take their increments together, so they stay in step
+    // to the end, and last is only set once they all have written
+    // their last chunk.
+    for (auto i = size_t{0}; i < n; ++i) {
+        if (!testInbufReadSpace(channels[i])) {
             if (m_debugLevel > 2) {cerr << "processChunks: out of input" << endl;}
+            return false;
+        }
+    }
+    for (auto i = size_t{0}; i < n; ++i) {
+        auto &cd = *m_channelData[channels[i]];
+        if (!cd.draining) readChunk(cd);
+    }
+    auto phaseReset = false;
+    auto  phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
+    for (auto i = size_t{0}; i < n; ++i) {
+        getIncrements(channels[i], phaseIncrement, shiftIncrement, phaseReset);
+    }
+    analyseChunks(channels, n);
+    // Any followers must take the analysis before we modify it
+    auto followersLast = true;
+    for (auto &f : m_followers) {
+        for (auto i = size_t{0}; i < n; ++i) {
+            if (!f->processFollowingChunk(channels[i], *m_channelData[channels[i]])) followersLast = false;
+        }
+    }
+    last = processChunkInBits(channels, n, phaseIncrement, shiftIncrement, phaseReset);
+    // Carry on until every ratio has drained
+    last = last && followersLast;
+    for (auto i = size_t{0}; i < n; ++i) m_channelData[channels[i]]->chunkCount++;
+    if (m_debugLevel > 2) {
+        auto &cd = *m_channelData[channels[0]];
+        cerr << "channel " << channels[0] << ": last = " << last << ", chunkCount = " << cd.chunkCount << endl;
+    }
+    return true;
+}
+void
+RubbersStretcher::Impl::readChunk(ChannelData &cd){
+    // Read the next chunk's input into fltbuf and advance by one
+    // increment.  Zero-pad at the end of the input, rather than leave
+    // the previous frame's synthesis output in the rest of fltbuf
+    auto ready = cd.inbuf->getReadSpace();
+    assert(ready >= m_aWindowSize || cd.inputSize >= 0);
+    cd.inbuf->peek(cd.fltbuf, std::min(ready, m_aWindowSize));
+    if (ready < m_aWindowSize) v_zero(cd.fltbuf + ready, m_aWindowSize - ready);
+    cd.inbuf->skip(m_increment);
+}
+bool
+RubbersStretcher::Impl::processChunkInBits(const size_t *channels, size_t n,
+                                           size_t phaseIncrement,
+                                           size_t shiftIncrement,
+                                           bool phaseReset){
+    // Modify, synthesise and write the analysed chunk for the given
+    // channels.  An increment longer than the window is broken down
+    // into quarter-window bits, each starting again from the chunk as
+    // analysed, which is kept in savedFltbuf as synthesis overwrites
+    // fltbuf.  Return true once the channels have written their last
+    // chunk.
+    if (shiftIncrement <= m_aWindowSize) {
+        return processChunkForChannels(channels, n, phaseIncrement, shiftIncrement, phaseReset);
+    }
+    auto bit = m_aWindowSize/4;
+    if (m_debugLevel > 1) {
+        cerr << "channel " << channels[0] << " breaking down overlong increment " << shiftIncrement << " into " << bit << "-size bits" << endl;
+    }
+    for (auto j = size_t{0}; j < n; ++j) {
+        auto &cd = *m_channelData[channels[j]];
+        v_copy(cd.savedFltbuf, cd.fltbuf, m_aWindowSize);
+    }
+    auto last = false;
+    for (auto i = size_t{0}; i < shiftIncrement; i += bit) {
+        for (auto j = size_t{0}; j < n; ++j) {
+            auto &cd = *m_channelData[channels[j]];
+            v_copy(cd.fltbuf, cd.savedFltbuf, m_aWindowSize);
+        }
+        auto thisIncrement = bit;
+        if (i + thisIncrement > shiftIncrement) {thisIncrement = shiftIncrement - i;}
+        last = processChunkForChannels(channels, n, phaseIncrement + i, thisIncrement, phaseReset);
+        phaseReset = false;
+    }
+    return last;
+}
+bool
+RubbersStretcher::Impl::processChunkForChannels(const size_t *channels, size_t n,
+                                                size_t phaseIncrement,
+                                                size_t shiftIncrement,
+                                                bool phaseReset){
+    // As processChunkForChannel, for n channels, with the inverse
+    // FFTs of those still synthesising done as one batch.  With
+    // m_joint, their phases are also advanced together.
+    if (n == 1 && !m_joint) {
+        return processChunkForChannel(channels[0], phaseIncrement, shiftIncrement, phaseReset);
+    }
+    if (phaseReset && (m_debugLevel > 1)) {
+        cerr << "processChunkForChannels: phase reset found, incrs " << phaseIncrement << ":" << shiftIncrement << endl;
+    }
+    auto last = true;
+    auto synthesising = static_cast<size_t*>(alloca(n * sizeof(size_t)));
+    std::copy_n(channels, n, synthesising);
+    auto draining = [this](size_t c) { return m_channelData[c]->draining; };
+    auto m = size_t(std::remove_if(synthesising, synthesising + n, draining) - synthesising);
+    modifyChunks(synthesising, m, phaseIncrement, phaseReset);
+    synthesiseChunks(synthesising, m, shiftIncrement);
+    for (auto i = size_t{0}; i < n; ++i) {
+        auto c = channels[i];
+        if (!writeChunkForChannel(c, shiftIncrement, m_channelData[c]->draining)) last = false;
+    }
+    return last;
+}
+bool
+RubbersStretcher::Impl::processFollowingChunk(size_t c, const ChannelData &analysed){
+    Profiler profiler("RubbersStretcher::Impl::processFollowingChunk");
+    // As processNextChunk, but for a follower, which copies the
+    // chunk as analysed by its leader for channel c rather than
+    // reading any input.  Return true once the channel has written
+    // its last chunk.
+    auto &cd = *m_channelData[c];
+    if (cd.outputComplete) return true;
+    cd.inputSize = analysed.inputSize;
+    cd.draining = analysed.draining;
+    cd.silent = analysed.silent;
+    const auto hs = m_fftSize / 2 + 1;
+    auto phaseReset = false;
+    auto phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
+    getIncrements(c, phaseIncrement, shiftIncrement, phaseReset);
+    v_copy(cd.mag, analysed.mag, hs);
+    v_copy(cd.phase, analysed.phase, hs);
+    v_copy(cd.fltbuf, analysed.fltbuf, m_aWindowSize);
+    auto last = processChunkInBits(&c, 1, phaseIncrement, shiftIncrement, phaseReset);
+    cd.chunkCount++;
+    return last;
+}
+#ifndef NO_THREADING
+void
+RubbersStretcher::Impl::processChunksThreaded(){
+    Profiler profiler("RubbersStretcher::Impl::processChunksThreaded");
+    // In offline mode every increment is known in advance, so the
+    // channels don't depend on one another and each channel's backlog
+    // can go to the shared pool as a separate task.  We help out on
+    // this thread until they are all done, so process() still returns
+    // with all available input processed, just as when unthreaded.
+    ThreadPool::TaskGroup group(ThreadPool::instance());
+    for (size_t c = 0; c < m_channels; ++c) {
+        group.run([this, c] {
+                auto any = false, last = false;
+                processChunks(c, any, last);
+            });
+    }
+    group.wait();
+}
+#endif
+void
+RubbersStretcher::Impl::processChunksExecuted(){
+    Profiler profiler("RubbersStretcher::Impl::processChunksExecuted");
+    // As processChunksThreaded, but for a caller-supplied executor.
+    // Rather than hand over a whole channel's backlog at once, we go
+    // in rounds of one chunk per channel, so that each work item is
+    // bounded by a single analysis and synthesis step.  Channels drop
+    // out of the rounds as they run out of input or reach the end.
+    auto active = static_cast<size_t*>(alloca(m_channels * sizeof(size_t)));
+    auto more   = static_cast<bool*>(alloca(m_channels * sizeof(bool)));
+    auto n = m_channels;
+    for (auto c = size_t{0}; c < n; ++c) active[c] = c;
+    auto step = [this, active, more](size_t i) {
+        auto last = false;
+        more[i] = processNextChunk(active[i], last) && !last;
+    };
+    while (n > 0) {
+        execute(n, step);
+        auto remaining = size_t{0};
+        for (auto i = size_t{0}; i < n; ++i) {
+            if (more[i]) active[remaining++] = active[i];
+        }
+        n = remaining;
+    }
+}
+bool
+RubbersStretcher::Impl::processesInStep() const{
+    // Whether offline processing takes the channels through each
+    // chunk together, rather than through each channel's backlog in
+    // turn.  m_joint needs this, and when nothing else would run the
+    // channels concurrently it lets their FFTs go as one batch.
+    if (m_realtime) return false;
+    if (m_joint) return true;
+    if (m_executor || m_channels < 2) return false;
+#ifndef NO_THREADING
+    if (m_threaded || m_pipelined || !m_segmentStarts.empty()) return false;
+#endif
+    return true;
+}
+void
+RubbersStretcher::Impl::processChunksInStep(){
+    Profiler profiler("RubbersStretcher::Impl::processChunksInStep");
+    // As processChunks, but for every channel at once, as decided by
+    // processesInStep.
+    auto channels = static_cast<size_t*>(alloca(m_channels * sizeof(size_t)));
+    for (auto c = size_t{0}; c < m_channels; ++c) channels[c] = c;
+    auto last = false;
+    while (!last) {
+        if (!processNextChunks(channels, m_channels, last)) break;
+    }
+}
+#ifndef NO_THREADING
+void
+RubbersStretcher::Impl::processSegments(size_t c){
+    Profiler profiler("RubbersStretcher::Impl::processSegments");
+    // Offline rendering in independent segments, starting at the
+    // chunks chosen by chooseSegments.  Here we only gather each
+    // segment's input from the input buffer; the segment is rendered
+    // on the shared pool once complete, and the rendered segments are
+    // stitched back into the channel's output in order as they
+    // finish.  The final chunks, which may be short and need the
+    // draining logic, are left to processChunks once every segment
+    // before them has been stitched.
+    auto &cd = *m_channelData[c];
+    auto &open = m_openSegments[c];
+    const auto maxRendering = size_t(ThreadPool::instance().getWorkerCount()) * 2 + 2;
+    while (true) {
+        stitchSegments(c);
+        if (cd.inbuf->getReadSpace() < m_aWindowSize) {
+            if (cd.inputSize < 0) return; // more input to come
             break;
         }
-        any = true;
-        if (!cd.draining) {
-            auto ready = cd.inbuf->getReadSpace();
-            assert(ready >= m_aWindowSize || cd.inputSize >= 0);
-            cd.inbuf->peek(cd.fltbuf, std::min(ready, m_aWindowSize));
-            cd.inbuf->skip(m_increment);
+        auto chunk = cd.chunkCount;
+        if (chunk + 1 >= m_outputIncrements.size()) break;
+        if (open && std::binary_search(m_segmentStarts.begin(), m_segmentStarts.end(), chunk)) {
+            submitSegment(c);
         }
+        if (!open) {
+            if (m_renderingSegments[c].size() >= maxRendering) {
+                // Don't let the input and output held by segments
+                // in flight grow without limit
+                m_segmentGroup->wait();
+                stitchSegments(c);
+            }
+            open.reset(new Segment(chunk, new ChannelData({ m_fftSize },
+                                                          std::max(m_aWindowSize, m_sWindowSize),
+                                                          m_fftSize, 0)));
+        }
+        // Consecutive windows overlap, so peeking each whole window
+        // into place leaves the input contiguous
+        auto offset = (chunk - open->start) * m_increment;
+        open->input.resize(offset + m_aWindowSize);
+        cd.inbuf->peek(&open->input[offset], m_aWindowSize);
+        cd.inbuf->skip(m_increment);
+        cd.chunkCount++;
+    }
+    if (open) submitSegment(c);
+    if (m_segmentGroup) m_segmentGroup->wait();
+    stitchSegments(c);
+    auto any = false, last = false;
+    processChunks(c, any, last);
+}
+void
+RubbersStretcher::Impl::submitSegment(size_t c){
+    auto segment = m_openSegments[c].release();
+    segment->end = m_channelData[c]->chunkCount;
+    m_renderingSegments[c].emplace_back(segment);
+    if (!m_segmentGroup) m_segmentGroup.reset(new ThreadPool::TaskGroup(ThreadPool::instance()));
+    m_segmentGroup->run([this, segment] {
+            renderSegment(*segment);
+            segment->done.store(true, std::memory_order_release);
+        });
+}
+void
+RubbersStretcher::Impl::renderSegment(Segment &segment){
+    Profiler profiler("RubbersStretcher::Impl::renderSegment");
+    // As processNextChunk, for each chunk of the segment, except that
+    // the output is collected raw instead of being written out
+    auto &cd = *segment.cd;
+    const auto wsz = m_sWindowSize;
+    auto emit = [&](size_t si) {
+        segment.increments.push_back(si);
+        segment.accumulator.insert(segment.accumulator.end(), cd.accumulator, cd.accumulator + si);
+        segment.windowAccumulator.insert(segment.windowAccumulator.end(), cd.windowAccumulator, cd.windowAccumulator + si);
+        shiftAccumulators(cd, si);
+    };
+    cd.windowAccumulator[0] = 0.f; // the stitched channel already has its own
+    cd.chunkCount = segment.start;
+    for (auto chunk = segment.start; chunk < segment.end; ++chunk) {
+        std::copy_n(&segment.input[(chunk - segment.start) * m_increment], m_aWindowSize, cd.fltbuf);
         auto phaseReset = false;
-        auto  phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
-        getIncrements(c, phaseIncrement, shiftIncrement, phaseReset);
+        auto phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
+        getIncrements(cd, phaseIncrement, shiftIncrement, phaseReset);
+        analyseChunk(cd);
         if (shiftIncrement <= m_aWindowSize) {
-            analyseChunk(c);
-            last = processChunkForChannel(c, phaseIncrement, shiftIncrement, phaseReset);
+            modifyChunk(cd, phaseIncrement, phaseReset);
+            synthesiseChunk(cd, shiftIncrement);
+            emit(shiftIncrement);
         } else {
             auto bit = m_aWindowSize/4;
-            if (m_debugLevel > 1) {
-                cerr << "channel " << c << " breaking down overlong increment " << shiftIncrement << " into " << bit << "-size bits" << endl;
-            }
-            if (!tmp) tmp = allocate<float>(m_aWindowSize);
-            analyseChunk(c);
-            std::copy_n ( cd.fltbuf, m_aWindowSize, tmp );
+            auto tmp = std::vector<float>(cd.fltbuf, cd.fltbuf + m_aWindowSize);
             for (auto i = size_t{0}; i < shiftIncrement; i += bit) {
-                std::copy_n ( tmp, m_aWindowSize, cd.fltbuf );
+                std::copy(tmp.begin(), tmp.end(), cd.fltbuf);
                 auto thisIncrement = bit;
                 if (i + thisIncrement > shiftIncrement) {thisIncrement = shiftIncrement - i;}
-                last = processChunkForChannel(c, phaseIncrement + i, thisIncrement, phaseReset);
+                modifyChunk(cd, phaseIncrement + i, phaseReset);
+                synthesiseChunk(cd, thisIncrement);
+                emit(thisIncrement);
                 phaseReset = false;
             }
         }
         cd.chunkCount++;
-        if (m_debugLevel > 2) {cerr << "channel " << c << ": last = " << last << ", chunkCount = " << cd.chunkCount << endl;}
     }
-    if (tmp) deallocate(tmp);
+    segment.input = std::vector<float>();
+    segment.accumulator.insert(segment.accumulator.end(), cd.accumulator, cd.accumulator + wsz);
+    segment.windowAccumulator.insert(segment.windowAccumulator.end(), cd.windowAccumulator, cd.windowAccumulator + wsz);
 }
+void
+RubbersStretcher::Impl::stitchSegments(size_t c){
+    // Write out any rendered segments at the front of the queue for
+    // channel c.  Each segment's raw output is added to the tail
+    // already pending in the channel's accumulators and then written
+    // exactly as the chunks would have been, and afterwards the
+    // channel is left in the state the segment's own ChannelData
+    // reached, so that serial processing can carry on from it.
+    auto &cd = *m_channelData[c];
+    auto &rendering = m_renderingSegments[c];
+    const auto wsz = m_sWindowSize;
+    const auto hs = m_fftSize / 2 + 1;
+    while (!rendering.empty() && rendering.front()->done.load(std::memory_order_acquire)) {
+        auto &segment = *rendering.front();
+        auto &scd = *segment.cd;
+        auto pos = size_t{0};
+        for (auto si : segment.increments) {
+            v_add(cd.accumulator, &segment.accumulator[pos], si);
+            v_add(cd.windowAccumulator, &segment.windowAccumulator[pos], si);
+            writeChunkForChannel(c, si, false);
+            pos += si;
+        }
+        v_add(cd.accumulator, &segment.accumulator[pos], wsz);
+        v_add(cd.windowAccumulator, &segment.windowAccumulator[pos], wsz);
+        cd.accumulatorFill = scd.accumulatorFill;
+        v_copy(cd.fltbuf, scd.fltbuf, wsz);
+        v_copy(cd.mag, scd.mag, hs);
+        v_copy(cd.phase, scd.phase, hs);
+        v_copy(cd.prevPhase, scd.prevPhase, hs);
+        v_copy(cd.prevError, scd.prevError, hs);
+        v_copy(cd.unwrappedPhase, scd.unwrappedPhase, hs);
+        v_copy(cd.interpolator, scd.interpolator, wsz);
+        cd.interpolatorScale = scd.interpolatorScale;
+        cd.unchanged = scd.unchanged;
+        rendering.pop_front();
+    }
+}
+#endif
 bool
 RubbersStretcher::Impl::processOneChunk(){
     Profiler profiler("RubbersStretcher::Impl::processOneChunk");
@@ -182,6 +528,40 @@ RubbersStretcher::Impl::processOneChunk(){
     // enough data on each channel for at least one chunk.  This is
     // able to calculate increments as it goes along.
     // This is the normal process method in RT mode.
+    // The analyses are independent per channel, and so are the
+    // syntheses once the shared increments are known; both go to the
+    // executor if there is one.  Without one, the channels' FFTs are
+    // done together as batches instead.
+    auto analysing = static_cast<size_t*>(alloca(m_channels * sizeof(size_t)));
+    auto n = size_t{0};
+    auto ready = readOneChunk(analysing, n);
+    if (!m_executor) {
+        analyseChunks(analysing, n);
+    } else {
+        auto analyse = [this, analysing](size_t i) { analyseChunk(*m_channelData[analysing[i]]); };
+        execute(n, analyse);
+    }
+    if (!ready) return false;
+    auto phaseReset = false;
+    auto phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
+    getOneChunkIncrements(phaseIncrement, shiftIncrement, phaseReset);
+    if (!m_executor) return writeOneChunks(phaseIncrement, shiftIncrement, phaseReset);
+    modifyJointly(phaseIncrement, phaseReset);
+    auto lasts = static_cast<bool*>(alloca(m_channels * sizeof(bool)));
+    auto synthesise = [&](size_t c) {
+        lasts[c] = writeOneChunk(c, phaseIncrement, shiftIncrement, phaseReset);
+    };
+    execute(m_channels, synthesise);
+    return lasts[m_channels - 1];
+}
+bool
+RubbersStretcher::Impl::readOneChunk(size_t *analysing, size_t &n){
+    // Read the next chunk's input for every channel, listing in
+    // analysing the n channels that need analysis.  Return false if
+    // any channel is out of input.  None need analysis if the chunk
+    // is bypassed.
+    n = 0;
+    updateBypass();
     for (auto c = size_t{0}; c < m_channels; ++c) {
         if (!testInbufReadSpace(c)) {
             if (m_debugLevel > 2) {cerr << "processOneChunk: out of input" << endl;}
@@ -189,25 +569,168 @@ RubbersStretcher::Impl::processOneChunk(){
         }
         auto &cd = *m_channelData[c];
         if (!cd.draining) {
-            auto ready = cd.inbuf->getReadSpace();
-            assert(ready >= m_aWindowSize || cd.inputSize >= 0);
-            cd.inbuf->peek(cd.fltbuf, std::min(ready, m_aWindowSize));
-            cd.inbuf->skip(m_increment);
-            analyseChunk(c);
+            readChunk(cd);
+            if (bypassing()) continue;
+            if (m_bypassLeaving) primeAccumulators(cd);
+            analysing[n++] = c;
         }
     }
-    auto phaseReset = false;
-    auto phaseIncrement = size_t{0}, shiftIncrement = size_t{0};
+    return true;
+}
+void
+RubbersStretcher::Impl::getOneChunkIncrements(size_t &phaseIncrement, size_t &shiftIncrement, bool &phaseReset){
+    // Once every channel has been analysed
+    if (bypassing()) {
+        phaseIncrement = shiftIncrement = m_increment;
+        phaseReset = false;
+        m_channelData[0]->prevIncrement = m_increment;
+        return;
+    }
     if (!getIncrements(0, phaseIncrement, shiftIncrement, phaseReset)) 
     {calculateIncrements(phaseIncrement, shiftIncrement, phaseReset);}
-    auto last = false;
+    // Coming out of bypass, the phases have no history to follow
+    if (m_bypassLeaving) phaseReset = true;
+}
+void
+RubbersStretcher::Impl::modifyJointly(size_t phaseIncrement, bool phaseReset){
+    // With m_joint, the phases of every channel still synthesising
+    // are advanced here, ahead of writeOneChunk for each channel
+    if (!m_joint || bypassing()) return;
+    auto synthesising = static_cast<size_t*>(alloca(m_channels * sizeof(size_t)));
+    modifyOneChunks(synthesising, phaseIncrement, phaseReset);
+}
+size_t
+RubbersStretcher::Impl::modifyOneChunks(size_t *synthesising, size_t phaseIncrement, bool phaseReset){
+    // Modify the chunk of every channel still synthesising, listing
+    // them in synthesising and returning how many there are
+    if (phaseReset && (m_debugLevel > 1)) {
+        cerr << "modifyOneChunks: phase reset found, phase increment " << phaseIncrement << endl;
+    }
+    auto n = size_t{0};
     for (auto c = size_t{0}; c < m_channels; ++c) {
+        if (!m_channelData[c]->draining) synthesising[n++] = c;
+    }
+    modifyChunks(synthesising, n, phaseIncrement, phaseReset);
+    return n;
+}
+bool
+RubbersStretcher::Impl::writeOneChunk(size_t c, size_t phaseIncrement, size_t shiftIncrement, bool phaseReset){
+    auto &cd = *m_channelData[c];
+    auto last = false;
+    if (bypassing()) {
+        bypassChunk(cd);
+        last = writeChunkForChannel(c, shiftIncrement, cd.draining);
+    } else if (m_joint) {
+        // modifyJointly has been and gone
+        if (!cd.draining) synthesiseChunk(cd, shiftIncrement);
+        last = writeChunkForChannel(c, shiftIncrement, cd.draining);
+    } else {
         last = processChunkForChannel(c, phaseIncrement, shiftIncrement, phaseReset);
-        m_channelData[c]->chunkCount++;
     }
+    cd.chunkCount++;
     return last;
 }
 
+bool
+RubbersStretcher::Impl::writeOneChunks(size_t phaseIncrement, size_t shiftIncrement, bool phaseReset){
+    // As writeOneChunk for every channel in turn, except that the
+    // channels' inverse FFTs are done together as one batch
+    if (bypassing()) {
+        auto last = false;
+        for (auto c = size_t{0}; c < m_channels; ++c) {
+            last = writeOneChunk(c, phaseIncrement, shiftIncrement, phaseReset);
+        }
+        return last;
+    }
+    auto synthesising = static_cast<size_t*>(alloca(m_channels * sizeof(size_t)));
+    auto n = modifyOneChunks(synthesising, phaseIncrement, phaseReset);
+    synthesiseChunks(synthesising, n, shiftIncrement);
+    return finishOneChunks(shiftIncrement);
+}
+bool
+RubbersStretcher::Impl::finishOneChunks(size_t shiftIncrement){
+    // Write out every channel's synthesised chunk
+    auto last = false;
+    for (auto c = size_t{0}; c < m_channels; ++c) {
+        auto &cd = *m_channelData[c];
+        last = writeChunkForChannel(c, shiftIncrement, cd.draining);
+        cd.chunkCount++;
+    }
+    return last;
+}
+bool
+RubbersStretcher::Impl::canBypass() const{
+    // Whether chunks may skip processing.  The input would come out
+    // unchanged anyway, but this relies on the synthesis frame lining
+    // up with the analysis frame, and it stops once the input is
+    // complete, as draining needs the accumulators to be complete too
+    if (!m_realtime || m_timeRatio != 1.0 || m_pitchScale != 1.0) return false;
+    if (m_aWindowSize != m_sWindowSize || m_sWindowSize > m_fftSize) return false;
+    for (auto c = size_t{0}; c < m_channels; ++c) {
+        if (m_channelData[c]->inputSize >= 0) return false;
+    }
+    return true;
+}
+void
+RubbersStretcher::Impl::updateBypass(){
+    // Move the bypass mix one chunk along.  The frames are mixed
+    // rather than the output, so that the overlap-add smooths over
+    // any difference in where the two would have the input go.  Once
+    // the accumulators hold only frames taken wholly from the input,
+    // the chunks can be copied instead.
+    auto wasBypassing = bypassing();
+    auto step = float(m_increment) / m_aWindowSize;
+    m_bypassTarget = canBypass();
+    if (m_bypassTarget) {
+        if (m_bypassGain == 1.f && !wasBypassing) ++m_bypassHeld;
+        m_bypassGain = std::min(m_bypassGain + step, 1.f);
+    } else {
+        m_bypassGain = std::max(m_bypassGain - step, 0.f);
+        m_bypassHeld = 0;
+    }
+    m_bypassLeaving = (wasBypassing && !m_bypassTarget);
+}
+void
+RubbersStretcher::Impl::bypassChunk(ChannelData &cd){
+    // At unity each chunk writes out the first m_increment samples of
+    // its input frame, so a bypassed chunk just puts those in the
+    // accumulator with unit weight.  The inbuf, which has to hold a
+    // window of input ahead of them anyway, serves as the delay line,
+    // and the output keeps the same latency as when processing.
+    v_copy(cd.accumulator, cd.fltbuf, m_increment);
+    v_set(cd.windowAccumulator, 1.f, m_increment);
+    cd.accumulatorFill = std::max(cd.accumulatorFill, m_increment);
+}
+void
+RubbersStretcher::Impl::primeAccumulators(ChannelData &cd){
+    // Coming out of bypass, fill the accumulators as if the earlier
+    // chunks overlapping this one had been taken from the input, as
+    // the last ones before bypass were, using the input frame in
+    // cd.fltbuf before it is windowed
+    const auto wsz = m_sWindowSize;
+    float *const  accumulator = cd.accumulator;
+    float *const  windowAccumulator = cd.windowAccumulator;
+    v_zero(accumulator, wsz);
+    v_zero(windowAccumulator, wsz);
+    cd.accumulatorFill = wsz - std::min(wsz, m_increment);
+    if (m_aWindowSize != wsz || wsz > m_fftSize) {
+        // The new sizes have no unchanged frame to follow, so start
+        // afresh as at the start of the stream
+        windowAccumulator[0] = 1.f;
+        return;
+    }
+    const float *const  awindow = m_awindow->getValues();
+    const float *const  swindow = m_swindow->getValues();
+    const float *const  weights = m_sWindowWeights.data();
+    for (auto offset = m_increment; offset < wsz; offset += m_increment) {
+        for (auto i = size_t{0}; i + offset < wsz; ++i) {
+            accumulator[i] += awindow[i + offset] * swindow[i + offset];
+            windowAccumulator[i] += weights[i + offset];
+        }
+    }
+    v_multiply(accumulator, cd.fltbuf, wsz);
+}
+
 bool
 RubbersStretcher::Impl::testInbufReadSpace(size_t c){
     Profiler profiler("RubbersStretcher::Impl::testInbufReadSpace");
@@ -264,12 +787,21 @@ RubbersStretcher::Impl::processChunkForChannel(size_t c,
         // reached the true end of the data.
         // We need to peek m_aWindowSize samples for processing, and
         // then skip m_increment to advance the read pointer.
-        modifyChunk(c, phaseIncrement, phaseReset);
-        synthesiseChunk(c, shiftIncrement); // reads from cd.mag, cd.phase
+        modifyChunk(cd, phaseIncrement, phaseReset);
+        synthesiseChunk(cd, shiftIncrement); // reads from cd.mag, cd.phase
 
     }
+    return writeChunkForChannel(c, shiftIncrement, cd.draining);
+}
+bool
+RubbersStretcher::Impl::writeChunkForChannel(size_t c, size_t shiftIncrement, bool draining){
+    // Write out the synthesised chunk for a channel, growing the
+    // output buffer if necessary.  The draining state is passed in
+    // rather than read from the channel, as in pipelined mode the
+    // analysis stage may already have moved on to draining.
+    auto &cd = *m_channelData[c];
     auto last = false;
-    if (cd.draining) {
+    if (draining) {
         if (m_debugLevel > 1) {cerr << "draining: accumulator fill = " << cd.accumulatorFill << " (shiftIncrement = " << shiftIncrement << ")" <<  endl;}
         if (shiftIncrement == 0) {
             cerr << "WARNING: draining: shiftIncrement == 0, can't handle that in this context: setting to " << m_increment << endl;
@@ -282,7 +814,7 @@ RubbersStretcher::Impl::processChunkForChannel(size_t c,
         }
     }
     auto required = static_cast<ssize_t>(shiftIncrement);
-    if (m_pitchScale != 1.0) {required = static_cast<ssize_t>((required / m_pitchScale) + 1);}
+    if (m_pitchScale != 1.0 || m_bandRatio < 1.0) {required = static_cast<ssize_t>((required / (m_pitchScale * m_bandRatio)) + 1);}
     auto ws = static_cast<ssize_t>(cd.outbuf->getWriteSpace());
     if (ws < required) {
         if (m_debugLevel > 0) {cerr << "Buffer overrun on output for channel " << c << endl;}
@@ -295,9 +827,10 @@ RubbersStretcher::Impl::processChunkForChannel(size_t c,
         // This is an unhappy situation.
         auto *oldbuf = cd.outbuf;
         cd.outbuf = oldbuf->resized(oldbuf->size() + (required - ws));
+        std::unique_lock<Mutex> lock(m_emergencyMutex);
         m_emergencyScavenger.claim(oldbuf);
     }
-    writeChunk(c, shiftIncrement, last);
+    writeChunk(c, shiftIncrement, last, draining);
     return last;
 }
 void
@@ -342,7 +875,8 @@ RubbersStretcher::Impl::calculateIncrements(size_t &phaseIncrementRtn,size_t &sh
         df = m_phaseResetAudioCurve->process((float *)cd.mag, m_increment);
         silent = (m_silentAudioCurve->process((float *)cd.mag, m_increment) > 0.f);
     } else {
-        auto tmp = (float *)alloca(hs * sizeof(float));
+        // The first channel's scratch is free until synthesis
+        auto tmp = cd.spare;
         std::fill_n ( tmp, hs, 0.f );
         for (auto c = decltype(m_channels){0}; c < m_channels; ++c) {
             v_add(tmp, m_channelData[c]->mag, hs);
@@ -384,13 +918,17 @@ RubbersStretcher::Impl::calculateIncrements(size_t &phaseIncrementRtn,size_t &sh
 }
 bool
 RubbersStretcher::Impl::getIncrements(size_t channel,size_t &phaseIncrementRtn,size_t &shiftIncrementRtn,bool &phaseReset){
-    Profiler profiler("RubbersStretcher::Impl::getIncrements");
     if (channel >= m_channels) {
         phaseIncrementRtn = m_increment;
         shiftIncrementRtn = m_increment;
         phaseReset = false;
         return false;
     }
+    return getIncrements(*m_channelData[channel], phaseIncrementRtn, shiftIncrementRtn, phaseReset);
+}
+bool
+RubbersStretcher::Impl::getIncrements(ChannelData &cd,size_t &phaseIncrementRtn,size_t &shiftIncrementRtn,bool &phaseReset){
+    Profiler profiler("RubbersStretcher::Impl::getIncrements");
     // There are two relevant output increments here.  The first is
     // the phase increment which we use when recalculating the phases
     // for the current chunk; the second is the shift increment used
@@ -406,7 +944,6 @@ RubbersStretcher::Impl::getIncrements(size_t channel,size_t &phaseIncrementRtn,s
     // consistency.
     
     // m_outputIncrements stores phase increments.
-    auto &cd = *m_channelData[channel];
     auto gotData = true;
     if (cd.chunkCount >= m_outputIncrements.size()) {
 //        cerr << "WARNING: RubbersStretcher::Impl::getIncrements:"
@@ -443,25 +980,127 @@ RubbersStretcher::Impl::getIncrements(size_t channel,size_t &phaseIncrementRtn,s
     return gotData;
 }
 void
-RubbersStretcher::Impl::analyseChunk(size_t channel){
+RubbersStretcher::Impl::analyseChunk(ChannelData &cd){
+    if (skipIfSilent(cd)) return;
+    analyseChunk(cd, cd.fltbuf, cd.mag, cd.phase);
+}
+float
+RubbersStretcher::Impl::silenceThreshold() const{
+    float level = m_silenceThreshold;
+    if (level >= 0.f) return level;
+    // Every bin of the analysis FFT is bounded by the peak input
+    // level times the sum of the analysis window, so below this the
+    // silent audio curve would find nothing
+    return 1e-6f / (m_awindow->getArea() * m_aWindowSize);
+}
+bool
+RubbersStretcher::Impl::skipIfSilent(ChannelData &cd){
+    // Decide whether the chunk in cd.fltbuf is silent, in which case
+    // it is not analysed at all.  Its spectrum is taken to be empty,
+    // for the onset detector and any followers, and modifyChunk and
+    // synthesiseChunk then skip it too.
+    cd.silent = skipIfSilent(cd.fltbuf, cd.mag, cd.phase);
+    return cd.silent;
+}
+bool
+RubbersStretcher::Impl::skipIfSilent(const float *fltbuf, float *mag, float *phase){
+    const auto threshold = silenceThreshold();
+    auto peak = 0.f;
+    for (size_t i = 0; i < m_aWindowSize; ++i) peak = std::max(peak, fabsf(fltbuf[i]));
+    m_chunksAnalysed.fetch_add(1, std::memory_order_relaxed);
+    if (peak >= threshold) return false;
+    m_chunksSkipped.fetch_add(1, std::memory_order_relaxed);
+    const auto hs = m_fftSize / 2 + 1;
+    v_zero(mag, hs);
+    v_zero(phase, hs);
+    return true;
+}
+void
+RubbersStretcher::Impl::analyseChunk(ChannelData &cd, float *fltbuf, float *mag, float *phase){
     Profiler profiler("RubbersStretcher::Impl::analyseChunk");
-    ChannelData &cd = *m_channelData[channel];
     float *const  dblbuf = cd.dblbuf;
-    float *const  fltbuf = cd.fltbuf;
-    // cd.fltbuf is known to contain m_aWindowSize samples
-    if (m_aWindowSize > m_fftSize) {m_afilter->cut(fltbuf);}
-    cutShiftAndFold(dblbuf, m_fftSize, fltbuf, m_awindow);
-    cd.fft->forwardPolar(dblbuf, cd.mag, cd.phase);
+    // fltbuf is known to contain m_aWindowSize samples
+    // the sinc filter, window, rotation and fold are all applied in one
+    // pass; fltbuf is left windowed for synthesiseChunk to reuse
+    cutShiftAndFold(dblbuf, m_fftSize, fltbuf, m_awindow,
+                    m_aWindowSize > m_fftSize ? m_afilter : nullptr);
+    cd.fft->forwardPolar(dblbuf, mag, phase);
 }
 void
-RubbersStretcher::Impl::modifyChunk(size_t channel,size_t outputIncrement,bool phaseReset){
+RubbersStretcher::Impl::analyseChunks(const size_t *channels, size_t n){
+    // As analyseChunk for each of the given channels, with their
+    // forward FFTs done as one batch by the first channel's FFT
+    if (n < 2) {
+        for (auto i = size_t{0}; i < n; ++i) analyseChunk(*m_channelData[channels[i]]);
+        return;
+    }
+    Profiler profiler("RubbersStretcher::Impl::analyseChunks");
+    auto frames = static_cast<float**>(alloca(3 * n * sizeof(float*)));
+    auto mags = frames + n;
+    auto phases = mags + n;
+    auto k = prepareAnalysis(channels, n, frames, mags, phases);
+    m_channelData[0]->fft->forwardPolarBatch(int(k), frames, mags, phases);
+}
+size_t
+RubbersStretcher::Impl::prepareAnalysis(const size_t *channels, size_t n,
+                                        float **frames, float **mags, float **phases){
+    // The part of analyseChunks before the FFTs.  List the frames
+    // to be transformed, and where their spectra go, returning how
+    // many there are
+    auto k = size_t{0};
+    for (auto i = size_t{0}; i < n; ++i) {
+        auto &cd = *m_channelData[channels[i]];
+        if (skipIfSilent(cd)) continue;
+        cutShiftAndFold(cd.dblbuf, m_fftSize, cd.fltbuf, m_awindow,
+                        m_aWindowSize > m_fftSize ? m_afilter : nullptr);
+        frames[k] = cd.dblbuf;
+        mags[k] = cd.mag;
+        phases[k] = cd.phase;
+        ++k;
+    }
+    return k;
+}
+void
+RubbersStretcher::Impl::modifyChunk(ChannelData &cd,size_t outputIncrement,bool phaseReset){
+    if (cd.silent) {
+        modifySilentChunk(cd);
+        cd.unchanged = true;
+        return;
+    }
+    cd.unchanged = modifyChunk(cd, cd.mag, cd.phase, outputIncrement, phaseReset, cd.unchanged);
+}
+void
+RubbersStretcher::Impl::modifySilentChunk(ChannelData &cd){
+    // As a phase reset on an empty spectrum would leave things, so
+    // that the phases pick up afresh when the signal returns
+    const auto hs = m_fftSize / 2 + 1;
+    v_zero(cd.prevPhase, hs);
+    v_zero(cd.prevError, hs);
+    v_zero(cd.unwrappedPhase, hs);
+}
+bool
+RubbersStretcher::Impl::modifyChunk(ChannelData &cd,const float *mag,float *phase,size_t outputIncrement,bool phaseReset,bool wasUnchanged){
     Profiler profiler("RubbersStretcher::Impl::modifyChunk");
-    ChannelData &cd = *m_channelData[channel];
+    // Update the phases in place, returning whether the frame can be
+    // resynthesised unchanged from its input
     if (phaseReset && m_debugLevel > 1) {cerr << "phase reset: leaving phases unmodified" << endl;}
-    const auto rate = m_sampleRate;
     const auto count = m_fftSize / 2;
-    auto unchanged = cd.unchanged && (outputIncrement == m_increment);
-    auto fullReset = phaseReset;
+    auto unchanged = wasUnchanged && (outputIncrement == m_increment);
+    auto advance = PhaseAdvance();
+    setUpPhaseAdvance(advance, outputIncrement, phaseReset);
+    if (m_options & OptionPhaseSparse) advance.mag = mag;
+    auto distacc = 0.0f;
+    auto fullReset = advance.process(phase, cd.prevPhase, cd.prevError,
+                                     cd.unwrappedPhase, cd.errorDelta, distacc);
+    if (m_debugLevel > 2) {cerr << "mean inheritance distance = " << distacc / count << endl;}
+    if (fullReset) unchanged = true;
+    if (unchanged && m_debugLevel > 1) {cerr << "frame unchanged" << endl;}
+    return unchanged;
+}    
+void
+RubbersStretcher::Impl::setUpPhaseAdvance(PhaseAdvance &advance, size_t outputIncrement, bool phaseReset) const{
+    // Everything but the magnitudes, which differ by channel
+    const auto rate = m_sampleRate;
     auto laminar = !(m_options & OptionPhaseIndependent);
     auto bandlimited = (m_options & OptionTransientsMixed);
     auto bandlow = static_cast<int>(lrint((150 * m_fftSize) / rate));
@@ -485,166 +1124,321 @@ RubbersStretcher::Impl::modifyChunk(size_t channel,size_t outputIncrement,bool p
     auto limit2 = static_cast<int>(lrint((freq2 * m_fftSize) / rate));
     if (limit1 < limit0) limit1 = limit0;
     if (limit2 < limit1) limit2 = limit1;
-    auto prevInstability = 0.0f;
-    auto prevDirection = false;
-    auto distance = 0.0f;
-    const auto maxdist = 8.0f;
-    const auto lookback = 1;
+    advance.fftSize = m_fftSize;
+    advance.increment = m_increment;
+    advance.outputIncrement = outputIncrement;
+    advance.laminar = laminar;
+    advance.reset = phaseReset;
+    advance.bandlimited = bandlimited;
+    advance.bandlow = bandlow;
+    advance.bandhigh = bandhigh;
+    advance.limit0 = limit0;
+    advance.limit1 = limit1;
+    advance.limit2 = limit2;
+    if (m_options & OptionPhaseSparse) advance.floor = 3.16e-4f; // -70dB
+}
+void
+RubbersStretcher::Impl::modifyChunks(const size_t *channels, size_t n, size_t outputIncrement, bool phaseReset){
+    // As modifyChunk for each of the given channels.  With m_joint
+    // their phases are gathered into its channel-interleaved state
+    // and advanced together, and scattered back again
+    if (!m_joint) {
+        for (auto i = size_t{0}; i < n; ++i) modifyChunk(*m_channelData[channels[i]], outputIncrement, phaseReset);
+        return;
+    }
+    Profiler profiler("RubbersStretcher::Impl::modifyChunks");
+    if (phaseReset && m_debugLevel > 1) {cerr << "phase reset: leaving phases unmodified" << endl;}
+    auto &joint = *m_joint;
+    const auto stride = m_channels;
+    const auto hs = m_fftSize / 2 + 1;
+    // Channels not given, and silent ones, have no weight in the
+    // shared decisions
+    v_zero(joint.mag, int(hs * stride));
+    for (auto i = size_t{0}; i < n; ++i) {
+        const auto c = channels[i];
+        const auto &cd = *m_channelData[c];
+        if (cd.silent) {
+            for (auto b = size_t{0}; b < hs; ++b) joint.phase[b * stride + c] = 0.0f;
+            continue;
+        }
+        const float *const  mag = cd.mag;
+        const float *const  phase = cd.phase;
+        for (auto b = size_t{0}; b < hs; ++b) {
+            joint.mag[b * stride + c] = mag[b];
+            joint.phase[b * stride + c] = phase[b];
+        }
+    }
+    auto advance = PhaseAdvance();
+    setUpPhaseAdvance(advance, outputIncrement, phaseReset);
     auto distacc = 0.0f;
-    for (auto i = static_cast<int>(count); i >= 0; i -= lookback) {
-        auto resetThis = phaseReset;
-        if (bandlimited) {
-            if (resetThis) {
-                if (i > bandlow && i < bandhigh) {
-                    resetThis = false;
-                    fullReset = false;
-                }
+    auto fullReset = advance.processJoint(int(stride), joint.mag, joint.bins,
+                                          joint.phase, joint.prevPhase, joint.prevError,
+                                          joint.unwrappedPhase, joint.delta, joint.shared,
+                                          distacc);
+    if (m_debugLevel > 2) {cerr << "mean inheritance distance = " << distacc / (hs - 1) << endl;}
+    for (auto i = size_t{0}; i < n; ++i) {
+        const auto c = channels[i];
+        auto &cd = *m_channelData[c];
+        if (cd.silent) {
+            // As modifyChunk, which leaves the history as a phase
+            // reset on an empty spectrum would
+            for (auto b = size_t{0}; b < hs; ++b) {
+                joint.prevPhase[b * stride + c] = 0.0f;
+                joint.prevError[b * stride + c] = 0.0f;
+                joint.unwrappedPhase[b * stride + c] = 0.0f;
             }
+            cd.unchanged = true;
+            continue;
         }
-        auto p = cd.phase[i];
-        auto perr = 0.0f;
-        auto outphase = p;
-        auto mi = maxdist;
-        if (i <= limit0) mi = 0.0f;
-        else if (i <= limit1) mi = 1.0f;
-        else if (i <= limit2) mi = 3.0f;
-        if (!resetThis) {
-            auto omega = (static_cast<float>(2 * M_PI) * m_increment * i) / (m_fftSize);
-            auto pp = cd.prevPhase[i];
-            auto ep = pp + omega;
-            perr = princarg(p - ep);
-            auto instability = fabs(perr - cd.prevError[i]);
-            auto direction = (perr > cd.prevError[i]);
-            auto inherit = false;
-            if (laminar) {
-                if (distance >= mi || i == count) {inherit = false;}
-                else if (bandlimited && (i == bandhigh || i == bandlow)) {inherit = false;}
-                else if (instability > prevInstability &&direction == prevDirection) {inherit = true;}
+        float *const  phase = cd.phase;
+        for (auto b = size_t{0}; b < hs; ++b) phase[b] = joint.phase[b * stride + c];
+        cd.unchanged = fullReset || (cd.unchanged && outputIncrement == m_increment);
+    }
+}
+void
+RubbersStretcher::Impl::formantShiftChunk(ChannelData &cd, float *mag, float *dblbuf, FFT &fft){
+    Profiler profiler("RubbersStretcher::Impl::formantShiftChunk");
+    float *const  envelope = cd.envelope;
+    const auto  sz = m_fftSize;
+    const auto  hs = sz / 2;
+    // With OptionFormantReused, the last envelope stands for as long
+    // as the spectrum stays within a tenth (in summed magnitude) of
+    // the one it was estimated from
+    auto reuse = false;
+    if ((m_options & OptionFormantReused) && cd.envelopeSize == sz) {
+        const float *const  prev = cd.envelopeMag;
+        auto change = 0.0f, total = 0.0f;
+        for (auto i = decltype(hs){0}; i <= hs; ++i) {
+            change += fabsf(mag[i] - prev[i]);
+            total += prev[i];
+        }
+        reuse = (change < total * 0.1f);
+    }
+    if (!reuse) {
+        // The short lpcFft is only of use with a longer main FFT
+        if ((m_options & OptionFormantLPC) && cd.lpcFftSize <= sz) lpcEnvelope(cd, mag, dblbuf, fft);
+        else cepstralEnvelope(cd, mag, dblbuf, fft);
+        if (m_options & OptionFormantReused) {
+            v_copy(cd.envelopeMag, mag, hs + 1);
+            cd.envelopeSize = sz;
+        } else {
+            cd.envelopeSize = 0;
+        }
+    }
+    // The shifted envelope is gathered from the unshifted one through
+    // a table of source bins, rebuilt when the pitch scale changes.
+    // Bins shifted down from beyond Nyquist read the zero at hs + 1.
+    int *const  warp = cd.envelopeWarp;
+    if (cd.envelopeWarpScale != m_pitchScale || cd.envelopeWarpSize != sz) {
+        if (m_pitchScale > 1.0) {
+            for (auto target = decltype(hs){0}; target <= hs; ++target) {
+                auto source = static_cast<decltype(hs)>(lrint(target * m_pitchScale));
+                warp[target] = int(source > hs ? hs + 1 : source);
             }
-            auto advance = outputIncrement * ((omega + perr) / m_increment);
-            if (inherit) {
-                auto inherited = cd.unwrappedPhase[i + lookback] - cd.prevPhase[i + lookback];
-                advance = ((advance * distance) + (inherited * (maxdist - distance))) / maxdist;
-                outphase = p + advance;
-                distacc += distance;
-                distance += 1;
-            } else {
-                outphase = cd.unwrappedPhase[i] + advance;
-                distance = 0;
+        } else {
+            for (auto target = decltype(hs){0}; target < hs; ++target) {
+                warp[target] = int(lrint(target * m_pitchScale));
             }
-            prevInstability = instability;
-            prevDirection = direction;
-        } else {distance = 0.0;}
-        cd.prevError[i] = perr;
-        cd.prevPhase[i] = p;
-        cd.phase[i] = outphase;
-        cd.unwrappedPhase[i] = outphase;
+            warp[hs] = int(hs);
+        }
+        cd.envelopeWarpScale = m_pitchScale;
+        cd.envelopeWarpSize = sz;
     }
-    if (m_debugLevel > 2) {cerr << "mean inheritance distance = " << distacc / count << endl;}
-    if (fullReset) unchanged = true;
-    cd.unchanged = unchanged;
-    if (unchanged && m_debugLevel > 1) {cerr << "frame unchanged on channel " << channel << endl;}
-}    
+    envelope[hs + 1] = 0.0f;
+    v_divide(mag, envelope, hs + 1);
+    v_multiply_gather(mag, envelope, warp, hs + 1);
+}
 void
-RubbersStretcher::Impl::formantShiftChunk(size_t channel){
-    Profiler profiler("RubbersStretcher::Impl::formantShiftChunk");
-    auto &cd = *m_channelData[channel];
-    float *const  mag = cd.mag;
+RubbersStretcher::Impl::cepstralEnvelope(ChannelData &cd, const float *mag, float *dblbuf, FFT &fft){
+    // The envelope as the exponential of the low quefrencies of the
+    // log spectrum
     float *const  envelope = cd.envelope;
-    float *const  dblbuf = cd.dblbuf;
     const auto  sz = m_fftSize;
     const auto  hs = sz / 2;
     const auto  factor = 1.0f / sz;
-    cd.fft->inverseCepstral(mag, dblbuf);
+    fft.inverseCepstral(mag, dblbuf);
     const auto cutoff = static_cast<decltype(sz)>(m_sampleRate / 700);
 //    cerr <<"cutoff = "<< cutoff << ", m_sampleRate/cutoff = " << m_sampleRate/cutoff << endl;
     dblbuf[0] /= 2;
     dblbuf[cutoff-1] /= 2;
     std::fill(&dblbuf[cutoff],&dblbuf[sz],0.);
     v_scale(dblbuf, factor, cutoff);
-    auto spare = (float *)alloca((hs + 1) * sizeof(float));
-    cd.fft->forward(dblbuf, envelope, spare);
+    fft.forward(dblbuf, envelope, cd.spare);
     v_exp(envelope, hs + 1);
-    v_divide(mag, envelope, hs + 1);
-    if (m_pitchScale > 1.0) {
-        // scaling up, we want a new envelope that is lower by the pitch factor
-        for (auto target = decltype(hs){0}; target <= hs; ++target) {
-            auto source = static_cast<decltype(hs)>(lrint(target * m_pitchScale));
-            if (source > hs) {envelope[target] = 0.0;}
-            else {envelope[target] = envelope[source];}
-        }
-    } else {
-        // scaling down, we want a new envelope that is higher by the pitch factor
-        for (auto target = hs; target > 0; ) {
-            --target;
-            auto source = lrint(target * m_pitchScale);
-            envelope[target] = envelope[source];
+}
+void
+RubbersStretcher::Impl::lpcEnvelope(ChannelData &cd, const float *mag, float *dblbuf, FFT &fft){
+    // The envelope as the response of an all-pole predictor fitted to
+    // the autocorrelation, which is the inverse transform of the
+    // power spectrum.  That response is smooth at the scale of a few
+    // bins per pole, so it is evaluated with the short lpcFft and
+    // interpolated, in place of a second full-size FFT and the
+    // log and exp of the cepstral method.
+    float *const  envelope = cd.envelope;
+    float *const  spare = cd.spare;
+    const auto  sz = m_fftSize;
+    const auto  hs = sz / 2;
+    const auto  order = lpcOrder();
+    const auto  lsz = cd.lpcFftSize;
+    const auto  lhs = lsz / 2;
+    v_copy(envelope, mag, hs + 1);
+    v_square(envelope, hs + 1);
+    v_zero(spare, hs + 1);
+    fft.inverse(envelope, spare, dblbuf);
+    if (!(dblbuf[0] > 0.f)) {
+        v_set(envelope, 1.0f, hs + 1);
+        return;
+    }
+    // Levinson-Durbin, with a -40dB floor of white noise added to
+    // keep the predictor well-conditioned
+    auto a = static_cast<double*>(alloca((order + 1) * sizeof(double)));
+    auto err = dblbuf[0] * 1.0001;
+    a[0] = 1.0;
+    for (auto i = size_t{1}; i <= order; ++i) {
+        auto acc = double(dblbuf[i]);
+        for (auto j = size_t{1}; j < i; ++j) acc += a[j] * dblbuf[i - j];
+        const auto k = -acc / err;
+        for (auto j = size_t{1}; j <= i / 2; ++j) {
+            const auto lo = a[j], hi = a[i - j];
+            a[j] = lo + k * hi;
+            a[i - j] = hi + k * lo;
         }
+        a[i] = k;
+        err *= 1.0 - k * k;
     }
-    v_multiply(mag, envelope, hs+1);
-    cd.unchanged = false;
+    for (auto i = size_t{0}; i <= order; ++i) dblbuf[i] = float(a[i]);
+    v_zero(dblbuf + order + 1, lsz - order - 1);
+    cd.lpcFft->forwardMagnitude(dblbuf, spare);
+    for (auto i = size_t{0}; i <= lhs; ++i) spare[i] = 1.0f / spare[i];
+    // Both sizes are powers of two, so each short bin spans a whole
+    // number of full-size ones
+    const auto span = sz / lsz;
+    const auto step = 1.0f / span;
+    for (auto i = size_t{0}; i < lhs; ++i) {
+        const auto base = spare[i], slope = (spare[i + 1] - base) * step;
+        float *const  e = envelope + i * span;
+        for (auto j = size_t{0}; j < span; ++j) e[j] = base + slope * j;
+    }
+    envelope[hs] = spare[lhs];
+}
+void
+RubbersStretcher::Impl::synthesiseChunk(ChannelData &cd,size_t shiftIncrement){
+    if (cd.silent) {
+        accumulateChunk(cd, nullptr, nullptr, false, shiftIncrement);
+        return;
+    }
+    if (formantShifting()) cd.unchanged = false;
+    synthesiseChunk(cd, cd.mag, cd.phase, cd.fltbuf, cd.dblbuf, *cd.fft, cd.unchanged, shiftIncrement);
 }
-
 void
-RubbersStretcher::Impl::synthesiseChunk(size_t channel,size_t shiftIncrement){
+RubbersStretcher::Impl::synthesiseChunk(ChannelData &cd, float *mag, float *phase,
+                                        float *fltbuf, float *dblbuf, FFT &fft,
+                                        bool unchanged, size_t shiftIncrement){
     Profiler profiler("RubbersStretcher::Impl::synthesiseChunk");
-    if ((m_options & OptionFormantPreserved) &&
-        (m_pitchScale != 1.0)) {
-        formantShiftChunk(channel);
+    // fltbuf holds the windowed input frame, which is used as it is
+    // if the frame is unchanged
+    if (formantShifting()) {
+        formantShiftChunk(cd, mag, dblbuf, fft);
+        unchanged = false;
     }
-    auto &cd = *m_channelData[channel];
-    float *const  dblbuf = cd.dblbuf;
-    float *const  fltbuf = cd.fltbuf;
+    // Our FFTs produced unscaled results.  The 1/fsz scale is folded
+    // into the window by accumulateChunk rather than applied to mag
+    if (!unchanged) fft.inversePolar(mag, phase, dblbuf);
+    accumulateChunk(cd, fltbuf, dblbuf, unchanged, shiftIncrement);
+}
+void
+RubbersStretcher::Impl::synthesiseChunks(const size_t *channels, size_t n, size_t shiftIncrement){
+    // As synthesiseChunk for each of the given channels, with the
+    // inverse FFTs of those that changed done as one batch by the
+    // first channel's FFT
+    if (n < 2) {
+        for (auto i = size_t{0}; i < n; ++i) synthesiseChunk(*m_channelData[channels[i]], shiftIncrement);
+        return;
+    }
+    Profiler profiler("RubbersStretcher::Impl::synthesiseChunks");
+    auto mags = static_cast<const float**>(alloca(2 * n * sizeof(float*)));
+    auto phases = mags + n;
+    auto frames = static_cast<float**>(alloca(n * sizeof(float*)));
+    auto k = prepareSynthesis(channels, n, mags, phases, frames);
+    m_channelData[0]->fft->inversePolarBatch(int(k), mags, phases, frames);
+    accumulateChunks(channels, n, shiftIncrement);
+}
+size_t
+RubbersStretcher::Impl::prepareSynthesis(const size_t *channels, size_t n,
+                                         const float **mags, const float **phases, float **frames){
+    // The part of synthesiseChunks before the FFTs, likewise
+    auto k = size_t{0};
+    for (auto i = size_t{0}; i < n; ++i) {
+        auto &cd = *m_channelData[channels[i]];
+        if (cd.silent) continue;
+        if (formantShifting()) {
+            formantShiftChunk(cd, cd.mag, cd.dblbuf, *cd.fft);
+            cd.unchanged = false;
+        }
+        if (cd.unchanged) continue;
+        mags[k] = cd.mag;
+        phases[k] = cd.phase;
+        frames[k] = cd.dblbuf;
+        ++k;
+    }
+    return k;
+}
+void
+RubbersStretcher::Impl::accumulateChunks(const size_t *channels, size_t n, size_t shiftIncrement){
+    // The part of synthesiseChunks after the FFTs
+    for (auto i = size_t{0}; i < n; ++i) {
+        auto &cd = *m_channelData[channels[i]];
+        if (cd.silent) accumulateChunk(cd, nullptr, nullptr, false, shiftIncrement);
+        else accumulateChunk(cd, cd.fltbuf, cd.dblbuf, cd.unchanged, shiftIncrement);
+    }
+}
+void
+RubbersStretcher::Impl::accumulateChunk(ChannelData &cd, const float *fltbuf, const float *dblbuf,
+                                        bool unchanged, size_t shiftIncrement){
+    // Add a synthesised frame (dblbuf, or the windowed input frame in
+    // fltbuf if the frame is unchanged) into the accumulators.  With
+    // neither, for a silent chunk, only the window weights are added.
+    // Around a bypass, the synthesised frame is mixed with the input
+    // frame by m_bypassGain.
     float *const  accumulator = cd.accumulator;
     float *const  windowAccumulator = cd.windowAccumulator;
     const auto fsz = m_fftSize;
-    const auto hs = fsz / 2;
     const auto wsz = m_sWindowSize;
-    if (!cd.unchanged) {
-        // Our FFTs produced unscaled results. Scale before inverse
-        // transform rather than after, to avoid overflow if using a
-        // fixed-point FFT.
-        auto factor = 1.f / fsz;
-        v_scale(cd.mag, factor, hs + 1);
-        cd.fft->inversePolar(cd.mag, cd.phase, cd.dblbuf);
-        if (wsz == fsz) {v_convert(fltbuf, dblbuf + hs, hs);v_convert(fltbuf + hs, dblbuf, hs);
-        } else {
-            v_zero(fltbuf, wsz);
-            auto j = (fsz - wsz/2);
-            while (j < 0) j += fsz;
-            for (auto i = decltype(wsz){0}; i < wsz; ++i) {
-                fltbuf[i] += dblbuf[j];
-                if (++j == fsz) j = 0;
-            }
-        }
-    }
+    // The synthesis window is applied as the frame is added into the
+    // accumulator.  When smoothing, cd.interpolator caches the sinc
+    // interpolator already multiplied by the synthesis window, which
+    // is also exactly what the window accumulator needs.
+    const float *window = m_swindow->getValues();
+    const float *scaledWindow = m_sWindowScaled.data();
+    const float *weights = m_sWindowWeights.data();
+    auto scale = 1.f;
     if (wsz > fsz) {
         auto p = shiftIncrement * 2;
         if (cd.interpolatorScale != p) {
             SincWindow<float>::write(cd.interpolator, wsz, p);
+            m_swindow->cut(cd.interpolator);
             cd.interpolatorScale = p;
         }
-        v_multiply(fltbuf, cd.interpolator, wsz);
+        window = scaledWindow = weights = cd.interpolator;
+        scale = 1.f / fsz;
+    }
+    const auto mix = m_bypassGain;
+    if (!unchanged && dblbuf) {
+        v_unfold_window_and_add(accumulator, wsz, dblbuf, fsz, scaledWindow, scale * (1.f - mix));
+        if (mix > 0.f && fltbuf) v_multiply_and_add_with_gain(accumulator, fltbuf, window, mix, wsz);
+    } else if (unchanged && fltbuf) {
+        v_multiply_and_add_with_gain(accumulator, fltbuf, window, 1.f, wsz);
     }
-    m_swindow->cut(fltbuf);
-    v_add(accumulator, fltbuf, wsz);
     cd.accumulatorFill = wsz;
-    if (wsz > fsz) {
-        // reuse fltbuf to calculate interpolating window shape for
-        // window accumulator
-        v_copy(fltbuf, cd.interpolator, wsz);
-        m_swindow->cut(fltbuf);
-        v_add(windowAccumulator, fltbuf, wsz);
-    } else {m_swindow->add(windowAccumulator, m_awindow->getArea() * 1.5f);}
+    v_add(windowAccumulator, weights, wsz);
 }
 
 void
-RubbersStretcher::Impl::writeChunk(size_t channel, size_t shiftIncrement, bool last){
+RubbersStretcher::Impl::writeChunk(size_t channel, size_t shiftIncrement, bool last, bool draining){
     Profiler profiler("RubbersStretcher::Impl::writeChunk");
     auto &cd = *m_channelData[channel];
     float *const  accumulator = cd.accumulator;
     float *const  windowAccumulator = cd.windowAccumulator;
-    const auto sz = m_sWindowSize;
     const auto si = shiftIncrement;
     if (m_debugLevel > 2) {cerr << "writeChunk(" << channel << ", " << shiftIncrement << ", " << last << ")" << endl;}
     v_divide(accumulator, windowAccumulator, si);
@@ -652,11 +1446,17 @@ RubbersStretcher::Impl::writeChunk(size_t channel, size_t shiftIncrement, bool l
     // were running in RT mode)
     auto theoreticalOut = size_t{0};
     if (cd.inputSize >= 0) {theoreticalOut = lrint(cd.inputSize * m_timeRatio);}
+    // The output is resampled when the pitch shift is resampled after
+    // stretching, and when band-limited, to return to the caller's
+    // rate.  scale is the number of accumulator samples per sample
+    // written to the outbuf.
     auto resampledAlready = resampleBeforeStretching();
-    if (!resampledAlready &&
-        (m_pitchScale != 1.0 || m_options & OptionPitchHighConsistency) &&
+    auto scale = (resampledAlready ? 1.0 : m_pitchScale) * m_bandRatio;
+    if (((!resampledAlready &&
+          (m_pitchScale != 1.0 || m_options & OptionPitchHighConsistency)) ||
+         m_bandRatio < 1.0) &&
         cd.resampler) {
-        auto reqSize = static_cast<size_t>(ceil(si / m_pitchScale));
+        auto reqSize = static_cast<size_t>(ceil(si / scale));
         if (reqSize > cd.resamplebufSize) {
             // This shouldn't normally happen -- the buffer is
             // supposed to be initialised with enough space in the
@@ -666,23 +1466,25 @@ RubbersStretcher::Impl::writeChunk(size_t channel, size_t shiftIncrement, bool l
             cerr << "WARNING: RubbersStretcher::Impl::writeChunk: resizing resampler buffer from "<< cd.resamplebufSize << " to " << reqSize << endl;
             cd.setResampleBufSize(reqSize);
         }
-        auto outframes = cd.resampler->resample(&cd.accumulator,&cd.resamplebuf,si,1.0 / m_pitchScale,last);
+        auto outframes = cd.resampler->resample(&cd.accumulator,&cd.resamplebuf,si,1.0 / scale,last);
         writeOutput(*cd.outbuf, cd.resamplebuf,outframes, cd.outCount, theoreticalOut);
     } else {writeOutput(*cd.outbuf, accumulator,si, cd.outCount, theoreticalOut);}
-    v_move(accumulator, accumulator + si, sz - si);
-    v_zero(accumulator + sz - si, si);
-    v_move(windowAccumulator, windowAccumulator + si, sz - si);
-    v_zero(windowAccumulator + sz - si, si);
-    if (cd.accumulatorFill > si) {cd.accumulatorFill -= si;}
-    else {
-        cd.accumulatorFill = 0;
-        if (cd.draining) {
-            if (m_debugLevel > 1) {cerr << "RubbersStretcher::Impl::processChunks: setting outputComplete to true" << endl;}
-            cd.outputComplete = true;
-        }
+    shiftAccumulators(cd, si);
+    if (cd.accumulatorFill == 0 && draining) {
+        if (m_debugLevel > 1) {cerr << "RubbersStretcher::Impl::processChunks: setting outputComplete to true" << endl;}
+        cd.outputComplete = true;
     }
 }
 void
+RubbersStretcher::Impl::shiftAccumulators(ChannelData &cd, size_t shiftIncrement){
+    // Discard the shiftIncrement samples just written from the front
+    // of the overlap-add accumulators
+    const auto si = shiftIncrement;
+    cd.advanceAccumulators(si, m_sWindowSize);
+    if (cd.accumulatorFill > si) {cd.accumulatorFill -= si;}
+    else {cd.accumulatorFill = 0;}
+}
+void
 RubbersStretcher::Impl::writeOutput(RingBuffer<float> &to, float *from, size_t qty, size_t &outCount, size_t theoreticalOut){
     Profiler profiler("RubbersStretcher::Impl::writeOutput");
     // In non-RT mode, we don't want to write the first startSkip
@@ -690,7 +1492,7 @@ RubbersStretcher::Impl::writeOutput(RingBuffer<float> &to, float *from, size_t q
     // output.  In RT mode we didn't apply any pre-padding in
     // configure(), so we don't want to remove any here.
     auto  startSkip = size_t{0};
-    if (!m_realtime) {startSkip = lrintf((m_sWindowSize/2) / m_pitchScale);}
+    if (!m_realtime) {startSkip = lrintf((m_sWindowSize/2) / (m_pitchScale * m_bandRatio));}
     if (outCount > startSkip) {
         // this is the normal case
         if (theoreticalOut > 0) {
@@ -742,6 +1544,7 @@ RubbersStretcher::Impl::writeOutput(RingBuffer<float> &to, float *from, size_t q
 ssize_t
 RubbersStretcher::Impl::available() const{
     Profiler profiler("RubbersStretcher::Impl::available");
+    RTAudit::Section audit(m_audit);
 /*        for (size_t c = 0; c < m_channels; ++c) {
             if (m_channelData[c]->inputSize >= 0) {
 //                cerr << "available: m_done true" << endl;
@@ -765,13 +1568,24 @@ RubbersStretcher::Impl::available() const{
         if (m_channelData[i]->resampler) haveResamplers = true;
     }
     if (min == 0 && consumed) return -1;
-    if (m_pitchScale == 1.0) return min;
     if (haveResamplers) return min; // resampling has already happened
+    if (m_pitchScale == 1.0) return min;
     return ssize_t(floor(min / m_pitchScale));
 }
+ssize_t
+RubbersStretcher::Impl::available(size_t ratioIndex) const{
+    auto impl = forRatio(ratioIndex);
+    return impl ? impl->available() : 0;
+}
+size_t
+RubbersStretcher::Impl::retrieve(float *const *output, size_t samples, size_t ratioIndex) const{
+    auto impl = forRatio(ratioIndex);
+    return impl ? impl->retrieve(output, samples) : 0;
+}
 size_t
 RubbersStretcher::Impl::retrieve(float *const *output, size_t samples) const{
     Profiler profiler("RubbersStretcher::Impl::retrieve");
+    RTAudit::Section audit(m_audit);
     auto got = samples;
     for (auto c = size_t{0}; c < m_channels; ++c) {
         auto gotHere = static_cast<size_t>(m_channelData[c]->outbuf->read(output[c], got));
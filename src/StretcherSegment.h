@@ -0,0 +1,68 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_STRETCHERSEGMENT_H_
+#define _RUBBERBAND_STRETCHERSEGMENT_H_
+
+#include "StretcherChannelData.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Rubbers
+{
+
+/**
+ * A run of consecutive chunks on one channel, beginning at a full
+ * phase reset, that can be rendered independently of the chunks
+ * before it.  See RubbersStretcher::Impl::processSegments.
+ *
+ * The segment is rendered on a ChannelData of its own, and its
+ * overlap-add output is kept raw (not yet divided through by the
+ * window accumulator) so that it can be summed with the tails of its
+ * neighbours when stitched back into the channel.
+ */
+class RubbersStretcher::Impl::Segment
+{
+public:
+    Segment(size_t startChunk, ChannelData *channelData) :
+        start(startChunk), end(startChunk), cd(channelData), done(false) { }
+    size_t start; // first chunk
+    size_t end;   // one past the last chunk, once gathered
+    std::unique_ptr<ChannelData> cd;
+    // Input samples for all chunks, starting with the first sample of
+    // the first chunk's analysis window
+    std::vector<float> input;
+    // Rendered output, as the shift increments written for each chunk
+    // (or each part of an overlong chunk) in turn, followed by the
+    // accumulators left in cd
+    std::vector<size_t> increments;
+    std::vector<float> accumulator;
+    std::vector<float> windowAccumulator;
+    std::atomic<bool> done;
+};
+
+}
+
+#endif
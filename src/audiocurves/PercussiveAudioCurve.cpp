@@ -33,15 +33,19 @@ namespace Rubbers
 
 
 PercussiveAudioCurve::PercussiveAudioCurve(Parameters parameters) :
-    AudioCurveCalculator(parameters)
-{m_prevMag = std::make_unique<float[]>(m_fftSize/2+1);}
+    AudioCurveCalculator(parameters),
+    m_prevMagSize(m_fftSize/2 + 1)
+{m_prevMag = std::make_unique<float[]>(m_prevMagSize);}
 PercussiveAudioCurve::~PercussiveAudioCurve(){}
 
 void
 PercussiveAudioCurve::reset(){v_zero(&m_prevMag[0], m_fftSize/2 + 1);}
 void
 PercussiveAudioCurve::setFftSize(int newSize){
-    m_prevMag = std::make_unique<float[]>(newSize/2 + 1);
+    if (newSize/2 + 1 > m_prevMagSize) {
+        m_prevMagSize = newSize/2 + 1;
+        m_prevMag = std::make_unique<float[]>(m_prevMagSize);
+    }
     AudioCurveCalculator::setFftSize(newSize);
     reset();
 }
@@ -40,6 +40,7 @@ public:
     virtual const char *getUnit() const { return "bin/total"; }
 protected:
     std::unique_ptr<float[]> m_prevMag;
+    int m_prevMagSize; // allocated; kept if the FFT size is reduced
 };
 
 }
@@ -60,6 +60,12 @@ public:
      */
     typedef size_t size_type;
     RingBuffer(size_type  n);
+    /**
+     * Create a ring buffer with room to write n samples, as above,
+     * whose storage is allocated large enough for it to grow() to
+     * hold up to "reserved" samples without reallocation.
+     */
+    RingBuffer(size_type n, size_type reserved);
     virtual ~RingBuffer() = default;
     /**
      * Return the total capacity of the ring buffer in samples.
@@ -75,6 +81,15 @@ public:
      * size, the contents are undefined.
      */
     virtual RingBuffer<T> *resized(size_type newSize) const;
+    /**
+     * Enlarge this ring buffer in place to hold at least newSize
+     * samples, keeping its data, if the storage reserved on
+     * construction allows it.  Returns false, leaving the buffer
+     * unchanged, if it does not.  Unlike resized(), this does not
+     * allocate; like it, the results are undefined if another
+     * thread reads or writes during the call.
+     */
+    bool grow(size_type newSize);
     /**
      * Reset read and write pointers, thus emptying the buffer.
      * Should be called from the write thread.
@@ -160,7 +175,8 @@ public:
     RingBuffer &operator=(const RingBuffer &) = delete;
     RingBuffer &operator=(RingBuffer &&) = default;
 protected:
-    const size_type m_size;
+    size_type m_size;
+    size_type m_reserved;
     std::unique_ptr<T[]>       m_buffer { nullptr };
     std::atomic<size_type>    m_writer { 0 };
     std::atomic<size_type>    m_reader { 0 };
@@ -174,9 +190,17 @@ protected:
 template <typename T>
 RingBuffer<T>::RingBuffer(typename RingBuffer<T>::size_type n) :
     m_size(roundup(n)),
+    m_reserved(m_size),
     m_buffer(std::make_unique<T[]>(m_size))
 {}
 template <typename T>
+RingBuffer<T>::RingBuffer(typename RingBuffer<T>::size_type n,
+                          typename RingBuffer<T>::size_type reserved) :
+    m_size(roundup(n)),
+    m_reserved(std::max(m_size, roundup(reserved))),
+    m_buffer(std::make_unique<T[]>(m_reserved))
+{}
+template <typename T>
 typename RingBuffer<T>::size_type
 RingBuffer<T>::size() const{return m_size;}
 template <typename T>
@@ -189,11 +213,27 @@ RingBuffer<T>::resized(typename RingBuffer<T>::size_type newSize) const{
     while (r != w) {
         auto value = m_buffer[r%m_size];
         newBuffer->write(&value, 1);
-        if (++r == m_size) r = 0;
+        ++r;
     }
     return newBuffer;
 }
 template <typename T>
+bool
+RingBuffer<T>::grow(typename RingBuffer<T>::size_type newSize){
+    newSize = roundup(newSize);
+    if (newSize <= m_size) return true;
+    if (newSize > m_reserved) return false;
+    // Rotate the data to the start of the storage, where it is
+    // contiguous whatever the new size
+    auto w = m_writer.load();
+    auto r = m_reader.load();
+    std::rotate(&m_buffer[0], &m_buffer[r % m_size], &m_buffer[m_size]);
+    m_size = newSize;
+    m_reader.store(0);
+    m_writer.store(w - r);
+    return true;
+}
+template <typename T>
 void
 RingBuffer<T>::reset(){ m_reader.store(m_writer.load()); }
 template <typename T>
@@ -280,7 +320,7 @@ RingBuffer<T>::peek(T *const destination,typename RingBuffer<T>::size_type n) co
     if (n > available) {
 	std::cerr << "WARNING: RingBuffer::peek: " << n << " requested, only "
                   << available << " available\n";
-        std::fill_n ( &destination[available], (n - available ),T{0});
+        std::fill_n ( &destination[available], (n - available ),T{});
 	n = available;
     }
     if (n == 0) return n;
@@ -361,10 +401,10 @@ RingBuffer<T>::zero(typename RingBuffer<T>::size_type  n){
     auto off = w %m_size;
     auto here = m_size - off;
     auto bufbase = &m_buffer[off];
-    if (here >= n) {std::fill_n(bufbase, n, T{0});}
+    if (here >= n) {std::fill_n(bufbase, n, T{});}
     else {
-        std::fill_n ( bufbase, here, T{0});
-        std::fill_n ( &m_buffer[0], n - here, T{0});
+        std::fill_n ( bufbase, here, T{});
+        std::fill_n ( &m_buffer[0], n - here, T{});
     }
     m_writer += n;
     return n;
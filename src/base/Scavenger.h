@@ -76,7 +76,7 @@ protected:
     typedef std::list<T *> ObjectList;
     ObjectList m_excess;
     int m_lastExcess;
-    std::mutex m_excessMutex;
+    Mutex m_excessMutex;
     void pushExcess(T *);
     void clearExcess(int);
     unsigned int m_claimed;
@@ -126,7 +126,7 @@ Scavenger<T>::~Scavenger(){
             if ( pair.first ) 
             {
                 auto ot = std::exchange ( pair.first, nullptr );
-                delete[] ot;
+                delete ot;
                 ++ m_scavenged;
             }
         }
@@ -176,7 +176,7 @@ Scavenger<T>::scavenge(bool clearNow){
 template <typename T>
 void
 Scavenger<T>::pushExcess(T *t){
-    std::unique_lock<std::mutex> lock(m_excessMutex);
+    std::unique_lock<Mutex> lock(m_excessMutex);
     m_excess.push_back(t);
     auto sec = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
     m_lastExcess = sec;
@@ -187,7 +187,7 @@ Scavenger<T>::clearExcess(int sec){
 #ifdef DEBUG_SCAVENGER
     std::cerr << "Scavenger::clearExcess: Excess now " << m_excess.size() << std::endl;
 #endif
-    std::unique_lock<std::mutex> lock(m_excessMutex);
+    std::unique_lock<Mutex> lock(m_excessMutex);
     for ( auto it : m_excess )
     {
         delete it;
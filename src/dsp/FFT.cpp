@@ -27,6 +27,7 @@
 #include "system/Allocators.h"
 #include "system/VectorOps.h"
 #include "system/VectorOpsComplex.h"
+#include "system/SharedCache.h"
 
 //#define FFT_MEASUREMENT 1
 
@@ -81,6 +82,9 @@ extern "C" {
 #include <cstdio>
 #include <cstdlib>
 #include <vector>
+#include <tuple>
+#include <chrono>
+#include <algorithm>
 #include <xmmintrin.h>
 #include <immintrin.h>
 
@@ -96,8 +100,13 @@ namespace Rubbers {
 class FFTImpl
 {
 public:
+    FFTImpl() : m_polar(&vector_kernels()) { }
     virtual ~FFTImpl() { }
 
+    void setPolarAccuracy(VectorAccuracy accuracy) {
+        m_polar = &vector_kernels(accuracy);
+    }
+
     virtual FFT::Precisions getSupportedPrecisions() const = 0;
 
     virtual void initFloat() = 0;
@@ -122,6 +131,42 @@ public:
     virtual void inverseInterleaved(const float * complexIn, float * realOut) = 0;
     virtual void inversePolar(const float * magIn, const float * phaseIn, float * realOut) = 0;
     virtual void inverseCepstral(const float * magIn, float * cepOut) = 0;
+
+    // Batched transforms.  These defaults transform one frame at a
+    // time; an implementation that can do several frames in one go
+    // overrides the float ones, and initFloatBatch to prepare them.
+    virtual void initFloatBatch(int) { initFloat(); }
+
+    virtual void forwardInterleavedBatch(int count, const double *const *realIn, double *const *complexOut) {
+        for (int k = 0; k < count; ++k) forwardInterleaved(realIn[k], complexOut[k]);
+    }
+    virtual void forwardPolarBatch(int count, const double *const *realIn, double *const *magOut, double *const *phaseOut) {
+        for (int k = 0; k < count; ++k) forwardPolar(realIn[k], magOut[k], phaseOut[k]);
+    }
+    virtual void inverseInterleavedBatch(int count, const double *const *complexIn, double *const *realOut) {
+        for (int k = 0; k < count; ++k) inverseInterleaved(complexIn[k], realOut[k]);
+    }
+    virtual void inversePolarBatch(int count, const double *const *magIn, const double *const *phaseIn, double *const *realOut) {
+        for (int k = 0; k < count; ++k) inversePolar(magIn[k], phaseIn[k], realOut[k]);
+    }
+
+    virtual void forwardInterleavedBatch(int count, const float *const *realIn, float *const *complexOut) {
+        for (int k = 0; k < count; ++k) forwardInterleaved(realIn[k], complexOut[k]);
+    }
+    virtual void forwardPolarBatch(int count, const float *const *realIn, float *const *magOut, float *const *phaseOut) {
+        for (int k = 0; k < count; ++k) forwardPolar(realIn[k], magOut[k], phaseOut[k]);
+    }
+    virtual void inverseInterleavedBatch(int count, const float *const *complexIn, float *const *realOut) {
+        for (int k = 0; k < count; ++k) inverseInterleaved(complexIn[k], realOut[k]);
+    }
+    virtual void inversePolarBatch(int count, const float *const *magIn, const float *const *phaseIn, float *const *realOut) {
+        for (int k = 0; k < count; ++k) inversePolar(magIn[k], phaseIn[k], realOut[k]);
+    }
+
+protected:
+    // The float polar conversions, at the accuracy chosen for this
+    // instance
+    const VectorKernels *m_polar;
 };    
 
 namespace FFTs {
@@ -1248,7 +1293,7 @@ public:
     void forwardPolar(const double * realIn, double * magOut, double * phaseOut) {
         v_convert(m_time_buf,realIn,m_size);
         ffts_execute(m_r2c,m_time_buf,m_freq_buf);
-        v_cartesian_interleaved_to_polar( m_time_buf + m_size/2+1, m_freq_buf, m_freq_buf, m_size/2+1);
+        m_polar->cartesianInterleavedToPolar(m_time_buf + m_size/2+1, m_freq_buf, m_freq_buf, m_size/2+1);
         v_convert(magOut,m_time_buf,m_size/2+1);
         v_convert(phaseOut,m_time_buf+m_size/2+1,m_size/2+1);
     }
@@ -1274,7 +1319,7 @@ public:
     }
     void forwardPolar(const float * realIn, float * magOut, float * phaseOut) {
         ffts_execute(m_r2c,realIn,m_freq_buf);
-        v_cartesian_interleaved_to_polar(magOut, phaseOut, m_freq_buf, m_size/2+1);
+        m_polar->cartesianInterleavedToPolar(magOut, phaseOut, m_freq_buf, m_size/2+1);
     }
     void forwardMagnitude(const float * realIn, float * magOut) {
         ffts_execute(m_r2c,realIn,m_freq_buf);
@@ -1301,7 +1346,7 @@ public:
              m_freq_buf[2*i+1] = phaseIn[i];
             m_freq_buf[2*i+0] = magIn[i];
         }
-        v_polar_interleaved_to_cartesian_inplace ( m_freq_buf, m_size/2+1);
+        m_polar->polarInterleavedToCartesianInplace(m_freq_buf, m_size/2+1);
         ffts_execute(m_c2r,m_freq_buf,m_time_buf);
         v_convert(realOut,m_time_buf,m_size);
     }
@@ -1326,7 +1371,7 @@ public:
         ffts_execute(m_c2r,complexIn,realOut);
     }
     void inversePolar(const float * magIn, const float * phaseIn, float * realOut) {
-        v_polar_to_cartesian_interleaved(m_freq_buf,magIn,phaseIn,m_size/2+1);
+        m_polar->polarToCartesianInterleaved(m_freq_buf,magIn,phaseIn,m_size/2+1);
         ffts_execute(m_c2r,m_freq_buf,realOut);
     }
     void inverseCepstral(const float * magIn, float * cepOut) {
@@ -1379,10 +1424,14 @@ private:
 #define fftwf_plan fftw_plan
 #define fftwf_plan_dft_r2c_1d fftw_plan_dft_r2c_1d
 #define fftwf_plan_dft_c2r_1d fftw_plan_dft_c2r_1d
+#define fftwf_plan_many_dft_r2c fftw_plan_many_dft_r2c
+#define fftwf_plan_many_dft_c2r fftw_plan_many_dft_c2r
 #define fftwf_destroy_plan fftw_destroy_plan
 #define fftwf_malloc fftw_malloc
 #define fftwf_free fftw_free
 #define fftwf_execute fftw_execute
+#define fftwf_execute_dft_r2c fftw_execute_dft_r2c
+#define fftwf_execute_dft_c2r fftw_execute_dft_c2r
 #define atan2f atan2
 #define sqrtf sqrt
 #define cosf cos
@@ -1401,6 +1450,8 @@ private:
 #define fftw_malloc fftwf_malloc
 #define fftw_free fftwf_free
 #define fftw_execute fftwf_execute
+#define fftw_execute_dft_r2c fftwf_execute_dft_r2c
+#define fftw_execute_dft_c2r fftwf_execute_dft_c2r
 #define atan2 atan2f
 #define sqrt sqrtf
 #define cos cosf
@@ -1411,7 +1462,9 @@ private:
 class D_FFTW : public FFTImpl{
 public:
     D_FFTW(int size) :
-        m_fplanf(0), m_dplanf(0), m_size(size)
+        m_fplanf(0), m_dplanf(0),
+        m_fbatch(0), m_fbatchPacked(0), m_fbatchCount(0),
+        m_size(size)
     {}
     ~D_FFTW() {
         if (m_fplanf) {
@@ -1423,13 +1476,16 @@ public:
 #ifndef FFTW_DOUBLE_ONLY
             if (save) saveWisdom('f');
 #endif
-            fftwf_destroy_plan(m_fplanf);
-            fftwf_destroy_plan(m_fplani);
             fftwf_free(m_fbuf);
             fftwf_free(m_fpacked);
+            if (m_fbatch) fftwf_free(m_fbatch);
+            if (m_fbatchPacked) fftwf_free(m_fbatchPacked);
 #ifndef NO_THREADING
             m_commonMutex.unlock();
 #endif
+            // may destroy the plans, which takes the common mutex
+            m_fplans.reset();
+            m_fbatchPlans.reset();
         }
         if (m_dplanf) {
 #ifndef NO_THREADING
@@ -1440,13 +1496,12 @@ public:
 #ifndef FFTW_SINGLE_ONLY
             if (save) saveWisdom('d');
 #endif
-            fftw_destroy_plan(m_dplanf);
-            fftw_destroy_plan(m_dplani);
             fftw_free(m_dbuf);
             fftw_free(m_dpacked);
 #ifndef NO_THREADING
             m_commonMutex.unlock();
 #endif
+            m_dplans.reset();
         }
     }
 
@@ -1478,10 +1533,9 @@ public:
         m_fbuf = (fft_float_type *)fftw_malloc(m_size * sizeof(fft_float_type));
         m_fpacked = (fftwf_complex *)fftw_malloc
             ((m_size/2 + 1) * sizeof(fftwf_complex));
-        m_fplanf = fftwf_plan_dft_r2c_1d
-            (m_size, m_fbuf, m_fpacked, FFTW_MEASURE);
-        m_fplani = fftwf_plan_dft_c2r_1d
-            (m_size, m_fpacked, m_fbuf, FFTW_MEASURE);
+        m_fplans = SharedCache<int, FloatPlans>::get(m_size, m_size);
+        m_fplanf = m_fplans->forward;
+        m_fplani = m_fplans->inverse;
 #ifndef NO_THREADING
         m_commonMutex.unlock();
 #endif
@@ -1502,13 +1556,35 @@ public:
         m_dbuf = (fft_double_type *)fftw_malloc(m_size * sizeof(fft_double_type));
         m_dpacked = (fftw_complex *)fftw_malloc
             ((m_size/2 + 1) * sizeof(fftw_complex));
-        m_dplanf = fftw_plan_dft_r2c_1d
-            (m_size, m_dbuf, m_dpacked, FFTW_MEASURE);
-        m_dplani = fftw_plan_dft_c2r_1d
-            (m_size, m_dpacked, m_dbuf, FFTW_MEASURE);
+        m_dplans = SharedCache<int, DoublePlans>::get(m_size, m_size);
+        m_dplanf = m_dplans->forward;
+        m_dplani = m_dplans->inverse;
+#ifndef NO_THREADING
+        m_commonMutex.unlock();
+#endif
+    }
+
+    void initFloatBatch(int count) {
+        initFloat();
+        if (count < 2 || count <= m_fbatchCount) return;
+#ifndef NO_THREADING
+        m_commonMutex.lock();
+#endif
+        if (m_fbatch) fftwf_free(m_fbatch);
+        if (m_fbatchPacked) fftwf_free(m_fbatchPacked);
+        m_fbatch = (fft_float_type *)fftw_malloc
+            (count * m_size * sizeof(fft_float_type));
+        m_fbatchPacked = (fftwf_complex *)fftw_malloc
+            (count * (m_size/2 + 1) * sizeof(fftwf_complex));
+        std::shared_ptr<const FloatBatchPlans> previous = m_fbatchPlans;
+        m_fbatchPlans = SharedCache<std::pair<int, int>, FloatBatchPlans>::get
+            (std::make_pair(m_size, count), m_size, count);
+        m_fbatchCount = count;
 #ifndef NO_THREADING
         m_commonMutex.unlock();
 #endif
+        // may destroy the old plans, which takes the common mutex
+        previous.reset();
     }
 
     void loadWisdom(char type) { wisdom(false, type); }
@@ -1633,7 +1709,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 dbuf[i] = realIn[i];
             }
-        fftw_execute(m_dplanf);
+        fftw_execute_dft_r2c(m_dplanf, m_dbuf, m_dpacked);
         unpackDouble(realOut, imagOut);
     }
 
@@ -1647,7 +1723,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 dbuf[i] = realIn[i];
             }
-        fftw_execute(m_dplanf);
+        fftw_execute_dft_r2c(m_dplanf, m_dbuf, m_dpacked);
         v_convert(complexOut, (fft_double_type *)m_dpacked, sz + 2);
     }
 
@@ -1661,7 +1737,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 dbuf[i] = realIn[i];
             }
-        fftw_execute(m_dplanf);
+        fftw_execute_dft_r2c(m_dplanf, m_dbuf, m_dpacked);
         v_cartesian_interleaved_to_polar(magOut, phaseOut,
                                          (double *)m_dpacked, m_size/2+1);
     }
@@ -1676,7 +1752,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 dbuf[i] = realIn[i];
             }
-        fftw_execute(m_dplanf);
+        fftw_execute_dft_r2c(m_dplanf, m_dbuf, m_dpacked);
         const int hs = m_size/2;
         for (int i = 0; i <= hs; ++i) {
             magOut[i] = sqrt(m_dpacked[i][0] * m_dpacked[i][0] +
@@ -1694,7 +1770,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 fbuf[i] = realIn[i];
             }
-        fftwf_execute(m_fplanf);
+        fftwf_execute_dft_r2c(m_fplanf, m_fbuf, m_fpacked);
         unpackFloat(realOut, imagOut);
     }
 
@@ -1708,7 +1784,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 fbuf[i] = realIn[i];
             }
-        fftwf_execute(m_fplanf);
+        fftwf_execute_dft_r2c(m_fplanf, m_fbuf, m_fpacked);
         v_convert(complexOut, (fft_float_type *)m_fpacked, sz + 2);
     }
 
@@ -1722,9 +1798,14 @@ public:
             for (int i = 0; i < sz; ++i) {
                 fbuf[i] = realIn[i];
             }
-        fftwf_execute(m_fplanf);
+        fftwf_execute_dft_r2c(m_fplanf, m_fbuf, m_fpacked);
+#ifdef FFTW_DOUBLE_ONLY
         v_cartesian_interleaved_to_polar(magOut, phaseOut,
                                          (float *)m_fpacked, m_size/2+1);
+#else
+        m_polar->cartesianInterleavedToPolar(magOut, phaseOut,
+                                             (float *)m_fpacked, m_size/2+1);
+#endif
     }
 
     void forwardMagnitude(const float * realIn, float * magOut) {
@@ -1737,7 +1818,7 @@ public:
             for (int i = 0; i < sz; ++i) {
                 fbuf[i] = realIn[i];
             }
-        fftwf_execute(m_fplanf);
+        fftwf_execute_dft_r2c(m_fplanf, m_fbuf, m_fpacked);
         const int hs = m_size/2;
         for (int i = 0; i <= hs; ++i) {
             magOut[i] = sqrtf(m_fpacked[i][0] * m_fpacked[i][0] +
@@ -1748,7 +1829,7 @@ public:
     void inverse(const double * realIn, const double * imagIn, double * realOut) {
         if (!m_dplanf) initDouble();
         packDouble(realIn, imagIn);
-        fftw_execute(m_dplani);
+        fftw_execute_dft_c2r(m_dplani, m_dpacked, m_dbuf);
         const int sz = m_size;
         fft_double_type *const  dbuf = m_dbuf;
 #ifndef FFTW_SINGLE_ONLY
@@ -1762,7 +1843,7 @@ public:
     void inverseInterleaved(const double * complexIn, double * realOut) {
         if (!m_dplanf) initDouble();
         v_convert((double *)m_dpacked, complexIn, m_size + 2);
-        fftw_execute(m_dplani);
+        fftw_execute_dft_c2r(m_dplani, m_dpacked, m_dbuf);
         const int sz = m_size;
         fft_double_type *const  dbuf = m_dbuf;
 #ifndef FFTW_SINGLE_ONLY
@@ -1783,7 +1864,7 @@ public:
         for (int i = 0; i <= hs; ++i) {
             dpacked[i][1] = magIn[i] * sin(phaseIn[i]);
         }
-        fftw_execute(m_dplani);
+        fftw_execute_dft_c2r(m_dplani, m_dpacked, m_dbuf);
         const int sz = m_size;
         fft_double_type *const  dbuf = m_dbuf;
 #ifndef FFTW_SINGLE_ONLY
@@ -1805,7 +1886,7 @@ public:
         for (int i = 0; i <= hs; ++i) {
             dpacked[i][1] = 0.0;
         }
-        fftw_execute(m_dplani);
+        fftw_execute_dft_c2r(m_dplani, m_dpacked, m_dbuf);
         const int sz = m_size;
 #ifndef FFTW_SINGLE_ONLY
         if (cepOut != dbuf)
@@ -1818,7 +1899,7 @@ public:
     void inverse(const float * realIn, const float * imagIn, float * realOut) {
         if (!m_fplanf) initFloat();
         packFloat(realIn, imagIn);
-        fftwf_execute(m_fplani);
+        fftwf_execute_dft_c2r(m_fplani, m_fpacked, m_fbuf);
         const int sz = m_size;
         fft_float_type *const  fbuf = m_fbuf;
 #ifndef FFTW_DOUBLE_ONLY
@@ -1832,7 +1913,7 @@ public:
     void inverseInterleaved(const float * complexIn, float * realOut) {
         if (!m_fplanf) initFloat();
         v_copy((float *)m_fpacked, complexIn, m_size + 2);
-        fftwf_execute(m_fplani);
+        fftwf_execute_dft_c2r(m_fplani, m_fpacked, m_fbuf);
         const int sz = m_size;
         fft_float_type *const  fbuf = m_fbuf;
 #ifndef FFTW_DOUBLE_ONLY
@@ -1846,6 +1927,7 @@ public:
     void inversePolar(const float * magIn, const float * phaseIn, float * realOut) {
         if (!m_fplanf) initFloat();
         const int hs = m_size/2;
+#ifdef FFTW_DOUBLE_ONLY
         fftwf_complex *const  fpacked = m_fpacked;
         for (int i = 0; i <= hs; ++i) {
             fpacked[i][0] = magIn[i] * cosf(phaseIn[i]);
@@ -1853,7 +1935,11 @@ public:
         for (int i = 0; i <= hs; ++i) {
             fpacked[i][1] = magIn[i] * sinf(phaseIn[i]);
         }
-        fftwf_execute(m_fplani);
+#else
+        m_polar->polarToCartesianInterleaved((float *)m_fpacked,
+                                             magIn, phaseIn, hs + 1);
+#endif
+        fftwf_execute_dft_c2r(m_fplani, m_fpacked, m_fbuf);
         const int sz = m_size;
         fft_float_type *const  fbuf = m_fbuf;
 #ifndef FFTW_DOUBLE_ONLY
@@ -1864,6 +1950,91 @@ public:
             }
     }
 
+    // The float batches go through the plan_many plan, in runs of
+    // as many frames as initFloatBatch prepared it for.  A shorter
+    // run still goes through the plan, with the spare frames
+    // transformed to no purpose, unless it is no more than half as
+    // long, when its frames go one at a time instead.
+    void forwardInterleavedBatch(int count, const float *const *realIn, float *const *complexOut) {
+        const int hs = m_size/2;
+        for (int i = 0; i < count; ) {
+            const int n = std::min(count - i, m_fbatchCount);
+            if (!batchRun(n)) {
+                FFTImpl::forwardInterleavedBatch(count - i, realIn + i, complexOut + i);
+                return;
+            }
+            forwardBatch(n, realIn + i);
+            for (int k = 0; k < n; ++k) {
+                v_convert(complexOut[i + k], (fft_float_type *)(m_fbatchPacked + k * (hs + 1)),
+                          m_size + 2);
+            }
+            i += n;
+        }
+    }
+
+    void forwardPolarBatch(int count, const float *const *realIn, float *const *magOut, float *const *phaseOut) {
+        const int hs = m_size/2;
+        for (int i = 0; i < count; ) {
+            const int n = std::min(count - i, m_fbatchCount);
+            if (!batchRun(n)) {
+                FFTImpl::forwardPolarBatch(count - i, realIn + i, magOut + i, phaseOut + i);
+                return;
+            }
+            forwardBatch(n, realIn + i);
+            for (int k = 0; k < n; ++k) {
+                fft_float_type *packed = (fft_float_type *)(m_fbatchPacked + k * (hs + 1));
+#ifdef FFTW_DOUBLE_ONLY
+                v_cartesian_interleaved_to_polar(magOut[i + k], phaseOut[i + k], packed, hs + 1);
+#else
+                m_polar->cartesianInterleavedToPolar(magOut[i + k], phaseOut[i + k], packed, hs + 1);
+#endif
+            }
+            i += n;
+        }
+    }
+
+    void inverseInterleavedBatch(int count, const float *const *complexIn, float *const *realOut) {
+        const int hs = m_size/2;
+        for (int i = 0; i < count; ) {
+            const int n = std::min(count - i, m_fbatchCount);
+            if (!batchRun(n)) {
+                FFTImpl::inverseInterleavedBatch(count - i, complexIn + i, realOut + i);
+                return;
+            }
+            for (int k = 0; k < n; ++k) {
+                v_convert((fft_float_type *)(m_fbatchPacked + k * (hs + 1)), complexIn[i + k],
+                          m_size + 2);
+            }
+            inverseBatch(n, realOut + i);
+            i += n;
+        }
+    }
+
+    void inversePolarBatch(int count, const float *const *magIn, const float *const *phaseIn, float *const *realOut) {
+        const int hs = m_size/2;
+        for (int i = 0; i < count; ) {
+            const int n = std::min(count - i, m_fbatchCount);
+            if (!batchRun(n)) {
+                FFTImpl::inversePolarBatch(count - i, magIn + i, phaseIn + i, realOut + i);
+                return;
+            }
+            for (int k = 0; k < n; ++k) {
+                fftwf_complex *const  fpacked = m_fbatchPacked + k * (hs + 1);
+#ifdef FFTW_DOUBLE_ONLY
+                for (int j = 0; j <= hs; ++j) {
+                    fpacked[j][0] = magIn[i + k][j] * cosf(phaseIn[i + k][j]);
+                    fpacked[j][1] = magIn[i + k][j] * sinf(phaseIn[i + k][j]);
+                }
+#else
+                m_polar->polarToCartesianInterleaved((float *)fpacked,
+                                                     magIn[i + k], phaseIn[i + k], hs + 1);
+#endif
+            }
+            inverseBatch(n, realOut + i);
+            i += n;
+        }
+    }
+
     void inverseCepstral(const float * magIn, float * cepOut) {
         if (!m_fplanf) initFloat();
         const int hs = m_size/2;
@@ -1874,7 +2045,7 @@ public:
         for (int i = 0; i <= hs; ++i) {
             fpacked[i][1] = 0.f;
         }
-        fftwf_execute(m_fplani);
+        fftwf_execute_dft_c2r(m_fplani, m_fpacked, m_fbuf);
         const int sz = m_size;
         fft_float_type *const  fbuf = m_fbuf;
 #ifndef FFTW_DOUBLE_ONLY
@@ -1884,7 +2055,136 @@ public:
                 cepOut[i] = fbuf[i];
             }
     }
+    // Whether plans for sizes with no saved wisdom are measured
+    // (the default) or estimated.  See FFT::loadTuning.
+    static void setPlanMeasure(bool measure) {
+#ifndef NO_THREADING
+        std::lock_guard<Mutex> guard(m_commonMutex);
+#endif
+        m_planMeasure = measure;
+    }
+    static bool getPlanMeasure() {
+#ifndef NO_THREADING
+        std::lock_guard<Mutex> guard(m_commonMutex);
+#endif
+        return m_planMeasure;
+    }
+
 private:
+    // Called with the common mutex held
+    static unsigned coldPlanning() {
+        return m_planMeasure ? FFTW_MEASURE : FFTW_ESTIMATE;
+    }
+
+    // Plans are shared by all instances of the same size and run
+    // through the new-array execute functions on each instance's own
+    // buffers, which FFTW allows concurrently.  They are made with
+    // the common mutex held (by initFloat/initDouble) and destroyed
+    // when the last instance using them goes away.
+    struct FloatPlans {
+        explicit FloatPlans(int size) {
+            fft_float_type *buf = (fft_float_type *)fftw_malloc(size * sizeof(fft_float_type));
+            fftwf_complex *packed = (fftwf_complex *)fftw_malloc
+                ((size/2 + 1) * sizeof(fftwf_complex));
+            forward = fftwf_plan_dft_r2c_1d(size, buf, packed, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            if (!forward) forward = fftwf_plan_dft_r2c_1d(size, buf, packed, coldPlanning());
+            inverse = fftwf_plan_dft_c2r_1d(size, packed, buf, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            if (!inverse) inverse = fftwf_plan_dft_c2r_1d(size, packed, buf, coldPlanning());
+            fftwf_free(buf);
+            fftwf_free(packed);
+        }
+        ~FloatPlans() {
+#ifndef NO_THREADING
+            std::lock_guard<Mutex> guard(m_commonMutex);
+#endif
+            fftwf_destroy_plan(forward);
+            fftwf_destroy_plan(inverse);
+        }
+        fftwf_plan forward;
+        fftwf_plan inverse;
+    };
+    struct DoublePlans {
+        explicit DoublePlans(int size) {
+            fft_double_type *buf = (fft_double_type *)fftw_malloc(size * sizeof(fft_double_type));
+            fftw_complex *packed = (fftw_complex *)fftw_malloc
+                ((size/2 + 1) * sizeof(fftw_complex));
+            forward = fftw_plan_dft_r2c_1d(size, buf, packed, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            if (!forward) forward = fftw_plan_dft_r2c_1d(size, buf, packed, coldPlanning());
+            inverse = fftw_plan_dft_c2r_1d(size, packed, buf, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            if (!inverse) inverse = fftw_plan_dft_c2r_1d(size, packed, buf, coldPlanning());
+            fftw_free(buf);
+            fftw_free(packed);
+        }
+        ~DoublePlans() {
+#ifndef NO_THREADING
+            std::lock_guard<Mutex> guard(m_commonMutex);
+#endif
+            fftw_destroy_plan(forward);
+            fftw_destroy_plan(inverse);
+        }
+        fftw_plan forward;
+        fftw_plan inverse;
+    };
+    // Plans for count frames held end to end, in the r2c and c2r
+    // layouts of the single-frame plans
+    struct FloatBatchPlans {
+        FloatBatchPlans(int size, int count) {
+            int n = size;
+            int hs1 = size/2 + 1;
+            fft_float_type *buf = (fft_float_type *)fftw_malloc
+                (count * size * sizeof(fft_float_type));
+            fftwf_complex *packed = (fftwf_complex *)fftw_malloc
+                (count * hs1 * sizeof(fftwf_complex));
+            forward = fftwf_plan_many_dft_r2c(1, &n, count, buf, 0, 1, size,
+                                              packed, 0, 1, hs1,
+                                              FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            if (!forward) forward = fftwf_plan_many_dft_r2c(1, &n, count, buf, 0, 1, size,
+                                                            packed, 0, 1, hs1,
+                                                            coldPlanning());
+            inverse = fftwf_plan_many_dft_c2r(1, &n, count, packed, 0, 1, hs1,
+                                              buf, 0, 1, size,
+                                              FFTW_MEASURE | FFTW_WISDOM_ONLY);
+            if (!inverse) inverse = fftwf_plan_many_dft_c2r(1, &n, count, packed, 0, 1, hs1,
+                                                            buf, 0, 1, size,
+                                                            coldPlanning());
+            fftwf_free(buf);
+            fftwf_free(packed);
+        }
+        ~FloatBatchPlans() {
+#ifndef NO_THREADING
+            std::lock_guard<Mutex> guard(m_commonMutex);
+#endif
+            fftwf_destroy_plan(forward);
+            fftwf_destroy_plan(inverse);
+        }
+        fftwf_plan forward;
+        fftwf_plan inverse;
+    };
+
+    // Whether a run of count frames goes through the batch plan
+    bool batchRun(int count) const {
+        return m_fbatchCount >= 2 && count * 2 > m_fbatchCount;
+    }
+
+    void forwardBatch(int count, const float *const *realIn) {
+        const int sz = m_size;
+        for (int k = 0; k < count; ++k) {
+            v_convert(m_fbatch + k * sz, realIn[k], sz);
+        }
+        fftwf_execute_dft_r2c(m_fbatchPlans->forward, m_fbatch, m_fbatchPacked);
+    }
+
+    void inverseBatch(int count, float *const *realOut) {
+        const int sz = m_size;
+        fftwf_execute_dft_c2r(m_fbatchPlans->inverse, m_fbatchPacked, m_fbatch);
+        for (int k = 0; k < count; ++k) {
+            v_convert(realOut[k], m_fbatch + k * sz, sz);
+        }
+    }
+
+    std::shared_ptr<const FloatPlans> m_fplans;
+    std::shared_ptr<const DoublePlans> m_dplans;
+    std::shared_ptr<const FloatBatchPlans> m_fbatchPlans;
     fftwf_plan m_fplanf;
     fftwf_plan m_fplani;
 #ifdef FFTW_DOUBLE_ONLY
@@ -1901,11 +2201,15 @@ private:
     double *m_dbuf;
 #endif
     fftw_complex *m_dpacked;
+    fft_float_type *m_fbatch;
+    fftwf_complex *m_fbatchPacked;
+    int m_fbatchCount;
     const int m_size;
     static int m_extantf;
     static int m_extantd;
+    static bool m_planMeasure;
 #ifndef NO_THREADING
-    static std::mutex m_commonMutex;
+    static Mutex m_commonMutex;
 #endif
 };
 
@@ -1915,8 +2219,11 @@ D_FFTW::m_extantf = 0;
 int
 D_FFTW::m_extantd = 0;
 
+bool
+D_FFTW::m_planMeasure = true;
+
 #ifndef NO_THREADING
-std::mutex
+Mutex
 D_FFTW::m_commonMutex;
 #endif
 
@@ -2259,335 +2566,500 @@ private:
 
 #ifdef USE_BUILTIN_FFT
 
-class D_Cross : public FFTImpl
+// The builtin transform: a real FFT of size N computed as a complex
+// FFT of N/2 points followed by the usual split into the spectrum of
+// a real signal.  The complex FFT is radix-4 Stockham, with one
+// radix-2 stage when N/2 is not a power of four, so there is no
+// bit-reversal pass.  Real and imaginary parts are kept in separate
+// arrays, so that each butterfly loop is a plain loop over arrays
+// which the compiler vectorises.  Twiddles are computed in double
+// precision once per size and shared by all instances of that size.
+
+template <typename T>
+struct CrossTables
 {
-public:
-    D_Cross(int size) : m_size(size), m_table(0) {
-        
-        m_a = new double[size];
-        m_b = new double[size];
-        m_c = new double[size];
-        m_d = new double[size];
-
-        m_table = new int[m_size];
-    
-        int bits;
-        int i, j, k, m;
-
-        for (i = 0; ; ++i) {
-            if (m_size & (1 << i)) {
-                bits = i;
-                break;
+    explicit CrossTables(int size) {
+        const int half = size / 2;
+        // For each radix-4 stage of n points: w^p, w^2p and w^3p for
+        // p < n/4, where w = exp(-2 pi i / n), as real and imaginary
+        // arrays of n/4 each
+        for (int n = half; n >= 4; n /= 4) {
+            const int m = n / 4;
+            for (int k = 1; k <= 3; ++k) {
+                for (int p = 0; p < m; ++p) {
+                    stages.push_back(T(cos((2.0 * M_PI * k * p) / n)));
+                }
+                for (int p = 0; p < m; ++p) {
+                    stages.push_back(T(-sin((2.0 * M_PI * k * p) / n)));
+                }
             }
         }
-        
-        for (i = 0; i < m_size; ++i) {
-            
-            m = i;
-            
-            for (j = k = 0; j < bits; ++j) {
-                k = (k << 1) | (m & 1);
-                m >>= 1;
-            }
-            
-            m_table[i] = k;
+        // For the split: exp(-2 pi i k / size) = cosines[k] - i
+        // sines[k], for k <= size/4
+        for (int k = 0; k <= half / 2; ++k) {
+            cosines.push_back(T(cos((M_PI * k) / half)));
+            sines.push_back(T(sin((M_PI * k) / half)));
         }
     }
+    std::vector<T> stages;
+    std::vector<T> cosines;
+    std::vector<T> sines;
+};
+
+template <typename T>
+class CrossTransform
+{
+public:
+    explicit CrossTransform(int size) :
+        m_half(size / 2),
+        m_tables(SharedCache<int, CrossTables<T> >::get(size, size)),
+        m_ar(allocate<T>(m_half)),
+        m_ai(allocate<T>(m_half)),
+        m_br(allocate<T>(m_half)),
+        m_bi(allocate<T>(m_half)) {
+    }
+
+    ~CrossTransform() {
+        deallocate(m_ar);
+        deallocate(m_ai);
+        deallocate(m_br);
+        deallocate(m_bi);
+    }
+
+    // The size/2+1 bins of the spectrum of realIn
+    void forward(const T *R__ realIn, T *R__ re, T *R__ im) {
+        const int half = m_half;
+        T *R__ zr = m_ar;
+        T *R__ zi = m_ai;
+        const T *R__ x = realIn;
+        for (int k = 0; k < half; ++k) {
+            zr[k] = x[0];
+            zi[k] = x[1];
+            x += 2;
+        }
+        const T *R__ fr;
+        const T *R__ fi;
+        transform(fr, fi);
+
+        // X[k] = (Z[k] + conj(Z[h-k])) / 2
+        //      + w^k (Z[k] - conj(Z[h-k])) / 2i, w = exp(-2 pi i / size),
+        // and X[h-k] is the same with the sign of the second term and
+        // the result conjugated
+        re[0] = fr[0] + fi[0];
+        im[0] = T(0);
+        re[half] = fr[0] - fi[0];
+        im[half] = T(0);
+        if (half < 2) return;
+        const int quarter = half / 2;
+        const T *R__ c = m_tables->cosines.data();
+        const T *R__ s = m_tables->sines.data();
+        for (int k = 1; k < quarter; ++k) {
+            const int j = half - k;
+            const T er = T(0.5) * (fr[k] + fr[j]);
+            const T ei = T(0.5) * (fi[k] - fi[j]);
+            const T or_ = T(0.5) * (fi[k] + fi[j]);
+            const T oi = T(0.5) * (fr[j] - fr[k]);
+            const T tr = c[k] * or_ + s[k] * oi;
+            const T ti = c[k] * oi - s[k] * or_;
+            re[k] = er + tr;
+            im[k] = ei + ti;
+            re[j] = er - tr;
+            im[j] = ti - ei;
+        }
+        re[quarter] = fr[quarter];
+        im[quarter] = -fi[quarter];
+    }
+
+    // The real signal of the size/2+1 bins re and im, unscaled
+    void inverse(const T *R__ re, const T *R__ im, T *R__ realOut) {
+        const int half = m_half;
+        // Z[k] = (X[k] + conj(X[h-k])) + i conj(w^k) (X[k] - conj(X[h-k])),
+        // built with its real and imaginary parts exchanged, so that
+        // the forward transform computes the inverse
+        join(half, re, im, m_ai, m_ar,
+             m_tables->cosines.data(), m_tables->sines.data());
+        const T *R__ fi;
+        const T *R__ fr;
+        transform(fi, fr);
+        T *R__ x = realOut;
+        for (int k = 0; k < half; ++k) {
+            x[0] = fr[k];
+            x[1] = fi[k];
+            x += 2;
+        }
+    }
+
+private:
+    // The half-size complex sequence whose transform inverse wants,
+    // as described there, into zr and zi.  (A separate function for
+    // the sake of the restricted parameters, without which the
+    // compiler won't vectorise the loop)
+    static void join(const int half, const T *R__ re, const T *R__ im,
+                     T *R__ zr, T *R__ zi, const T *R__ c, const T *R__ s) {
+        zr[0] = re[0] + re[half] - im[0] - im[half];
+        zi[0] = im[0] - im[half] + re[0] - re[half];
+        if (half < 2) return;
+        const int quarter = half / 2;
+        for (int k = 1; k < quarter; ++k) {
+            const int j = half - k;
+            const T er = re[k] + re[j];
+            const T ei = im[k] - im[j];
+            const T dr = re[k] - re[j];
+            const T di = im[k] + im[j];
+            const T or_ = c[k] * dr - s[k] * di;
+            const T oi = s[k] * dr + c[k] * di;
+            zr[k] = er - oi;
+            zi[k] = ei + or_;
+            zr[j] = er + oi;
+            zi[j] = or_ - ei;
+        }
+        zr[quarter] = T(2) * re[quarter];
+        zi[quarter] = T(-2) * im[quarter];
+    }
+
+    // Complex forward transform of the m_half points in m_ar and
+    // m_ai, which it overwrites along with m_br and m_bi; the result
+    // is left in whichever pair the last stage wrote
+    void transform(const T *R__ &re, const T *R__ &im) {
+        T *xr = m_ar;
+        T *xi = m_ai;
+        T *yr = m_br;
+        T *yi = m_bi;
+        const T *w = m_tables->stages.data();
+        int n = m_half;
+        int s = 1;
+        while (n >= 4) {
+            if (s == 1) radix4First(n, xr, xi, yr, yi, w);
+            else radix4(n, s, xr, xi, yr, yi, w);
+            w += 6 * (n / 4);
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+            n /= 4;
+            s *= 4;
+        }
+        if (n == 2) {
+            radix2(s, xr, xi, yr, yi);
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+        }
+        re = xr;
+        im = xi;
+    }
+
+    // One radix-4 stage on n-point subsequences interleaved at stride
+    // s, vectorised across the s subsequences
+    static void radix4(const int n, const int s,
+                       const T *R__ xr, const T *R__ xi,
+                       T *R__ yr, T *R__ yi, const T *R__ w) {
+        const int m = n / 4;
+        const int sm = s * m;
+        const T *ar = xr;
+        const T *ai = xi;
+        T *y0r = yr;
+        T *y0i = yi;
+        for (int p = 0; p < m; ++p) {
+            const T t[6] = {
+                w[p], w[m + p], w[2*m + p], w[3*m + p], w[4*m + p], w[5*m + p]
+            };
+            butterflies(s, ar, ai, ar + sm, ai + sm,
+                        ar + 2*sm, ai + 2*sm, ar + 3*sm, ai + 3*sm,
+                        y0r, y0i, y0r + s, y0i + s,
+                        y0r + 2*s, y0i + 2*s, y0r + 3*s, y0i + 3*s, t);
+            ar += s;
+            ai += s;
+            y0r += 4 * s;
+            y0i += 4 * s;
+        }
+    }
+
+    // The butterflies of one twiddle t (w^p, w^2p and w^3p, real and
+    // imaginary) across s subsequences, from the quarters a to d of
+    // the input into the outputs y0 to y3.  Every stream is its own
+    // restricted parameter, so that the compiler vectorises without
+    // checking them against each other for overlap
+    static void butterflies(const int s,
+                            const T *R__ ar, const T *R__ ai,
+                            const T *R__ br, const T *R__ bi,
+                            const T *R__ cr, const T *R__ ci,
+                            const T *R__ dr, const T *R__ di,
+                            T *R__ y0r, T *R__ y0i, T *R__ y1r, T *R__ y1i,
+                            T *R__ y2r, T *R__ y2i, T *R__ y3r, T *R__ y3i,
+                            const T *R__ t) {
+        const T w1r = t[0], w1i = t[1];
+        const T w2r = t[2], w2i = t[3];
+        const T w3r = t[4], w3i = t[5];
+        for (int q = 0; q < s; ++q) {
+            const T apcr = ar[q] + cr[q], apci = ai[q] + ci[q];
+            const T amcr = ar[q] - cr[q], amci = ai[q] - ci[q];
+            const T bpdr = br[q] + dr[q], bpdi = bi[q] + di[q];
+            const T bmdr = br[q] - dr[q], bmdi = bi[q] - di[q];
+            const T t1r = amcr + bmdi, t1i = amci - bmdr;
+            const T t2r = apcr - bpdr, t2i = apci - bpdi;
+            const T t3r = amcr - bmdi, t3i = amci + bmdr;
+            y0r[q] = apcr + bpdr;
+            y0i[q] = apci + bpdi;
+            y1r[q] = w1r * t1r - w1i * t1i;
+            y1i[q] = w1r * t1i + w1i * t1r;
+            y2r[q] = w2r * t2r - w2i * t2i;
+            y2i[q] = w2r * t2i + w2i * t2r;
+            y3r[q] = w3r * t3r - w3i * t3i;
+            y3i[q] = w3r * t3i + w3i * t3r;
+        }
+    }
+
+    // The first stage, where s is 1: vectorised across the butterflies
+    // instead, with the twiddles loaded as arrays
+    static void radix4First(const int n,
+                            const T *R__ xr, const T *R__ xi,
+                            T *R__ yr, T *R__ yi, const T *R__ w) {
+        const int m = n / 4;
+        const T *R__ ar = xr;
+        const T *R__ ai = xi;
+        const T *R__ br = xr + m;
+        const T *R__ bi = xi + m;
+        const T *R__ cr = xr + 2*m;
+        const T *R__ ci = xi + 2*m;
+        const T *R__ dr = xr + 3*m;
+        const T *R__ di = xi + 3*m;
+        const T *R__ w1r = w;
+        const T *R__ w1i = w + m;
+        const T *R__ w2r = w + 2*m;
+        const T *R__ w2i = w + 3*m;
+        const T *R__ w3r = w + 4*m;
+        const T *R__ w3i = w + 5*m;
+        T *R__ y = yr;
+        T *R__ z = yi;
+        for (int p = 0; p < m; ++p) {
+            const T apcr = ar[p] + cr[p], apci = ai[p] + ci[p];
+            const T amcr = ar[p] - cr[p], amci = ai[p] - ci[p];
+            const T bpdr = br[p] + dr[p], bpdi = bi[p] + di[p];
+            const T bmdr = br[p] - dr[p], bmdi = bi[p] - di[p];
+            const T t1r = amcr + bmdi, t1i = amci - bmdr;
+            const T t2r = apcr - bpdr, t2i = apci - bpdi;
+            const T t3r = amcr - bmdi, t3i = amci + bmdr;
+            y[0] = apcr + bpdr;
+            z[0] = apci + bpdi;
+            y[1] = w1r[p] * t1r - w1i[p] * t1i;
+            z[1] = w1r[p] * t1i + w1i[p] * t1r;
+            y[2] = w2r[p] * t2r - w2i[p] * t2i;
+            z[2] = w2r[p] * t2i + w2i[p] * t2r;
+            y[3] = w3r[p] * t3r - w3i[p] * t3i;
+            z[3] = w3r[p] * t3i + w3i[p] * t3r;
+            y += 4;
+            z += 4;
+        }
+    }
+
+    // The last stage, where the subsequences have two points
+    static void radix2(const int s,
+                       const T *R__ xr, const T *R__ xi,
+                       T *R__ yr, T *R__ yi) {
+        const T *R__ br = xr + s;
+        const T *R__ bi = xi + s;
+        T *R__ zr = yr + s;
+        T *R__ zi = yi + s;
+        for (int q = 0; q < s; ++q) {
+            yr[q] = xr[q] + br[q];
+            yi[q] = xi[q] + bi[q];
+            zr[q] = xr[q] - br[q];
+            zi[q] = xi[q] - bi[q];
+        }
+    }
+
+    const int m_half;
+    std::shared_ptr<const CrossTables<T> > m_tables;
+    T *m_ar;
+    T *m_ai;
+    T *m_br;
+    T *m_bi;
+};
+
+class D_Cross : public FFTImpl
+{
+public:
+    D_Cross(int size) :
+        m_size(size), m_float(0), m_double(0),
+        m_fre(0), m_fim(0), m_dre(0), m_dim(0) {
+    }
 
     ~D_Cross() {
-        delete[] m_table;
-        delete[] m_a;
-        delete[] m_b;
-        delete[] m_c;
-        delete[] m_d;
+        delete m_float;
+        delete m_double;
+        deallocate(m_fre);
+        deallocate(m_fim);
+        deallocate(m_dre);
+        deallocate(m_dim);
     }
 
     FFT::Precisions
     getSupportedPrecisions() const {
-        return FFT::DoublePrecision;
+        return FFT::SinglePrecision | FFT::DoublePrecision;
+    }
+
+    void initFloat() {
+        if (m_float) return;
+        m_float = new CrossTransform<float>(m_size);
+        m_fre = allocate<float>(m_size/2 + 1);
+        m_fim = allocate<float>(m_size/2 + 1);
     }
 
-    void initFloat() { }
-    void initDouble() { }
+    void initDouble() {
+        if (m_double) return;
+        m_double = new CrossTransform<double>(m_size);
+        m_dre = allocate<double>(m_size/2 + 1);
+        m_dim = allocate<double>(m_size/2 + 1);
+    }
 
     void forward(const double * realIn, double * realOut, double * imagOut) {
-        basefft(false, realIn, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) realOut[i] = m_c[i];
-        if (imagOut) {
-            for (int i = 0; i <= hs; ++i) imagOut[i] = m_d[i];
-        }
+        if (!m_double) initDouble();
+        m_double->forward(realIn, realOut, imagOut);
     }
 
     void forwardInterleaved(const double * realIn, double * complexOut) {
-        basefft(false, realIn, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) complexOut[i*2] = m_c[i];
-        for (int i = 0; i <= hs; ++i) complexOut[i*2+1] = m_d[i];
+        if (!m_double) initDouble();
+        m_double->forward(realIn, m_dre, m_dim);
+        interleave(complexOut, m_dre, m_dim);
     }
 
     void forwardPolar(const double * realIn, double * magOut, double * phaseOut) {
-        basefft(false, realIn, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            magOut[i] = sqrt(m_c[i] * m_c[i] + m_d[i] * m_d[i]);
-            phaseOut[i] = atan2(m_d[i], m_c[i]) ;
-        }
+        if (!m_double) initDouble();
+        m_double->forward(realIn, m_dre, m_dim);
+        v_cartesian_to_polar(magOut, phaseOut, m_dre, m_dim, m_size/2 + 1);
     }
 
     void forwardMagnitude(const double * realIn, double * magOut) {
-        basefft(false, realIn, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            magOut[i] = sqrt(m_c[i] * m_c[i] + m_d[i] * m_d[i]);
-        }
+        if (!m_double) initDouble();
+        m_double->forward(realIn, m_dre, m_dim);
+        magnitudes(magOut, m_dre, m_dim);
     }
 
     void forward(const float * realIn, float * realOut, float * imagOut) {
-        for (int i = 0; i < m_size; ++i) m_a[i] = realIn[i];
-        basefft(false, m_a, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) realOut[i] = m_c[i];
-        if (imagOut) {
-            for (int i = 0; i <= hs; ++i) imagOut[i] = m_d[i];
-        }
+        if (!m_float) initFloat();
+        m_float->forward(realIn, realOut, imagOut);
     }
 
     void forwardInterleaved(const float * realIn, float * complexOut) {
-        for (int i = 0; i < m_size; ++i) m_a[i] = realIn[i];
-        basefft(false, m_a, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) complexOut[i*2] = m_c[i];
-        for (int i = 0; i <= hs; ++i) complexOut[i*2+1] = m_d[i];
+        if (!m_float) initFloat();
+        m_float->forward(realIn, m_fre, m_fim);
+        interleave(complexOut, m_fre, m_fim);
     }
 
     void forwardPolar(const float * realIn, float * magOut, float * phaseOut) {
-        for (int i = 0; i < m_size; ++i) m_a[i] = realIn[i];
-        basefft(false, m_a, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            magOut[i] = sqrt(m_c[i] * m_c[i] + m_d[i] * m_d[i]);
-            phaseOut[i] = atan2(m_d[i], m_c[i]) ;
-        }
+        if (!m_float) initFloat();
+        m_float->forward(realIn, m_fre, m_fim);
+        m_polar->cartesianToPolar(magOut, phaseOut, m_fre, m_fim, m_size/2 + 1);
     }
 
     void forwardMagnitude(const float * realIn, float * magOut) {
-        for (int i = 0; i < m_size; ++i) m_a[i] = realIn[i];
-        basefft(false, m_a, 0, m_c, m_d);
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            magOut[i] = sqrt(m_c[i] * m_c[i] + m_d[i] * m_d[i]);
-        }
+        if (!m_float) initFloat();
+        m_float->forward(realIn, m_fre, m_fim);
+        magnitudes(magOut, m_fre, m_fim);
     }
 
     void inverse(const double * realIn, const double * imagIn, double * realOut) {
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            double real = realIn[i];
-            double imag = imagIn[i];
-            m_a[i] = real;
-            m_b[i] = imag;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = -imag;
-            }
-        }
-        basefft(true, m_a, m_b, realOut, m_d);
+        if (!m_double) initDouble();
+        m_double->inverse(realIn, imagIn, realOut);
     }
 
     void inverseInterleaved(const double * complexIn, double * realOut) {
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            double real = complexIn[i*2];
-            double imag = complexIn[i*2+1];
-            m_a[i] = real;
-            m_b[i] = imag;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = -imag;
-            }
-        }
-        basefft(true, m_a, m_b, realOut, m_d);
+        if (!m_double) initDouble();
+        deinterleave(m_dre, m_dim, complexIn);
+        m_double->inverse(m_dre, m_dim, realOut);
     }
 
     void inversePolar(const double * magIn, const double * phaseIn, double * realOut) {
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            double real = magIn[i] * cos(phaseIn[i]);
-            double imag = magIn[i] * sin(phaseIn[i]);
-            m_a[i] = real;
-            m_b[i] = imag;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = -imag;
-            }
-        }
-        basefft(true, m_a, m_b, realOut, m_d);
+        if (!m_double) initDouble();
+        v_polar_to_cartesian(m_dre, m_dim, magIn, phaseIn, m_size/2 + 1);
+        m_double->inverse(m_dre, m_dim, realOut);
     }
 
     void inverseCepstral(const double * magIn, double * cepOut) {
+        if (!m_double) initDouble();
         const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            double real = log(magIn[i] + 0.000001);
-            m_a[i] = real;
-            m_b[i] = 0.0;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = 0.0;
-            }
-        }
-        basefft(true, m_a, m_b, cepOut, m_d);
+        for (int i = 0; i <= hs; ++i) m_dre[i] = log(magIn[i] + 0.000001);
+        v_zero(m_dim, hs + 1);
+        m_double->inverse(m_dre, m_dim, cepOut);
     }
 
     void inverse(const float * realIn, const float * imagIn, float * realOut) {
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            float real = realIn[i];
-            float imag = imagIn[i];
-            m_a[i] = real;
-            m_b[i] = imag;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = -imag;
-            }
-        }
-        basefft(true, m_a, m_b, m_c, m_d);
-        for (int i = 0; i < m_size; ++i) realOut[i] = m_c[i];
+        if (!m_float) initFloat();
+        m_float->inverse(realIn, imagIn, realOut);
     }
 
     void inverseInterleaved(const float * complexIn, float * realOut) {
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            float real = complexIn[i*2];
-            float imag = complexIn[i*2+1];
-            m_a[i] = real;
-            m_b[i] = imag;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = -imag;
-            }
-        }
-        basefft(true, m_a, m_b, m_c, m_d);
-        for (int i = 0; i < m_size; ++i) realOut[i] = m_c[i];
+        if (!m_float) initFloat();
+        deinterleave(m_fre, m_fim, complexIn);
+        m_float->inverse(m_fre, m_fim, realOut);
     }
 
     void inversePolar(const float * magIn, const float * phaseIn, float * realOut) {
-        const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            float real = magIn[i] * cosf(phaseIn[i]);
-            float imag = magIn[i] * sinf(phaseIn[i]);
-            m_a[i] = real;
-            m_b[i] = imag;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = -imag;
-            }
-        }
-        basefft(true, m_a, m_b, m_c, m_d);
-        for (int i = 0; i < m_size; ++i) realOut[i] = m_c[i];
+        if (!m_float) initFloat();
+        m_polar->polarToCartesian(m_fre, m_fim, magIn, phaseIn, m_size/2 + 1);
+        m_float->inverse(m_fre, m_fim, realOut);
     }
 
     void inverseCepstral(const float * magIn, float * cepOut) {
+        if (!m_float) initFloat();
         const int hs = m_size/2;
-        for (int i = 0; i <= hs; ++i) {
-            float real = logf(magIn[i] + 0.000001);
-            m_a[i] = real;
-            m_b[i] = 0.0;
-            if (i > 0) {
-                m_a[m_size-i] = real;
-                m_b[m_size-i] = 0.0;
-            }
-        }
-        basefft(true, m_a, m_b, m_c, m_d);
-        for (int i = 0; i < m_size; ++i) cepOut[i] = m_c[i];
+        for (int i = 0; i <= hs; ++i) m_fre[i] = logf(magIn[i] + 0.000001f);
+        v_zero(m_fim, hs + 1);
+        m_float->inverse(m_fre, m_fim, cepOut);
     }
 
 private:
-    const int m_size;
-    int *m_table;
-    double *m_a;
-    double *m_b;
-    double *m_c;
-    double *m_d;
-    void basefft(bool inverse, const double * ri, const double * ii, double * ro, double * io);
-};
-void
-D_Cross::basefft(bool inverse, const double * ri, const double * ii, double * ro, double * io){
-    if (!ri || !ro || !io) return;
-
-    int i, j, k, m;
-    int blockSize, blockEnd;
-
-    double tr, ti;
-
-    double angle = 2.0 * M_PI;
-    if (inverse) angle = -angle;
-
-    const int n = m_size;
-
-    if (ii) {
-	for (i = 0; i < n; ++i) {
-	    ro[m_table[i]] = ri[i];
-        }
-	for (i = 0; i < n; ++i) {
-	    io[m_table[i]] = ii[i];
-	}
-    } else {
-	for (i = 0; i < n; ++i) {
-	    ro[m_table[i]] = ri[i];
+    template <typename T>
+    void interleave(T *R__ dst, const T *R__ re, const T *R__ im) const {
+        for (int i = 0; i <= m_size/2; ++i) {
+            dst[0] = re[i];
+            dst[1] = im[i];
+            dst += 2;
         }
-	for (i = 0; i < n; ++i) {
-	    io[m_table[i]] = 0.0;
-	}
     }
-    blockEnd = 1;
-    for (blockSize = 2; blockSize <= n; blockSize <<= 1) {
-	double delta = angle / (double)blockSize;
-	double sm2 = -sin(-2 * delta);
-	double sm1 = -sin(-delta);
-	double cm2 = cos(-2 * delta);
-	double cm1 = cos(-delta);
-	double w = 2 * cm1;
-	double ar[3], ai[3];
-	for (i = 0; i < n; i += blockSize) {
-	    ar[2] = cm2;
-	    ar[1] = cm1;
-
-	    ai[2] = sm2;
-	    ai[1] = sm1;
-
-	    for (j = i, m = 0; m < blockEnd; j++, m++) {
-
-		ar[0] = w * ar[1] - ar[2];
-		ar[2] = ar[1];
-		ar[1] = ar[0];
-
-		ai[0] = w * ai[1] - ai[2];
-		ai[2] = ai[1];
-		ai[1] = ai[0];
 
-		k = j + blockEnd;
-		tr = ar[0] * ro[k] - ai[0] * io[k];
-		ti = ar[0] * io[k] + ai[0] * ro[k];
-
-		ro[k] = ro[j] - tr;
-		io[k] = io[j] - ti;
-
-		ro[j] += tr;
-		io[j] += ti;
-	    }
-	}
+    template <typename T>
+    void deinterleave(T *R__ re, T *R__ im, const T *R__ src) const {
+        for (int i = 0; i <= m_size/2; ++i) {
+            re[i] = src[0];
+            im[i] = src[1];
+            src += 2;
+        }
+    }
 
-	blockEnd = blockSize;
+    template <typename T>
+    void magnitudes(T *R__ mag, const T *R__ re, const T *R__ im) const {
+        for (int i = 0; i <= m_size/2; ++i) {
+            mag[i] = sqrt(re[i] * re[i] + im[i] * im[i]);
+        }
     }
 
-}
+    const int m_size;
+    CrossTransform<float> *m_float;
+    CrossTransform<double> *m_double;
+    float *m_fre;
+    float *m_fim;
+    double *m_dre;
+    double *m_dim;
+};
+
 #endif /* USE_BUILTIN_FFT */
 } /* end namespace FFTs */
 
 std::string
 FFT::m_implementation;
 
+int
+FFT::m_polarAccuracy = -1;
+
+#ifndef NO_THREADING
+// Guards m_implementation, which may be read by FFTs being
+// constructed concurrently
+static Mutex implementationMutex;
+#endif
+
+// Set by setDefaultImplementation, which then overrides the tuning
+// table for every size
+static bool implementationExplicit = false;
+
 std::set<std::string>
 FFT::getImplementations()
 {
@@ -2632,56 +3104,314 @@ FFT::pickDefaultImplementation(){
 }
 
 std::string
-FFT::getDefaultImplementation() {return m_implementation;}
+FFT::getDefaultImplementation() {
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    return m_implementation;
+}
 void
-FFT::setDefaultImplementation(std::string i){ m_implementation = i;}
+FFT::setDefaultImplementation(std::string i){
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    m_implementation = i;
+    implementationExplicit = (i != "");
+}
 
-FFT::FFT(int size, int debugLevel) :
-    d(0){
-    if ((size < 2) ||
-        (size & (size-1))) {
-        std::cerr << "FFT::FFT(" << size << "): power-of-two sizes only supported, minimum size 2" << std::endl;
-#ifndef NO_EXCEPTIONS
-        throw InvalidSize;
-#else
-        abort();
+VectorAccuracy
+FFT::getDefaultPolarAccuracy() {
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
 #endif
-    }
-    if (m_implementation == "") pickDefaultImplementation();
-    std::string impl = m_implementation;
-    if (debugLevel > 0) {
-        std::cerr << "FFT::FFT(" << size << "): using implementation: "
-                  << impl << std::endl;
-    }
+    if (m_polarAccuracy < 0) return vector_accuracy();
+    return VectorAccuracy(m_polarAccuracy);
+}
+
+void
+FFT::setDefaultPolarAccuracy(VectorAccuracy accuracy) {
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    m_polarAccuracy = accuracy;
+}
+
+void
+FFT::setPolarAccuracy(VectorAccuracy accuracy)
+{
+    d->setPolarAccuracy(accuracy);
+}
+
+static FFTImpl *
+createImplementation(const std::string &impl, int size)
+{
     if (impl == "ffts") {
 #ifdef HAVE_FFTS
-        d = new FFTs::D_FFTS(size);
+        return new FFTs::D_FFTS(size);
 #endif
     } else if (impl == "fftw") {
 #ifdef HAVE_FFTW3
-        d = new FFTs::D_FFTW(size);
+        return new FFTs::D_FFTW(size);
 #endif
     } else if (impl == "vdsp") {
 #ifdef HAVE_VDSP
-        d = new FFTs::D_VDSP(size);
+        return new FFTs::D_VDSP(size);
 #endif
     } else if (impl == "medialib") {
 #ifdef HAVE_MEDIALIB
-        d = new FFTs::D_MEDIALIB(size);
+        return new FFTs::D_MEDIALIB(size);
 #endif
     } else if (impl == "openmax") {
 #ifdef HAVE_OPENMAX
-        d = new FFTs::D_OPENMAX(size);
+        return new FFTs::D_OPENMAX(size);
 #endif
     } else if (impl == "sfft") {
 #ifdef HAVE_SFFT
-        d = new FFTs::D_SFFT(size);
+        return new FFTs::D_SFFT(size);
 #endif
     } else if (impl == "cross") {
 #ifdef USE_BUILTIN_FFT
-        d = new FFTs::D_Cross(size);
+        return new FFTs::D_Cross(size);
+#endif
+    }
+    return 0;
+}
+
+// The tuning table: nanoseconds per forward+inverse pair, keyed by
+// implementation name, size and precision ('f' or 'd').  Guarded by
+// implementationMutex, like the defaults above.
+typedef std::tuple<std::string, int, char> TuningKey;
+static std::map<TuningKey, double> tuningTable;
+static bool tuningLoaded = false;
+
+static std::string
+getTuningPath()
+{
+    if (const char *env = getenv("RUBBERS_FFT_TUNING")) {
+        return env;
+    }
+    const char *home = getenv("HOME");
+    if (!home) return "";
+    return std::string(home) + "/.rubbers.fft-tuning";
+}
+
+static bool
+loadTuningLocked(std::string path)
+{
+    tuningLoaded = true;
+    if (path == "") return false;
+
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) return false;
+
+    char line[256];
+    char name[64];
+    int size;
+    char precision;
+    double ns;
+    int entries = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %d %c %lf", name, &size, &precision, &ns) != 4 ||
+            (precision != 'f' && precision != 'd') || !(ns > 0)) {
+            continue;
+        }
+        tuningTable[TuningKey(name, size, precision)] = ns;
+        ++entries;
+    }
+    fclose(f);
+
+#ifdef HAVE_FFTW3
+    if (entries > 0) FFTs::D_FFTW::setPlanMeasure(false);
+#endif
+    return entries > 0;
+}
+
+static std::string
+tunedImplementationLocked(int size)
+{
+    std::set<std::string> impls = FFT::getImplementations();
+    std::string best[2];
+    double bestns[2] = { 0, 0 };
+    for (std::map<TuningKey, double>::const_iterator i = tuningTable.begin();
+         i != tuningTable.end(); ++i) {
+        if (std::get<1>(i->first) != size) continue;
+        const std::string &name = std::get<0>(i->first);
+        if (impls.find(name) == impls.end()) continue;
+        int p = (std::get<2>(i->first) == 'f' ? 0 : 1);
+        if (best[p] == "" || i->second < bestns[p]) {
+            best[p] = name;
+            bestns[p] = i->second;
+        }
+    }
+    return (best[0] != "" ? best[0] : best[1]);
+}
+
+template <typename T>
+static double
+timeRoundTrip(FFTImpl *d, int size)
+{
+    T *in = allocate<T>(size);
+    T *re = allocate<T>(size / 2 + 1);
+    T *im = allocate<T>(size / 2 + 1);
+    T *out = allocate<T>(size);
+    for (int i = 0; i < size; ++i) {
+        in[i] = T(sin(i * 0.1) + 0.5 * cos(i * 0.37));
+    }
+
+    const int reps = std::max(8, (1 << 18) / size);
+    double best = 0;
+    for (int run = 0; run < 6; ++run) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; ++i) {
+            d->forward(in, re, im);
+            d->inverse(re, im, out);
+        }
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        double ns = elapsed.count() / reps;
+        // the first run only warms caches and lazy tables
+        if (run == 1 || (run > 1 && ns < best)) best = ns;
+    }
+
+    deallocate(in);
+    deallocate(re);
+    deallocate(im);
+    deallocate(out);
+    return best;
+}
+
+bool
+FFT::loadTuning(std::string path)
+{
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    return loadTuningLocked(path == "" ? getTuningPath() : path);
+}
+
+bool
+FFT::saveTuning(std::string path)
+{
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    if (path == "") path = getTuningPath();
+    if (path == "") return false;
+
+    // Write and rename, so that a worker loading the table
+    // concurrently never sees half of it
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        std::cerr << "FFT::saveTuning: failed to open " << tmp << std::endl;
+        return false;
+    }
+    fprintf(f, "# implementation size precision nanoseconds\n");
+    for (std::map<TuningKey, double>::const_iterator i = tuningTable.begin();
+         i != tuningTable.end(); ++i) {
+        fprintf(f, "%s %d %c %.1f\n", std::get<0>(i->first).c_str(),
+                std::get<1>(i->first), std::get<2>(i->first), i->second);
+    }
+    bool ok = (fclose(f) == 0);
+    if (ok) ok = (rename(tmp.c_str(), path.c_str()) == 0);
+    if (!ok) {
+        std::cerr << "FFT::saveTuning: failed to write " << path << std::endl;
+        remove(tmp.c_str());
+    }
+    return ok;
+}
+
+void
+FFT::calibrate(int size)
+{
+    if ((size < 2) || (size & (size-1))) {
+        std::cerr << "FFT::calibrate(" << size << "): power-of-two sizes only supported, minimum size 2" << std::endl;
+        return;
+    }
+
+    {
+#ifndef NO_THREADING
+        std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+        // so that saving afterwards keeps the entries for other sizes
+        if (!tuningLoaded) loadTuningLocked(getTuningPath());
+    }
+    // Measured plans for the timings, whatever a loaded table has
+    // set for everything else
+#ifdef HAVE_FFTW3
+    bool measure = FFTs::D_FFTW::getPlanMeasure();
+    FFTs::D_FFTW::setPlanMeasure(true);
+#endif
+
+    std::map<TuningKey, double> results;
+    std::set<std::string> impls = getImplementations();
+    for (std::set<std::string>::const_iterator i = impls.begin();
+         i != impls.end(); ++i) {
+        FFTImpl *d = createImplementation(*i, size);
+        if (!d) continue;
+        d->initFloat();
+        d->initDouble();
+        results[TuningKey(*i, size, 'f')] = timeRoundTrip<float>(d, size);
+        results[TuningKey(*i, size, 'd')] = timeRoundTrip<double>(d, size);
+        delete d;
+    }
+#ifdef HAVE_FFTW3
+    FFTs::D_FFTW::setPlanMeasure(measure);
+#endif
+
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    for (std::map<TuningKey, double>::iterator i = tuningTable.begin();
+         i != tuningTable.end(); ) {
+        if (std::get<1>(i->first) == size) tuningTable.erase(i++);
+        else ++i;
+    }
+    tuningTable.insert(results.begin(), results.end());
+}
+
+std::string
+FFT::getTunedImplementation(int size)
+{
+#ifndef NO_THREADING
+    std::lock_guard<Mutex> guard(implementationMutex);
+#endif
+    if (!tuningLoaded) loadTuningLocked(getTuningPath());
+    return tunedImplementationLocked(size);
+}
+
+FFT::FFT(int size, int debugLevel) :
+    d(0){
+    if ((size < 2) ||
+        (size & (size-1))) {
+        std::cerr << "FFT::FFT(" << size << "): power-of-two sizes only supported, minimum size 2" << std::endl;
+#ifndef NO_EXCEPTIONS
+        throw InvalidSize;
+#else
+        abort();
+#endif
+    }
+    std::string impl;
+    {
+#ifndef NO_THREADING
+        std::lock_guard<Mutex> guard(implementationMutex);
 #endif
+        if (!implementationExplicit) {
+            if (!tuningLoaded) loadTuningLocked(getTuningPath());
+            impl = tunedImplementationLocked(size);
+        }
+        if (impl == "") {
+            if (m_implementation == "") pickDefaultImplementation();
+            impl = m_implementation;
+        }
+    }
+    if (debugLevel > 0) {
+        std::cerr << "FFT::FFT(" << size << "): using implementation: "
+                  << impl << std::endl;
     }
+    d = createImplementation(impl, size);
 
     if (!d) {
         std::cerr << "FFT::FFT(" << size << "): ERROR: implementation "
@@ -2692,6 +3422,8 @@ FFT::FFT(int size, int debugLevel) :
         abort();
 #endif
     }
+
+    d->setPolarAccuracy(getDefaultPolarAccuracy());
 }
 
 FFT::~FFT()
@@ -2850,12 +3582,122 @@ FFT::inverseCepstral(const float * magIn, float * cepOut)
     d->inverseCepstral(magIn, cepOut);
 }
 
+void
+FFT::forwardInterleavedBatch(int count, const double *const *realIn, double *const *complexOut)
+{
+    CHECK_NOT_NULL(realIn);
+    CHECK_NOT_NULL(complexOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(realIn[k]);
+        CHECK_NOT_NULL(complexOut[k]);
+    }
+    d->forwardInterleavedBatch(count, realIn, complexOut);
+}
+
+void
+FFT::forwardPolarBatch(int count, const double *const *realIn, double *const *magOut, double *const *phaseOut)
+{
+    CHECK_NOT_NULL(realIn);
+    CHECK_NOT_NULL(magOut);
+    CHECK_NOT_NULL(phaseOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(realIn[k]);
+        CHECK_NOT_NULL(magOut[k]);
+        CHECK_NOT_NULL(phaseOut[k]);
+    }
+    d->forwardPolarBatch(count, realIn, magOut, phaseOut);
+}
+
+void
+FFT::inverseInterleavedBatch(int count, const double *const *complexIn, double *const *realOut)
+{
+    CHECK_NOT_NULL(complexIn);
+    CHECK_NOT_NULL(realOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(complexIn[k]);
+        CHECK_NOT_NULL(realOut[k]);
+    }
+    d->inverseInterleavedBatch(count, complexIn, realOut);
+}
+
+void
+FFT::inversePolarBatch(int count, const double *const *magIn, const double *const *phaseIn, double *const *realOut)
+{
+    CHECK_NOT_NULL(magIn);
+    CHECK_NOT_NULL(phaseIn);
+    CHECK_NOT_NULL(realOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(magIn[k]);
+        CHECK_NOT_NULL(phaseIn[k]);
+        CHECK_NOT_NULL(realOut[k]);
+    }
+    d->inversePolarBatch(count, magIn, phaseIn, realOut);
+}
+
+void
+FFT::forwardInterleavedBatch(int count, const float *const *realIn, float *const *complexOut)
+{
+    CHECK_NOT_NULL(realIn);
+    CHECK_NOT_NULL(complexOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(realIn[k]);
+        CHECK_NOT_NULL(complexOut[k]);
+    }
+    d->forwardInterleavedBatch(count, realIn, complexOut);
+}
+
+void
+FFT::forwardPolarBatch(int count, const float *const *realIn, float *const *magOut, float *const *phaseOut)
+{
+    CHECK_NOT_NULL(realIn);
+    CHECK_NOT_NULL(magOut);
+    CHECK_NOT_NULL(phaseOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(realIn[k]);
+        CHECK_NOT_NULL(magOut[k]);
+        CHECK_NOT_NULL(phaseOut[k]);
+    }
+    d->forwardPolarBatch(count, realIn, magOut, phaseOut);
+}
+
+void
+FFT::inverseInterleavedBatch(int count, const float *const *complexIn, float *const *realOut)
+{
+    CHECK_NOT_NULL(complexIn);
+    CHECK_NOT_NULL(realOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(complexIn[k]);
+        CHECK_NOT_NULL(realOut[k]);
+    }
+    d->inverseInterleavedBatch(count, complexIn, realOut);
+}
+
+void
+FFT::inversePolarBatch(int count, const float *const *magIn, const float *const *phaseIn, float *const *realOut)
+{
+    CHECK_NOT_NULL(magIn);
+    CHECK_NOT_NULL(phaseIn);
+    CHECK_NOT_NULL(realOut);
+    for (int k = 0; k < count; ++k) {
+        CHECK_NOT_NULL(magIn[k]);
+        CHECK_NOT_NULL(phaseIn[k]);
+        CHECK_NOT_NULL(realOut[k]);
+    }
+    d->inversePolarBatch(count, magIn, phaseIn, realOut);
+}
+
 void
 FFT::initFloat() 
 {
     d->initFloat();
 }
 
+void
+FFT::initFloatBatch(int count)
+{
+    d->initFloatBatch(count);
+}
+
 void
 FFT::initDouble() 
 {
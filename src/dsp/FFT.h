@@ -25,6 +25,7 @@
 #define _RUBBERBAND_FFT_H_
 
 #include "system/sysutils.h"
+#include "system/VectorOpsDispatch.h"
 
 #include <string>
 #include <set>
@@ -84,6 +85,32 @@ public:
     void inversePolar(const float *R__ magIn, const float *R__ phaseIn, float *R__ realOut);
     void inverseCepstral(const float *R__ magIn, float *R__ cepOut);
 
+    /**
+     * Batched transforms of count equal-size frames, frame k being
+     * read from the k'th input array and written to the k'th output
+     * array(s), with the same results as count single-frame calls.
+     *
+     * Batching only takes effect with FFTW, whose float versions go
+     * through a plan_many plan for the count passed to
+     * initFloatBatch, in runs of that many frames.  A shorter run
+     * goes through the same plan if it is more than half as long,
+     * and a frame at a time otherwise.  Every other implementation,
+     * including FFTS and the builtin one, transforms the frames in
+     * turn.  FFTS has no batched real transform, and a builtin
+     * kernel vectorised across frames rather than within them
+     * measured slower than the single-frame kernel at every size the
+     * stretcher uses (see bench-fftbatch).
+     */
+    void forwardInterleavedBatch(int count, const double *const *realIn, double *const *complexOut);
+    void forwardPolarBatch(int count, const double *const *realIn, double *const *magOut, double *const *phaseOut);
+    void inverseInterleavedBatch(int count, const double *const *complexIn, double *const *realOut);
+    void inversePolarBatch(int count, const double *const *magIn, const double *const *phaseIn, double *const *realOut);
+
+    void forwardInterleavedBatch(int count, const float *const *realIn, float *const *complexOut);
+    void forwardPolarBatch(int count, const float *const *realIn, float *const *magOut, float *const *phaseOut);
+    void inverseInterleavedBatch(int count, const float *const *complexIn, float *const *realOut);
+    void inversePolarBatch(int count, const float *const *magIn, const float *const *phaseIn, float *const *realOut);
+
     // Calling one or both of these is optional -- if neither is
     // called, the first call to a forward or inverse method will call
     // init().  You only need call these if you don't want to risk
@@ -91,6 +118,11 @@ public:
     void initFloat();
     void initDouble();
 
+    // As initFloat, and also prepares the float batched transforms
+    // for batches of up to count frames.  A smaller count than was
+    // prepared for before leaves the preparation as it was.
+    void initFloatBatch(int count);
+
     enum Precision {
         SinglePrecision = 0x1,
         DoublePrecision = 0x2
@@ -113,11 +145,69 @@ public:
     static std::string getDefaultImplementation();
     static void setDefaultImplementation(std::string);
 
+    /**
+     * Choose the accuracy tier of the float sincos and atan2 used by
+     * forwardPolar and inversePolar (see VectorAccuracy).  An FFT
+     * starts with the default, which is vector_accuracy() unless
+     * setDefaultPolarAccuracy has been called.  Implementations that
+     * do their polar conversions in a library of their own ignore it.
+     */
+    void setPolarAccuracy(VectorAccuracy accuracy);
+
+    static VectorAccuracy getDefaultPolarAccuracy();
+    static void setDefaultPolarAccuracy(VectorAccuracy);
+
     static std::string tune();
 
+    /**
+     * Persistent tuning table.  This records the measured time of a
+     * forward plus inverse transform for each (implementation, size,
+     * precision), so that an FFT constructed without an explicit
+     * default implementation can use whichever compiled-in
+     * implementation was fastest at its own size, without measuring
+     * anything at construction.
+     *
+     * The table lives in the file named by the RUBBERS_FFT_TUNING
+     * environment variable, or $HOME/.rubbers.fft-tuning, and is
+     * loaded on first use.  It is plain text, one "implementation
+     * size precision nanoseconds" line per entry, so a table made
+     * once on a representative host can be shipped with the workers
+     * that will use it.  Entries for implementations not compiled in
+     * are kept but ignored.
+     *
+     * Once a table has been loaded, FFTW plans for sizes without
+     * saved wisdom are made with FFTW_ESTIMATE rather than measured,
+     * so a cold start never pays for planning.  calibrate() measures
+     * the plans it times, which also leaves wisdom to be saved for
+     * them, and then puts the planning back as it was.
+     *
+     * Outside the library, RubbersStretcher::calibrateFft() and
+     * saveFftTuning() (and the --calibrate-fft option of the
+     * command-line utility) make and save a table.
+     */
+    static bool loadTuning(std::string path = "");
+    static bool saveTuning(std::string path = "");
+
+    /**
+     * Time every compiled-in implementation at the given size, at
+     * both precisions, and record the results in the tuning table
+     * (replacing any earlier entries for that size).  This is slow
+     * and is intended to be run once, followed by saveTuning().
+     */
+    static void calibrate(int size);
+
+    /**
+     * Return the implementation the tuning table prefers for the
+     * given size, or an empty string if it has no entries for that
+     * size.  Single-precision timings are used when there are any,
+     * as that is what the stretcher runs at.
+     */
+    static std::string getTunedImplementation(int size);
+
 protected:
     FFTImpl *d;
     static std::string m_implementation;
+    static int m_polarAccuracy;
     static void pickDefaultImplementation();
 };
 
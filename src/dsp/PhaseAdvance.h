@@ -0,0 +1,314 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_PHASE_ADVANCE_H_
+#define _RUBBERBAND_PHASE_ADVANCE_H_
+
+#include "system/sysutils.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Rubbers
+{
+
+/**
+ * The phase vocoder's per-frame phase update.
+ *
+ * Each bin's phase is advanced by its measured frequency scaled to
+ * the output hop.  With laminar propagation a bin whose phase error
+ * is growing in the same direction as the bin above it instead
+ * takes part of that bin's advance ("inherits" it), over a distance
+ * limited by frequency band.  Only that inheritance carries from
+ * bin to bin, so process() does the arithmetic for every bin in one
+ * loop with no carried state, which the compiler can vectorise, and
+ * then makes a short scalar scan downwards for inheritance and
+ * phase reset.  The result matches doing the whole thing a bin at a
+ * time, from the top down.
+ *
+ * Given the frame's magnitudes and a floor, bins far enough below
+ * the frame's peak are taken to be insignificant.  Those above the
+ * highest significant bin are left with their input phases, as if
+ * reset, and the passes stop short of them; those below it do not
+ * inherit.
+ */
+struct PhaseAdvance
+{
+    int fftSize;
+    int increment;        // analysis hop
+    int outputIncrement;  // synthesis hop
+    bool laminar;
+    bool reset;           // leave the phases unmodified
+    bool bandlimited;     // except between bandlow and bandhigh, and never inherit at those bins
+    int bandlow;
+    int bandhigh;
+    int limit0;           // inheritance distance is 0 up to this bin,
+    int limit1;           // 1 up to this one,
+    int limit2;           // 3 up to this one and 8 above
+    const float *mag = nullptr; // magnitudes of the frame, for the floor
+    float floor = 0.0f;   // bins below this times the peak are insignificant
+
+    /**
+     * Update fftSize/2 + 1 bins of phase in place, along with the
+     * per-channel history arrays.  delta is scratch of the same
+     * size, and is left holding nothing useful.  distacc
+     * accumulates the inheritance distances, for debugging.  Return
+     * true if every bin was reset.
+     */
+    bool process(float *phase, float *prevPhase, float *prevError,
+                 float *unwrappedPhase, float *delta, float &distacc) const {
+        const int count = fftSize / 2;
+        const float fsz = fftSize;
+        const float inc = increment;
+        const float outInc = outputIncrement;
+        const float omegaScale = static_cast<float>(2 * M_PI) * inc;
+        const float maxdist = 8.0f;
+
+        auto top = count;
+        auto threshold = 0.0f;
+        const float *const sig = (floor > 0.0f ? mag : nullptr);
+        if (sig) {
+            auto peak = 0.0f;
+            for (int i = 0; i <= count; ++i) peak = std::max(peak, sig[i]);
+            threshold = peak * floor;
+            while (top > 0 && sig[top] < threshold) --top;
+            for (int i = top + 1; i <= count; ++i) {
+                prevError[i] = 0.0f;
+                prevPhase[i] = phase[i];
+                unwrappedPhase[i] = phase[i];
+            }
+        }
+
+        // As if no bin inherited or was reset.  delta keeps the change
+        // in phase error, from which the scan takes the instability
+        // and direction
+        for (int i = 0; i <= top; ++i) {
+            const float p = phase[i];
+            const float omega = (omegaScale * i) / fsz;
+            const float perr = princarg(p - (prevPhase[i] + omega));
+            const float outphase = unwrappedPhase[i] + outInc * ((omega + perr) / inc);
+            delta[i] = perr - prevError[i];
+            prevError[i] = perr;
+            prevPhase[i] = p;
+            phase[i] = outphase;
+            unwrappedPhase[i] = outphase;
+        }
+
+        auto fullReset = reset;
+        if (reset && bandlimited &&
+            std::max(bandlow + 1, 0) <= std::min(bandhigh - 1, count)) {
+            fullReset = false;
+        }
+        if (!laminar && !reset) return fullReset;
+
+        // Decide which bins inherit.  That depends on the bin above
+        // only through the distance and the previous instability and
+        // direction, so it is done branch-free (the outcome being
+        // close to random from bin to bin) and the indices of the
+        // inheriting bins are packed, from the top down, into the
+        // part of delta already read
+        auto prevInstability = 0.0f;
+        auto prevDirection = false;
+        auto distance = 0.0f;
+        auto inheriting = 0;
+        for (int i = top; i >= 0; --i) {
+            if (reset && !(bandlimited && i > bandlow && i < bandhigh)) {
+                prevError[i] = 0.0f;
+                phase[i] = prevPhase[i];
+                unwrappedPhase[i] = prevPhase[i];
+                distance = 0.0f;
+                continue;
+            }
+            if (!laminar) continue;
+            const auto instability = fabsf(delta[i]);
+            const auto direction = (delta[i] > 0.0f);
+            auto mi = maxdist;
+            if (i <= limit0) mi = 0.0f;
+            else if (i <= limit1) mi = 1.0f;
+            else if (i <= limit2) mi = 3.0f;
+            const bool inherit = (distance < mi) & (i != top) &
+                !(bandlimited & ((i == bandhigh) | (i == bandlow))) &
+                (instability > prevInstability) & (direction == prevDirection) &
+                (!sig || sig[i] >= threshold);
+            delta[count - inheriting] = float(i);
+            inheriting += inherit;
+            distance = inherit ? distance + 1 : 0.0f;
+            prevInstability = instability;
+            prevDirection = direction;
+        }
+
+        // Blend the inheriting bins' advances with those of the bins
+        // above them, which are final by the time they are reached
+        auto above = count + 1;
+        distance = 0.0f;
+        for (int k = 0; k < inheriting; ++k) {
+            const int i = int(delta[count - k]);
+            distance = (i + 1 == above) ? distance + 1 : 0.0f;
+            above = i;
+            const float omega = (omegaScale * i) / fsz;
+            const float advance = outInc * ((omega + prevError[i]) / inc);
+            const float inherited = unwrappedPhase[i + 1] - prevPhase[i + 1];
+            const float outphase = prevPhase[i] +
+                ((advance * distance) + (inherited * (maxdist - distance))) / maxdist;
+            phase[i] = outphase;
+            unwrappedPhase[i] = outphase;
+            distacc += distance;
+        }
+        return fullReset;
+    }
+
+    /**
+     * As process, but for several channels at once, with the arrays
+     * holding (fftSize/2 + 1) bins of channels elements each, the
+     * channels of a bin next to one another.  The per-bin arithmetic
+     * runs over all of them in one loop, taking each element's bin
+     * number from bins (an array of the same layout), and the
+     * decisions to inherit are made once per bin for every channel,
+     * from the change in phase error averaged across the channels,
+     * weighted by their magnitudes in jointMag.  jointMag also
+     * stands in for mag with any floor.  shared is scratch of
+     * fftSize/2 + 1.
+     */
+    bool processJoint(int channels, const float *jointMag, const float *bins,
+                      float *phase, float *prevPhase, float *prevError,
+                      float *unwrappedPhase, float *delta, float *shared,
+                      float &distacc) const {
+        const int count = fftSize / 2;
+        const float fsz = fftSize;
+        const float inc = increment;
+        const float outInc = outputIncrement;
+        const float omegaScale = static_cast<float>(2 * M_PI) * inc;
+        const float maxdist = 8.0f;
+
+        // A bin is significant if it is in any channel
+        auto top = count;
+        auto threshold = 0.0f;
+        if (floor > 0.0f) {
+            auto peak = 0.0f;
+            for (int k = 0; k < (count + 1) * channels; ++k) peak = std::max(peak, jointMag[k]);
+            threshold = peak * floor;
+            for (; top > 0; --top) {
+                auto m = 0.0f;
+                for (int c = 0; c < channels; ++c) m = std::max(m, jointMag[top * channels + c]);
+                if (m >= threshold) break;
+            }
+            for (int k = (top + 1) * channels; k < (count + 1) * channels; ++k) {
+                prevError[k] = 0.0f;
+                prevPhase[k] = phase[k];
+                unwrappedPhase[k] = phase[k];
+            }
+        }
+
+        const int n = (top + 1) * channels;
+        for (int k = 0; k < n; ++k) {
+            const float p = phase[k];
+            const float omega = (omegaScale * bins[k]) / fsz;
+            const float perr = princarg(p - (prevPhase[k] + omega));
+            const float outphase = unwrappedPhase[k] + outInc * ((omega + perr) / inc);
+            delta[k] = perr - prevError[k];
+            prevError[k] = perr;
+            prevPhase[k] = p;
+            phase[k] = outphase;
+            unwrappedPhase[k] = outphase;
+        }
+
+        auto fullReset = reset;
+        if (reset && bandlimited &&
+            std::max(bandlow + 1, 0) <= std::min(bandhigh - 1, count)) {
+            fullReset = false;
+        }
+        if (!laminar && !reset) return fullReset;
+
+        for (int i = 0; i <= top; ++i) {
+            auto weighted = 0.0f, total = 0.0f;
+            for (int c = 0; c < channels; ++c) {
+                weighted += jointMag[i * channels + c] * delta[i * channels + c];
+                total += jointMag[i * channels + c];
+            }
+            shared[i] = (total > 0.0f ? weighted / total : 0.0f);
+        }
+
+        // As in process, with the indices of the inheriting bins
+        // packed into the part of shared already read
+        auto prevInstability = 0.0f;
+        auto prevDirection = false;
+        auto distance = 0.0f;
+        auto inheriting = 0;
+        for (int i = top; i >= 0; --i) {
+            if (reset && !(bandlimited && i > bandlow && i < bandhigh)) {
+                for (int k = i * channels; k < (i + 1) * channels; ++k) {
+                    prevError[k] = 0.0f;
+                    phase[k] = prevPhase[k];
+                    unwrappedPhase[k] = prevPhase[k];
+                }
+                distance = 0.0f;
+                continue;
+            }
+            if (!laminar) continue;
+            const auto instability = fabsf(shared[i]);
+            const auto direction = (shared[i] > 0.0f);
+            auto mi = maxdist;
+            if (i <= limit0) mi = 0.0f;
+            else if (i <= limit1) mi = 1.0f;
+            else if (i <= limit2) mi = 3.0f;
+            auto significant = true;
+            if (floor > 0.0f) {
+                auto m = 0.0f;
+                for (int c = 0; c < channels; ++c) m = std::max(m, jointMag[i * channels + c]);
+                significant = (m >= threshold);
+            }
+            const bool inherit = (distance < mi) & (i != top) &
+                !(bandlimited & ((i == bandhigh) | (i == bandlow))) &
+                (instability > prevInstability) & (direction == prevDirection) &
+                significant;
+            shared[count - inheriting] = float(i);
+            inheriting += inherit;
+            distance = inherit ? distance + 1 : 0.0f;
+            prevInstability = instability;
+            prevDirection = direction;
+        }
+
+        auto above = count + 1;
+        distance = 0.0f;
+        for (int j = 0; j < inheriting; ++j) {
+            const int i = int(shared[count - j]);
+            distance = (i + 1 == above) ? distance + 1 : 0.0f;
+            above = i;
+            const float omega = (omegaScale * i) / fsz;
+            for (int k = i * channels; k < (i + 1) * channels; ++k) {
+                const float advance = outInc * ((omega + prevError[k]) / inc);
+                const float inherited = unwrappedPhase[k + channels] - prevPhase[k + channels];
+                const float outphase = prevPhase[k] +
+                    ((advance * distance) + (inherited * (maxdist - distance))) / maxdist;
+                phase[k] = outphase;
+                unwrappedPhase[k] = outphase;
+            }
+            distacc += distance;
+        }
+        return fullReset;
+    }
+};
+
+}
+
+#endif
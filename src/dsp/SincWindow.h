@@ -28,10 +28,12 @@
 #include <iostream>
 #include <cstdlib>
 #include <map>
+#include <memory>
 
 #include "system/sysutils.h"
 #include "system/VectorOps.h"
 #include "system/Allocators.h"
+#include "system/SharedCache.h"
 
 namespace Rubbers {
 
@@ -56,6 +58,15 @@ public:
 	return *this;
     }
     virtual ~SincWindow() {deallocate(m_cache);}
+    /**
+     * Return a sinc windower of size n and scale p shared read-only
+     * with every other user in the process, constructing it only if
+     * none is alive already.  The shared windower cannot be
+     * rewritten.
+     */
+    static std::shared_ptr<const SincWindow> shared(int n, int p) {
+        return SharedCache<std::pair<int, int>, SincWindow>::get(std::make_pair(n, p), n, p);
+    }
     /**
      * Regenerate the sinc window with the same size, but a new scale
      * (the p value is interpreted as for the argument of the same
@@ -72,6 +83,7 @@ public:
     inline void add(T *const  dst, T scale) const {v_add_with_gain(dst, m_cache, scale, m_size);}
     inline T getArea() const { return m_area; }
     inline T getValue(int i) const { return m_cache[i]; }
+    inline const T *getValues() const { return m_cache; }
     inline int getSize() const { return m_size; }
     inline int getP() const { return m_p; }
     /**
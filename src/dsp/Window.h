@@ -27,10 +27,12 @@
 #include <cmath>
 #include <cstdlib>
 #include <map>
+#include <memory>
 
 #include "system/sysutils.h"
 #include "system/VectorOps.h"
 #include "system/Allocators.h"
+#include "system/SharedCache.h"
 
 namespace Rubbers {
 enum WindowType {
@@ -62,6 +64,14 @@ public:
     }
     Window(Window &&w) = default;
     virtual ~Window() {deallocate(m_cache);}
+    /**
+     * Return a windower of the given type and size shared read-only
+     * with every other user in the process, constructing it only if
+     * none is alive already.
+     */
+    static std::shared_ptr<const Window> shared(WindowType type, int size) {
+        return SharedCache<std::pair<int, int>, Window>::get(std::make_pair(int(type), size), type, size);
+    }
     inline void cut(T *const  block) const {v_multiply(block, m_cache, m_size);}
     inline void cut(const T *const  src, T *const  dst) const {v_multiply(dst, src, m_cache, m_size);}
     inline void add(T *const  dst, T scale) const {v_add_with_gain(dst, m_cache, scale, m_size);}
@@ -73,6 +83,7 @@ public:
     }
     inline T getArea() const { return m_area; }
     inline T getValue(int i) const { return m_cache[i]; }
+    inline const T *getValues() const { return m_cache; }
     inline WindowType getType() const { return m_type; }
     inline int getSize() const { return m_size; }
 protected:
@@ -23,10 +23,27 @@
 
 #include "rubbers/rubbers-c.h"
 #include "rubbers/RubbersStretcher.h"
+#include "rubbers/RubbersStretcherPool.h"
+
+#include <memory>
+
+class RubbersCExecutor : public Rubbers::RubbersStretcher::Executor
+{
+public:
+    RubbersCExecutor(RubbersExecutorFunction run, void *data) :
+        m_run(run), m_data(data) { }
+    void run(size_t count, WorkFunction work, void *context) override {
+        m_run(m_data, count, work, context);
+    }
+protected:
+    RubbersExecutorFunction m_run;
+    void *m_data;
+};
 
 struct RubbersState_
 {
     Rubbers::RubbersStretcher *m_s;
+    std::unique_ptr<RubbersCExecutor> m_executor;
 };
 
 RubbersState rubbers_new(unsigned int sampleRate,
@@ -118,6 +135,34 @@ void rubbers_set_max_process_size(RubbersState state, size_t samples)
     state->m_s->setMaxProcessSize(samples);
 }
 
+void rubbers_set_pitch_scale_range(RubbersState state, double minScale, double maxScale)
+{
+    state->m_s->setPitchScaleRange(minScale, maxScale);
+}
+
+void rubbers_set_bandwidth(RubbersState state, double frequency)
+{
+    state->m_s->setBandwidth(frequency);
+}
+
+void rubbers_set_silence_threshold(RubbersState state, float level)
+{
+    state->m_s->setSilenceThreshold(level);
+}
+
+double rubbers_get_silence_skip_rate(const RubbersState state)
+{
+    return state->m_s->getSilenceSkipRate();
+}
+
+void rubbers_set_executor(RubbersState state, RubbersExecutorFunction run, void *executorData)
+{
+    std::unique_ptr<RubbersCExecutor> executor;
+    if (run) executor.reset(new RubbersCExecutor(run, executorData));
+    state->m_s->setExecutor(executor.get());
+    state->m_executor = std::move(executor);
+}
+
 void rubbers_set_key_frame_map(RubbersState state, size_t keyframecount, size_t *from, size_t  *to)
 {
     std::map<size_t, size_t> kfm;
@@ -137,6 +182,16 @@ void rubbers_process(RubbersState state, const float *const *input, size_t sampl
     state->m_s->process(input, samples, flush!= 0);
 }
 
+void rubbers_process_batch(RubbersState *states, size_t count, const float *const *const *input, size_t samples, bool flush)
+{
+    // Kept between calls, so that a batch no larger than the last
+    // one allocates nothing here
+    static thread_local std::vector<Rubbers::RubbersStretcher *> stretchers;
+    if (stretchers.size() < count) stretchers.resize(count);
+    for (size_t i = 0; i < count; ++i) stretchers[i] = states[i]->m_s;
+    Rubbers::RubbersStretcher::processBatch(stretchers.data(), count, input, samples, flush != 0);
+}
+
 ssize_t rubbers_available(const RubbersState state)
 {
     return state->m_s->available();
@@ -147,6 +202,21 @@ size_t rubbers_retrieve(const RubbersState state, float *const *output, size_t s
     return state->m_s->retrieve(output, samples);
 }
 
+void rubbers_set_additional_time_ratios(RubbersState state, const double *ratios, size_t count)
+{
+    state->m_s->setAdditionalTimeRatios(std::vector<double>(ratios, ratios + count));
+}
+
+ssize_t rubbers_available_for_ratio(const RubbersState state, size_t ratioIndex)
+{
+    return state->m_s->available(ratioIndex);
+}
+
+size_t rubbers_retrieve_for_ratio(const RubbersState state, float *const *output, size_t samples, size_t ratioIndex)
+{
+    return state->m_s->retrieve(output, samples, ratioIndex);
+}
+
 unsigned int rubbers_get_channel_count(const RubbersState state)
 {
     return state->m_s->getChannelCount();
@@ -167,3 +237,80 @@ void rubbers_set_default_debug_level(int level)
     Rubbers::RubbersStretcher::setDefaultDebugLevel(level);
 }
 
+void rubbers_calibrate_fft(size_t minSize, size_t maxSize)
+{
+    Rubbers::RubbersStretcher::calibrateFft(minSize, maxSize);
+}
+
+bool rubbers_save_fft_tuning(const char *path)
+{
+    return Rubbers::RubbersStretcher::saveFftTuning(path ? path : "");
+}
+
+void rubbers_set_realtime_audit(RubbersState state, int mode)
+{
+    state->m_s->setRealTimeAudit
+        (Rubbers::RubbersStretcher::RealTimeAuditMode(mode));
+}
+
+size_t rubbers_get_realtime_audit_allocations(const RubbersState state)
+{
+    return state->m_s->getRealTimeAuditAllocations();
+}
+
+size_t rubbers_get_realtime_audit_locks(const RubbersState state)
+{
+    return state->m_s->getRealTimeAuditLocks();
+}
+
+size_t rubbers_get_dropped_samples(const RubbersState state)
+{
+    return state->m_s->getDroppedSamples();
+}
+
+struct RubbersPool_
+{
+    Rubbers::RubbersStretcherPool m_pool;
+    RubbersPool_(size_t maxIdle) : m_pool(maxIdle) { }
+};
+
+RubbersPool rubbers_pool_new(size_t maxIdle)
+{
+    return new RubbersPool_(maxIdle);
+}
+
+void rubbers_pool_delete(RubbersPool pool)
+{
+    delete pool;
+}
+
+RubbersState rubbers_pool_acquire(RubbersPool pool,
+                                  unsigned int sampleRate,
+                                  unsigned int channels,
+                                  RubbersOptions options,
+                                  double initialTimeRatio,
+                                  double initialPitchScale)
+{
+    RubbersState_ *state = new RubbersState_();
+    state->m_s = pool->m_pool.acquire
+        (sampleRate, channels, options,
+         initialTimeRatio, initialPitchScale);
+    return state;
+}
+
+void rubbers_pool_release(RubbersPool pool, RubbersState state)
+{
+    // The executor belongs to the state, which goes away here
+    if (state->m_executor) state->m_s->setExecutor(nullptr);
+    pool->m_pool.release(state->m_s);
+    delete state;
+}
+
+void rubbers_pool_reserve(RubbersPool pool,
+                          unsigned int sampleRate,
+                          unsigned int channels,
+                          RubbersOptions options,
+                          size_t count)
+{
+    pool->m_pool.reserve(sampleRate, channels, options, count);
+}
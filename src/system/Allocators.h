@@ -25,6 +25,7 @@
 #define _RUBBERBAND_ALLOCATORS_H_
 
 #include "VectorOps.h"
+#include "RTAudit.h"
 
 #include <new> // for std::bad_alloc
 #include <memory>
@@ -41,6 +42,7 @@ namespace Rubbers {
 template <typename T>
 T *allocate(size_t count){
     void *ptr = 0;
+    RTAudit::noteAllocation();
     // 32-byte alignment is required for at least OpenMAX
 #ifndef MALLOC_IS_ALIGNED
     static const int alignment = 32;
@@ -65,13 +67,18 @@ T *allocate_and_zero(size_t count){
     return ptr;
 }
 template <typename T>
-void deallocate(T *ptr) { if (ptr) free((void *)ptr);}
+void deallocate(T *ptr) {
+    if (!ptr) return;
+    RTAudit::noteAllocation();
+    free((void *)ptr);
+}
 
 /// Reallocate preserving contents but leaving additional memory uninitialised	
 template <typename T>
 T *reallocate(T *ptr, size_t oldcount, size_t count)
 {
 #ifdef MALLOC_IS_ALIGNED
+    RTAudit::noteAllocation();
     return reinterpret_cast<T*>(realloc(reinterpret_cast<void*>(ptr),count*sizeof(T)));
 #else /* !MALLOC_IS_ALIGNED */
     T *newptr = allocate<T>(count);
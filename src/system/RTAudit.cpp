@@ -0,0 +1,106 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "RTAudit.h"
+
+#ifdef RT_AUDIT
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace Rubbers {
+
+namespace {
+
+thread_local RTAudit::Counts *currentCounts = nullptr;
+
+void
+report(const char *what){
+    // Leave the section first, as reporting may itself allocate
+    currentCounts = nullptr;
+    fprintf(stderr, "RTAudit: %s in real-time section, aborting\n", what);
+    abort();
+}
+
+}
+
+RTAudit::Section::Section(Counts &counts) :
+    m_outer(currentCounts)
+{
+    if (counts.mode != Off) currentCounts = &counts;
+}
+
+RTAudit::Section::~Section(){currentCounts = m_outer;}
+
+RTAudit::Counts *
+RTAudit::current(){return currentCounts;}
+
+void
+RTAudit::noteAllocation(){
+    auto counts = currentCounts;
+    if (!counts) return;
+    ++counts->allocations;
+    if (counts->mode == Trap) report("heap allocation");
+}
+
+void
+RTAudit::noteLock(){
+    auto counts = currentCounts;
+    if (!counts) return;
+    ++counts->locks;
+    if (counts->mode == Trap) report("lock");
+}
+
+}
+
+// Replacements for the global allocation functions, so as to see
+// allocations made by the standard library as well as our own
+
+void *
+operator new(std::size_t size){
+    Rubbers::RTAudit::noteAllocation();
+    if (auto ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void *
+operator new[](std::size_t size){return operator new(size);}
+
+void
+operator delete(void *ptr) noexcept{
+    if (!ptr) return;
+    Rubbers::RTAudit::noteAllocation();
+    std::free(ptr);
+}
+
+void
+operator delete[](void *ptr) noexcept{operator delete(ptr);}
+
+void
+operator delete(void *ptr, std::size_t) noexcept{operator delete(ptr);}
+
+void
+operator delete[](void *ptr, std::size_t) noexcept{operator delete(ptr);}
+
+#endif
@@ -0,0 +1,102 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_RTAUDIT_H_
+#define _RUBBERBAND_RTAUDIT_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace Rubbers {
+
+/**
+ * RTAudit checks that code which is supposed to be real-time safe
+ * does not allocate or free heap memory or take a lock.
+ *
+ * A Section object marks the calling thread as running such code
+ * for as long as the Section exists.  While one is open, each heap
+ * operation (through operator new and delete, or the allocate()
+ * family in Allocators.h) and each lock of a Mutex (see Thread.h) on
+ * that thread is counted in the Counts the Section was opened with.
+ * In Trap mode the first one is also reported and the process
+ * aborted, so that it can be found in a debugger.
+ *
+ * Auditing is compiled in only when RT_AUDIT is defined, because it
+ * replaces the global operator new and delete and so affects the
+ * whole program.  Without RT_AUDIT, Section does nothing and the
+ * counts stay at zero.
+ */
+class RTAudit
+{
+public:
+    enum Mode {
+        Off,
+        Count,
+        Trap
+    };
+
+    struct Counts {
+        Mode mode = Off;
+        // A section may run work on several executor threads at once
+        std::atomic<size_t> allocations { 0 };
+        std::atomic<size_t> locks { 0 };
+        void reset() { allocations = 0; locks = 0; }
+    };
+
+#ifdef RT_AUDIT
+    class Section
+    {
+    public:
+        explicit Section(Counts &counts);
+        ~Section();
+        Section(const Section &) = delete;
+        Section &operator=(const Section &) = delete;
+    private:
+        Counts *m_outer;
+    };
+
+    /**
+     * Return the counts of the section open on this thread, or 0 if
+     * there is none.
+     */
+    static Counts *current();
+
+    static void noteAllocation();
+    static void noteLock();
+#else
+    class Section
+    {
+    public:
+        explicit Section(Counts &) { }
+    };
+
+    static Counts *current() { return nullptr; }
+
+    static void noteAllocation() { }
+    static void noteLock() { }
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "Semaphore.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Rubbers {
+
+namespace {
+
+inline void
+relax()
+{
+    // Tell the core we are spinning, so a hyperthreaded sibling gets
+    // the pipeline meanwhile
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+}
+
+Semaphore::Semaphore(int count, int maxSpin) :
+    m_count(count),
+    m_sleepers(0),
+    m_spin(maxSpin / 8),
+    m_minSpin(maxSpin > 0 ? std::max(1, maxSpin / 64) : 0),
+    m_maxSpin(maxSpin)
+{
+}
+
+Semaphore::~Semaphore()
+{
+}
+
+void
+Semaphore::post()
+{
+    // Sequentially consistent, as is the waiter's registration in
+    // m_sleepers, so that either a waiter about to sleep sees the new
+    // token or we see it counted as a sleeper
+    m_count.fetch_add(1);
+    if (m_sleepers.load() > 0) wake();
+}
+
+bool
+Semaphore::tryWait()
+{
+    auto count = m_count.load(std::memory_order_relaxed);
+    while (count > 0) {
+        if (m_count.compare_exchange_weak(count, count - 1,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+Semaphore::wait()
+{
+    for (int i = 0; i < m_spin; ++i) {
+        if (tryWait()) {
+            m_spin = std::min(m_maxSpin, m_spin * 2 + 1);
+            return;
+        }
+        relax();
+    }
+    // Never below the floor, or a waiter that has slept a few times
+    // would stop spinning for good and never see a token arrive in a
+    // spin to lengthen it again
+    m_spin = std::max(m_minSpin, m_spin / 2);
+    ++m_sleepers;
+    while (!tryWait()) sleep();
+    --m_sleepers;
+}
+
+#ifdef __linux__
+
+void
+Semaphore::sleep()
+{
+    // Returns at once if a token has arrived since we last looked
+    syscall(SYS_futex, reinterpret_cast<int *>(&m_count),
+            FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+}
+
+void
+Semaphore::wake()
+{
+    syscall(SYS_futex, reinterpret_cast<int *>(&m_count),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+#else
+
+void
+Semaphore::sleep()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this] { return m_count.load() > 0; });
+}
+
+void
+Semaphore::wake()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_condition.notify_one();
+}
+
+#endif
+
+}
@@ -0,0 +1,102 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_SEMAPHORE_H_
+#define _RUBBERBAND_SEMAPHORE_H_
+
+#include <atomic>
+
+#ifndef __linux__
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace Rubbers {
+
+/**
+ * Semaphore is a counting semaphore for handing work from a real-time
+ * thread to a worker thread.
+ *
+ * post() never blocks and takes no lock: it adds a token with a
+ * single atomic increment, and makes a system call only if a waiter
+ * has actually gone to sleep.  wait() takes a token, first spinning
+ * for a while in the hope of one arriving, and then sleeping.  The
+ * length of the spin adapts: it is lengthened each time a token
+ * arrives during it, and shortened each time the waiter has to
+ * sleep (though never below a short floor, so that it can lengthen
+ * again), so a worker fed at short regular intervals tends to be
+ * caught spinning while one fed rarely stops wasting a core.
+ *
+ * On Linux, sleeping and waking use a futex on the token count.
+ * Elsewhere they fall back to a mutex and condition variable, which
+ * post() then locks briefly if (and only if) a waiter is asleep.
+ */
+class Semaphore
+{
+public:
+    /**
+     * Construct a semaphore holding the given number of tokens.
+     * maxSpin is the longest spin, in polls of the count with a
+     * pause instruction between them, that wait() will make before
+     * sleeping; zero means always sleep at once.
+     */
+    explicit Semaphore(int count = 0, int maxSpin = 2000);
+    ~Semaphore();
+
+    /**
+     * Add a token, waking a sleeping waiter if there is one.
+     */
+    void post();
+
+    /**
+     * Take a token, waiting until one is available.
+     */
+    void wait();
+
+    /**
+     * Take a token if one is available without waiting, and return
+     * true if one was taken.
+     */
+    bool tryWait();
+
+    Semaphore(const Semaphore &) = delete;
+    Semaphore &operator=(const Semaphore &) = delete;
+
+protected:
+    void sleep();
+    void wake();
+
+    std::atomic<int> m_count;
+    std::atomic<int> m_sleepers;
+    int m_spin; // belongs to the waiter
+    int m_minSpin;
+    int m_maxSpin;
+#ifndef __linux__
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+#endif
+};
+
+}
+
+#endif
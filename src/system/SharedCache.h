@@ -0,0 +1,108 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_SHARED_CACHE_H_
+#define _RUBBERBAND_SHARED_CACHE_H_
+
+#include <map>
+#include <memory>
+#include <utility>
+
+#ifndef NO_THREADING
+#include "Thread.h"
+#endif
+
+namespace Rubbers {
+
+/**
+ * Process-wide cache of immutable objects of type T, keyed by Key.
+ *
+ * get() returns a reference-counted handle to the object for a key,
+ * constructing it from the given arguments if no live object exists
+ * for that key already.  All callers asking for the same key share
+ * the one object, read-only, and it is destroyed when the last handle
+ * to it is released.  The cache itself holds only weak references.
+ *
+ * get() is thread-safe.  Construction happens with the cache lock
+ * held, so two threads asking for the same key at once will not both
+ * build it.  A destructor of T must not call back into the same
+ * cache.
+ */
+template <typename Key, typename T>
+class SharedCache
+{
+public:
+    typedef std::shared_ptr<const T> Handle;
+
+    template <typename... Args>
+    static Handle get(const Key &key, Args &&...args) {
+#ifndef NO_THREADING
+        std::lock_guard<Mutex> guard(mutex());
+#endif
+        auto &m = entries();
+        auto it = m.find(key);
+        if (it != m.end()) {
+            if (auto h = it->second.lock()) return h;
+        }
+        prune(m);
+        Handle h = std::make_shared<const T>(std::forward<Args>(args)...);
+        m[key] = h;
+        return h;
+    }
+
+    /**
+     * Return the number of objects currently alive in the cache.
+     */
+    static size_t size() {
+#ifndef NO_THREADING
+        std::lock_guard<Mutex> guard(mutex());
+#endif
+        auto &m = entries();
+        prune(m);
+        return m.size();
+    }
+
+private:
+    typedef std::map<Key, std::weak_ptr<const T> > Map;
+
+    static Map &entries() {
+        static Map m;
+        return m;
+    }
+#ifndef NO_THREADING
+    static Mutex &mutex() {
+        static Mutex m;
+        return m;
+    }
+#endif
+    static void prune(Map &m) {
+        for (auto it = m.begin(); it != m.end(); ) {
+            if (it->second.expired()) it = m.erase(it);
+            else ++it;
+        }
+    }
+};
+
+}
+
+#endif
@@ -27,6 +27,7 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "RTAudit.h"
 
 namespace Rubbers
 {
@@ -43,6 +44,27 @@ public:
     std::thread::id id()  const{return m_thread.get_id();}
     static constexpr bool threadingAvailable(){return true;}
 };
+/**
+ * Mutex is a std::mutex that, in an RT_AUDIT build, reports each
+ * lock taken to RTAudit.  Use it for any lock that the real-time
+ * processing path might reach.  It cannot be used with
+ * std::condition_variable.
+ */
+#ifdef RT_AUDIT
+class Mutex : public std::mutex {
+public:
+    void lock(){
+        RTAudit::noteLock();
+        std::mutex::lock();
+    }
+    bool try_lock(){
+        RTAudit::noteLock();
+        return std::mutex::try_lock();
+    }
+};
+#else
+typedef std::mutex Mutex;
+#endif
 /**
   The Condition class bundles a condition variable and mutex.
 
@@ -0,0 +1,153 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace Rubbers
+{
+
+namespace {
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local int t_index = -1;
+}
+
+void
+ThreadPool::TaskGroup::run(Task task){
+    m_pending.fetch_add(1);
+    m_pool.submit(this, std::move(task));
+}
+void
+ThreadPool::TaskGroup::wait(){
+    while (m_pending.load() > 0) {
+        if (m_pool.runOne(m_pool.currentWorker())) continue;
+        std::unique_lock<std::mutex> lock(m_pool.m_sleepMutex);
+        ++m_pool.m_waiting;
+        m_pool.m_done.wait(lock, [this] {
+                return m_pending.load() == 0 || m_pool.m_queued.load() > 0;
+            });
+        --m_pool.m_waiting;
+    }
+}
+ThreadPool::ThreadPool(int workers){
+    workers = std::max(workers, 1);
+    for (int i = 0; i < workers; ++i) {m_workers.push_back(std::make_unique<Worker>());}
+    // Start only once every deque exists, as workers steal from all of them
+    for (int i = 0; i < workers; ++i) {
+        m_workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+    }
+}
+ThreadPool::~ThreadPool(){
+    {
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_exiting = true;
+    }
+    m_wake.notify_all();
+    for (auto &w : m_workers) {if (w->thread.joinable()) w->thread.join();}
+}
+ThreadPool &
+ThreadPool::instance(){
+    static ThreadPool pool(int(std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+int
+ThreadPool::currentWorker() const{return (t_pool == this) ? t_index : -1;}
+void
+ThreadPool::submit(TaskGroup *group, Task task){
+    auto self = currentWorker();
+    auto n = getWorkerCount();
+    auto index = (self >= 0) ? self : int(m_next.fetch_add(1) % n);
+    m_queued.fetch_add(1);
+    {
+        std::unique_lock<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(Entry { std::move(task), group });
+    }
+    {
+        // Taking the lock here ensures a thread that has just found
+        // nothing to do cannot miss this wakeup before sleeping
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_one();
+    if (m_waiting.load() > 0) m_done.notify_all();
+}
+bool
+ThreadPool::takeFrom(int index, bool back, Entry &entry){
+    auto &w = *m_workers[index];
+    std::unique_lock<std::mutex> lock(w.mutex);
+    if (w.tasks.empty()) return false;
+    if (back) {
+        entry = std::move(w.tasks.back());
+        w.tasks.pop_back();
+    } else {
+        entry = std::move(w.tasks.front());
+        w.tasks.pop_front();
+    }
+    m_queued.fetch_sub(1);
+    return true;
+}
+bool
+ThreadPool::runOne(int self){
+    if (m_queued.load() <= 0) return false;
+    auto n = getWorkerCount();
+    auto entry = Entry { Task(), nullptr };
+    auto found = (self >= 0 && takeFrom(self, true, entry));
+    if (!found) {
+        // Own deque is empty (or we are not a worker): steal the
+        // oldest task from somebody else's
+        auto start = (self >= 0) ? self : int(m_next.load() % n);
+        for (auto k = 1; k <= n && !found; ++k) {
+            auto victim = (start + k) % n;
+            if (victim == self) continue;
+            found = takeFrom(victim, false, entry);
+        }
+    }
+    if (!found) return false;
+    entry.task();
+    finished(entry.group);
+    return true;
+}
+void
+ThreadPool::finished(TaskGroup *group){
+    // The group may be destroyed as soon as its count reaches zero,
+    // so it must not be touched after this
+    if (group->m_pending.fetch_sub(1) != 1) return;
+    {
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+    }
+    m_done.notify_all();
+}
+void
+ThreadPool::workerLoop(int index){
+    t_pool = this;
+    t_index = index;
+    while (!m_exiting.load()) {
+        if (runOne(index)) continue;
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] {
+                return m_exiting.load() || m_queued.load() > 0;
+            });
+    }
+}
+
+}
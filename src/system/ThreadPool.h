@@ -0,0 +1,141 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_THREADPOOL_H_
+#define _RUBBERBAND_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Rubbers
+{
+
+/**
+ * ThreadPool runs short tasks on a fixed set of worker threads.
+ *
+ * Each worker owns a deque of tasks.  A worker pops its own work from
+ * the back of its deque, and when that runs dry it steals from the
+ * front of the other workers' deques.  Tasks submitted from a thread
+ * outside the pool are dealt out to the workers in turn.
+ *
+ * Tasks are submitted through a TaskGroup.  TaskGroup::wait() does
+ * not simply block: it runs queued tasks on the calling thread until
+ * every task in the group has completed.  So a client thread waiting
+ * on its own work contributes a core rather than idling, and a task
+ * may itself submit and wait on further work without deadlocking.
+ *
+ * A single process-wide pool is available from instance(), and is
+ * shared between all stretcher instances so that running many of
+ * them at once does not multiply the number of threads.
+ *
+ * Tasks must not throw.
+ */
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    class TaskGroup
+    {
+    public:
+        explicit TaskGroup(ThreadPool &pool) : m_pool(pool) { }
+        ~TaskGroup() { wait(); }
+
+        /**
+         * Queue a task on the pool as part of this group.
+         */
+        void run(Task task);
+
+        /**
+         * Return once all tasks queued through this group have
+         * completed, running queued work on the calling thread
+         * meanwhile.
+         */
+        void wait();
+
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+    private:
+        friend class ThreadPool;
+        ThreadPool &m_pool;
+        std::atomic<int> m_pending { 0 };
+    };
+
+    /**
+     * Construct a pool with the given number of worker threads (at
+     * least one).
+     */
+    explicit ThreadPool(int workers);
+    ~ThreadPool();
+
+    /**
+     * Return the process-wide pool, creating it on first use.  It has
+     * one worker fewer than the number of hardware threads (but at
+     * least one), since a thread waiting on a TaskGroup makes up the
+     * difference.
+     */
+    static ThreadPool &instance();
+
+    int getWorkerCount() const { return int(m_workers.size()); }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+protected:
+    struct Entry {
+        Task task;
+        TaskGroup *group;
+    };
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Entry> tasks;
+        std::thread thread;
+    };
+
+    void submit(TaskGroup *group, Task task);
+    bool runOne(int self);
+    bool takeFrom(int index, bool back, Entry &entry);
+    void finished(TaskGroup *group);
+    void workerLoop(int index);
+    int currentWorker() const;
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::atomic<unsigned int> m_next { 0 };
+    std::atomic<int> m_queued { 0 };
+    std::atomic<int> m_waiting { 0 };
+    std::atomic<bool> m_exiting { false };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+};
+
+}
+
+#endif
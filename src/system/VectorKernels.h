@@ -0,0 +1,422 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+// This file has no include guard: VectorOpsDispatch.cpp includes it
+// once for each instruction set it builds kernels for, inside a
+// namespace of that name and under a matching "#pragma GCC target".
+// Everything here is a plain loop over float arrays, written so that
+// the compiler vectorises it at whatever width the target has.  The
+// transcendental functions are the cephes single-precision
+// polynomials used by the Pommier SSE code, rewritten per element
+// with selects in place of branches.
+//
+// sincos and atan2 come in two accuracy tiers (see VectorAccuracy),
+// which share their range reduction and differ in the polynomial:
+//
+//   accurate: sincos within 7.5e-8 absolute for |x| < 8192;
+//             atan2 within 3e-7 radians
+//   fast:     sincos within 1.3e-5 absolute over the same range;
+//             atan2 within 1.8e-5 radians
+//
+// Both hold only if the reduction's subtractions are done in the
+// order written, which VectorOpsDispatch.cpp sees to.
+
+static inline float k_from_bits(const uint32_t i)
+{
+    float f;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+static inline uint32_t k_to_bits(const float f)
+{
+    uint32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+// Reduce |x| to r in [-pi/4, pi/4] about the nearest even multiple
+// j of pi/4, in three parts ("extended precision modular arithmetic")
+// or, for the fast tier, two
+static inline float k_sincos_reduce(const float x, uint32_t &j, const bool fast)
+{
+    const float ax = fabsf(x);
+    j = uint32_t(int32_t(ax * 1.27323954473516f));
+    j = (j + 1) & ~1u;
+    const float y = float(int32_t(j));
+    if (fast) {
+        return (ax - y * 0.78515625f) - y * 2.4191339744e-4f;
+    }
+    return ((ax - y * 0.78515625f)
+            - y * 2.4187564849853515625e-4f)
+            - y * 3.77489497744594108e-8f;
+}
+
+// Pick and sign the polynomials for sin(r) and cos(r) according to
+// the octant
+static inline void k_sincos_unfold(const float x, const uint32_t j,
+                                   const float ps, const float pc,
+                                   float &s, float &c)
+{
+    const bool swap = (j & 2u);
+    const uint32_t sinSign = (k_to_bits(x) ^ (j << 29)) & 0x80000000u;
+    const uint32_t cosSign = (~(j - 2u) << 29) & 0x80000000u;
+    s = k_from_bits(k_to_bits(swap ? pc : ps) ^ sinSign);
+    c = k_from_bits(k_to_bits(swap ? ps : pc) ^ cosSign);
+}
+
+static inline void k_sincos(const float x, float &s, float &c)
+{
+    uint32_t j;
+    const float r = k_sincos_reduce(x, j, false);
+    const float z = r * r;
+    const float pc = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z
+                      + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+    const float ps = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z
+                      - 1.6666654611e-1f) * z * r + r;
+    k_sincos_unfold(x, j, ps, pc, s, c);
+}
+
+// Minimax fits of degree 5 for sin and 4 for cos on [-pi/4, pi/4],
+// within 9.4e-7 and 1.2e-5
+static inline void k_sincos_fast(const float x, float &s, float &c)
+{
+    uint32_t j;
+    const float r = k_sincos_reduce(x, j, true);
+    const float z = r * r;
+    const float pc = (4.048924706e-2f * z - 4.997764336e-1f) * z + 1.0f;
+    const float ps = (8.153021597e-3f * z - 1.666283514e-1f) * z * r + r;
+    k_sincos_unfold(x, j, ps, pc, s, c);
+}
+
+static inline float k_exp(float x)
+{
+    x = std::min(std::max(x, -88.3762626647949f), 88.3762626647949f);
+    // exp(x) = exp(g + n log 2)
+    float fx = x * 1.44269504088896341f + 0.5f;
+    const float t = float(int32_t(fx));
+    fx = (t > fx) ? t - 1.0f : t;
+    x = x - fx * 0.693359375f - fx * -2.12194440e-4f;
+    const float z = x * x;
+    float y = 1.9875691500e-4f;
+    y = y * x + 1.3981999507e-3f;
+    y = y * x + 8.3334519073e-3f;
+    y = y * x + 4.1665795894e-2f;
+    y = y * x + 1.6666665459e-1f;
+    y = y * x + 5.0000001201e-1f;
+    y = y * z + x + 1.0f;
+    return y * k_from_bits(uint32_t(int32_t(fx) + 127) << 23);
+}
+
+static inline float k_log(const float in)
+{
+    // denormals are cut off, and zero or negative input gives NaN
+    uint32_t bits = k_to_bits(std::max(in, 1.17549435e-38f));
+    float e = float(int32_t(bits >> 23) - 127) + 1.0f;
+    float x = k_from_bits((bits & ~0x7f800000u) | 0x3f000000u);
+    const bool small = (x < 0.707106781186547524f);
+    e = small ? e - 1.0f : e;
+    x = small ? x + x - 1.0f : x - 1.0f;
+    const float z = x * x;
+    float y = 7.0376836292e-2f;
+    y = y * x - 1.1514610310e-1f;
+    y = y * x + 1.1676998740e-1f;
+    y = y * x - 1.2420140846e-1f;
+    y = y * x + 1.4249322787e-1f;
+    y = y * x - 1.6668057665e-1f;
+    y = y * x + 2.0000714765e-1f;
+    y = y * x - 2.4999993993e-1f;
+    y = y * x + 3.3333331174e-1f;
+    y = y * x * z;
+    y = y + e * -2.12194440e-4f - 0.5f * z;
+    const float result = x + y + e * 0.693359375f;
+    return (in > 0.0f) ? result : k_from_bits(0xffffffffu);
+}
+
+// Unfold atan(min/max) of the magnitudes into the right octant and
+// quadrant
+static inline float k_atan2_unfold(float a, const float y, const float x)
+{
+    a = (fabsf(y) > fabsf(x)) ? float(M_PI / 2) - a : a;
+    a = (x < 0.0f) ? float(M_PI) - a : a;
+    return k_from_bits(k_to_bits(a) ^ (k_to_bits(y) & 0x80000000u));
+}
+
+static inline float k_atan2(const float y, const float x)
+{
+    // cephes atanf, with the argument folded about tan(pi/8) in the
+    // same single division
+    const float ax = fabsf(x);
+    const float ay = fabsf(y);
+    const float hi = std::max(ax, ay);
+    const float lo = std::min(ax, ay);
+    const bool fold = (lo > 0.414213562373095f * hi);
+    const float num = fold ? lo - hi : lo;
+    const float den = fold ? lo + hi : hi;
+    const float t = num / std::max(den, 1.17549435e-38f);
+    const float z = t * t;
+    float a = ((( 8.05374449538e-2f * z - 1.38776856032e-1f) * z
+                 + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * t + t;
+    a = fold ? a + float(M_PI / 4) : a;
+    return k_atan2_unfold(a, y, x);
+}
+
+// A minimax fit of degree 9 for atan on [0, 1], within 1.8e-5,
+// without the fold
+static inline float k_atan2_fast(const float y, const float x)
+{
+    const float ax = fabsf(x);
+    const float ay = fabsf(y);
+    const float t = std::min(ax, ay) / std::max(std::max(ax, ay), 1.17549435e-38f);
+    const float z = t * t;
+    const float a = (((2.305932050e-2f * z - 9.044895960e-2f) * z
+                      + 1.844901151e-1f) * z - 3.316851486e-1f) * z * t + t;
+    return k_atan2_unfold(a, y, x);
+}
+
+// The tiers, as policies for the kernels that use them
+struct Accurate {
+    static void sincos(const float x, float &s, float &c) {k_sincos(x, s, c);}
+    static float atan2(const float y, const float x) {return k_atan2(y, x);}
+};
+
+struct Fast {
+    static void sincos(const float x, float &s, float &c) {k_sincos_fast(x, s, c);}
+    static float atan2(const float y, const float x) {return k_atan2_fast(y, x);}
+};
+
+static void k_add(float *const R__ dst, const float *const R__ src, const int count)
+{
+    for (int i = 0; i < count; ++i) {dst[i] += src[i];}
+}
+
+static void k_multiply(float *const R__ dst, const float *const R__ src, const int count)
+{
+    for (int i = 0; i < count; ++i) {dst[i] *= src[i];}
+}
+
+static void k_multiply_to(float *const R__ dst,
+                          const float *const R__ src1,
+                          const float *const R__ src2,
+                          const int count)
+{
+    for (int i = 0; i < count; ++i) {dst[i] = src1[i] * src2[i];}
+}
+
+// dst[i] *= src[index[i]], which AVX2 and AVX-512 can do with gathers
+static void k_multiply_gather(float *const R__ dst,
+                              const float *const R__ src,
+                              const int *const R__ index,
+                              const int count)
+{
+    for (int i = 0; i < count; ++i) {dst[i] *= src[index[i]];}
+}
+
+static void k_multiply_and_add(float *const R__ dst,
+                               const float *const R__ src1,
+                               const float *const R__ src2,
+                               const float gain,
+                               const int count)
+{
+    if (gain == 1.0f) {
+        for (int i = 0; i < count; ++i) {dst[i] += src1[i] * src2[i];}
+    } else {
+        for (int i = 0; i < count; ++i) {dst[i] += src1[i] * src2[i] * gain;}
+    }
+}
+
+static void k_window_run(float *const R__ dst,
+                         float *const R__ src,
+                         const float *const R__ window,
+                         const float *const R__ filter,
+                         const int count,
+                         const bool add)
+{
+    if (filter) {
+        if (add) {
+            for (int i = 0; i < count; ++i) {
+                const float x = src[i] * filter[i] * window[i];
+                src[i] = x;
+                dst[i] += x;
+            }
+        } else {
+            for (int i = 0; i < count; ++i) {
+                const float x = src[i] * filter[i] * window[i];
+                src[i] = x;
+                dst[i] = x;
+            }
+        }
+    } else {
+        if (add) {
+            for (int i = 0; i < count; ++i) {
+                const float x = src[i] * window[i];
+                src[i] = x;
+                dst[i] += x;
+            }
+        } else {
+            for (int i = 0; i < count; ++i) {
+                const float x = src[i] * window[i];
+                src[i] = x;
+                dst[i] = x;
+            }
+        }
+    }
+}
+
+static void k_exp_inplace(float *const R__ srcdst, const int count)
+{
+    for (int i = 0; i < count; ++i) {srcdst[i] = k_exp(srcdst[i]);}
+}
+
+static void k_log_inplace(float *const R__ srcdst, const int count)
+{
+    for (int i = 0; i < count; ++i) {srcdst[i] = k_log(srcdst[i]);}
+}
+
+template<typename Tier>
+static void k_sincos_array(float *const R__ s,
+                           float *const R__ c,
+                           const float *const R__ x,
+                           const int count)
+{
+    for (int i = 0; i < count; ++i) {Tier::sincos(x[i], s[i], c[i]);}
+}
+
+template<typename Tier>
+static void k_atan2_array(float *const R__ dst,
+                          const float *const R__ y,
+                          const float *const R__ x,
+                          const int count)
+{
+    for (int i = 0; i < count; ++i) {dst[i] = Tier::atan2(y[i], x[i]);}
+}
+
+template<typename Tier>
+static void k_polar_to_cartesian(float *const R__ real,
+                                 float *const R__ imag,
+                                 const float *const R__ mag,
+                                 const float *const R__ phase,
+                                 const int count)
+{
+    for (int i = 0; i < count; ++i) {
+        float s, c;
+        Tier::sincos(phase[i], s, c);
+        real[i] = c * mag[i];
+        imag[i] = s * mag[i];
+    }
+}
+
+template<typename Tier>
+static void k_polar_to_cartesian_interleaved(float *R__ dst,
+                                             const float *const R__ mag,
+                                             const float *const R__ phase,
+                                             const int count)
+{
+    for (int i = 0; i < count; ++i) {
+        float s, c;
+        Tier::sincos(phase[i], s, c);
+        dst[0] = c * mag[i];
+        dst[1] = s * mag[i];
+        dst += 2;
+    }
+}
+
+template<typename Tier>
+static void k_polar_interleaved_to_cartesian_inplace(float *R__ srcdst,
+                                                     const int count)
+{
+    for (int i = 0; i < count; ++i) {
+        float s, c;
+        const float mag = srcdst[0];
+        Tier::sincos(srcdst[1], s, c);
+        srcdst[0] = c * mag;
+        srcdst[1] = s * mag;
+        srcdst += 2;
+    }
+}
+
+template<typename Tier>
+static void k_cartesian_to_polar(float *const R__ mag,
+                                 float *const R__ phase,
+                                 const float *const R__ real,
+                                 const float *const R__ imag,
+                                 const int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const float re = real[i], im = imag[i];
+        mag[i] = sqrtf(re * re + im * im);
+        phase[i] = Tier::atan2(im, re);
+    }
+}
+
+// Not restricted: the FFTS backend converts in place, writing each
+// phase over the interleaved input it has already read
+template<typename Tier>
+static void k_cartesian_interleaved_to_polar(float *const mag,
+                                             float *const phase,
+                                             const float *src,
+                                             const int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const float re = src[0], im = src[1];
+        src += 2;
+        mag[i] = sqrtf(re * re + im * im);
+        phase[i] = Tier::atan2(im, re);
+    }
+}
+
+static const VectorKernels accurateKernels = {
+    k_add,
+    k_multiply,
+    k_multiply_to,
+    k_multiply_gather,
+    k_multiply_and_add,
+    k_window_run,
+    k_exp_inplace,
+    k_log_inplace,
+    k_sincos_array<Accurate>,
+    k_atan2_array<Accurate>,
+    k_polar_to_cartesian<Accurate>,
+    k_polar_to_cartesian_interleaved<Accurate>,
+    k_polar_interleaved_to_cartesian_inplace<Accurate>,
+    k_cartesian_to_polar<Accurate>,
+    k_cartesian_interleaved_to_polar<Accurate>,
+};
+
+static const VectorKernels fastKernels = {
+    k_add,
+    k_multiply,
+    k_multiply_to,
+    k_multiply_gather,
+    k_multiply_and_add,
+    k_window_run,
+    k_exp_inplace,
+    k_log_inplace,
+    k_sincos_array<Fast>,
+    k_atan2_array<Fast>,
+    k_polar_to_cartesian<Fast>,
+    k_polar_to_cartesian_interleaved<Fast>,
+    k_polar_interleaved_to_cartesian_inplace<Fast>,
+    k_cartesian_to_polar<Fast>,
+    k_cartesian_interleaved_to_polar<Fast>,
+};
@@ -43,6 +43,7 @@ extern "C" {
 #include <cstring>
 #include <cmath>
 #include "sysutils.h"
+#include "VectorOpsDispatch.h"
 #include <memory>
 #include <algorithm>
 #include <utility>
@@ -57,6 +58,10 @@ namespace Rubbers {
 // auto-vectorizable by a sensible compiler (definitely gcc-4.3 on
 // Linux, ideally also gcc-4.0 on OS/X).
 
+// The float versions of the hottest of them are specialised to call
+// through vector_kernels(), which are built for several instruction
+// sets and chosen at runtime (see VectorOpsDispatch.h).
+
 
 template<typename T>
 constexpr T roundup(T x ){
@@ -126,12 +131,15 @@ inline void v_add(T *const  dst,
                   const T *const  src,
                   const int count)
 {
-    auto _src=(const T*const )__builtin_assume_aligned(src,16);
-    auto _dst =(T*const )__builtin_assume_aligned(dst,16);
-    for (int i = 0; i < count; ++i) {
-        _dst[i] += _src[i];
-    }
+    // no alignment assumed: this is used on the overlap-add
+    // accumulators, which advance by arbitrary hop sizes
+    for (int i = 0; i < count; ++i) {dst[i] += src[i];}
 }
+template<>
+inline void v_add(float *const  dst,
+                  const float *const  src,
+                  const int count)
+{vector_kernels().add(dst, src, count);}
 template<typename T>
 inline void v_add(T *const  dst,
                   const T value,
@@ -197,6 +205,11 @@ inline void v_multiply(T *const  dst,
     auto _dst = (__typeof__(dst))__builtin_assume_aligned(dst,16);
     for (int i = 0; i < count; ++i) {_dst[i] *= _src[i];}
 }
+template<>
+inline void v_multiply(float *const  dst,
+                       const float *const  src,
+                       const int count)
+{vector_kernels().multiply(dst, src, count);}
 template<typename T>
 inline void v_multiply(T *const  dst,
                        const T *const  src1,
@@ -208,6 +221,31 @@ inline void v_multiply(T *const  dst,
     auto _dst = (__typeof__(dst))__builtin_assume_aligned(dst,16);
     for (int i = 0; i < count; ++i) {_dst[i] = _src1[i] * _src2[i];}
 }
+template<>
+inline void v_multiply(float *const  dst,
+                       const float *const  src1,
+                       const float *const  src2,
+                       const int count)
+{vector_kernels().multiplyTo(dst, src1, src2, count);}
+/**
+ * Multiply each element of dst by the element of src at the
+ * corresponding offset in index.  The offsets may repeat, and need
+ * not be in order.
+ */
+template<typename T>
+inline void v_multiply_gather(T *const  dst,
+                              const T *const  src,
+                              const int *const  index,
+                              const int count)
+{
+    for (int i = 0; i < count; ++i) {dst[i] *= src[index[i]];}
+}
+template<>
+inline void v_multiply_gather(float *const  dst,
+                              const float *const  src,
+                              const int *const  index,
+                              const int count)
+{vector_kernels().multiplyGather(dst, src, index, count);}
 template<typename T>
 inline void v_divide(
         T *const  dst
@@ -224,14 +262,14 @@ inline void v_divide(
       , const float *const  src
       , const int count)
 {
+    // dst need not be aligned (the overlap-add accumulators advance by
+    // arbitrary hop sizes), and src need not share its alignment
     int i=0;
-    auto _src = (__typeof__(src))__builtin_assume_aligned(src,16);
-    auto _dst = (__typeof__(dst))__builtin_assume_aligned(dst,16);
-    while(((intptr_t)(_dst+i))&15){_dst[i] /= (_src[i]);i++;}
+    while(i<count && (((intptr_t)(dst+i))&15)){dst[i] /= src[i];i++;}
     for(; i+3<count; i+=4){
-        *(v4sf*)(_dst+i)= _approx_div_ps( *(v4sf*)(_dst+i),*(v4sf*)(_src+i));
+        *(v4sf*)(dst+i)= _approx_div_ps( *(v4sf*)(dst+i),_mm_loadu_ps(src+i));
     }
-    for(;i<count;i++) _dst[i]/=_src[i];
+    for(;i<count;i++) dst[i]/=src[i];
 }
 template<typename T>
 inline void v_multiply_and_add(T *const  dst,
@@ -244,6 +282,135 @@ inline void v_multiply_and_add(T *const  dst,
     auto _dst = (__typeof__(dst))__builtin_assume_aligned(dst,16);
     for (int i = 0; i < count; ++i) {_dst[i] += _src1[i] * _src2[i];}
 }
+/**
+ * One contiguous run of v_window_shift_and_fold: src is windowed (and
+ * filtered, if filter is non-null) in place and the result either
+ * written or added to dst.  The four variants are split out so that
+ * each inner loop is branch-free and vectorises at whatever width the
+ * target supports.
+ */
+template<typename T>
+inline void v_window_run(T *const __restrict__ dst,
+                         T *const __restrict__ src,
+                         const T *const __restrict__ window,
+                         const T *const __restrict__ filter,
+                         const int count,
+                         const bool add)
+{
+    if (filter) {
+        if (add) {
+            for (int i = 0; i < count; ++i) {
+                const T x = src[i] * filter[i] * window[i];
+                src[i] = x;
+                dst[i] += x;
+            }
+        } else {
+            for (int i = 0; i < count; ++i) {
+                const T x = src[i] * filter[i] * window[i];
+                src[i] = x;
+                dst[i] = x;
+            }
+        }
+    } else {
+        if (add) {
+            for (int i = 0; i < count; ++i) {
+                const T x = src[i] * window[i];
+                src[i] = x;
+                dst[i] += x;
+            }
+        } else {
+            for (int i = 0; i < count; ++i) {
+                const T x = src[i] * window[i];
+                src[i] = x;
+                dst[i] = x;
+            }
+        }
+    }
+}
+template<>
+inline void v_window_run(float *const __restrict__ dst,
+                         float *const __restrict__ src,
+                         const float *const __restrict__ window,
+                         const float *const __restrict__ filter,
+                         const int count,
+                         const bool add)
+{vector_kernels().windowRun(dst, src, window, filter, count, add);}
+/**
+ * Window a frame of srcSize samples and lay it out as FFT input of
+ * targetSize samples, in a single pass over the frame.
+ *
+ * src is multiplied in place by filter (if non-null) and by window.
+ * The windowed frame is rotated by half its length, so that its
+ * centre lands on sample 0 of target, and any part of it that
+ * extends beyond targetSize is folded back (time-aliased) onto
+ * target.  If srcSize is less than targetSize the remainder of
+ * target is zeroed.  The rotation and fold are done as contiguous
+ * runs rather than with a wrapping index.
+ */
+template<typename T>
+inline void v_window_shift_and_fold(T *const  target,
+                                    const int targetSize,
+                                    T *const  src,
+                                    const int srcSize,
+                                    const T *const  window,
+                                    const T *const  filter = nullptr)
+{
+    const bool add = (srcSize != targetSize);
+    if (add) {v_zero(target, targetSize);}
+    int j = (targetSize - srcSize / 2) % targetSize;
+    if (j < 0) j += targetSize;
+    for (int i = 0; i < srcSize; ) {
+        const int n = std::min(srcSize - i, targetSize - j);
+        v_window_run(target + j, src + i, window + i,
+                     filter ? filter + i : nullptr, n, add);
+        i += n;
+        j = 0;
+    }
+}
+template<typename T>
+inline void v_multiply_and_add_with_gain(T *const __restrict__ dst,
+                                         const T *const __restrict__ src1,
+                                         const T *const __restrict__ src2,
+                                         const T gain,
+                                         const int count)
+{
+    if (gain == T(1)) {
+        for (int i = 0; i < count; ++i) {dst[i] += src1[i] * src2[i];}
+    } else {
+        for (int i = 0; i < count; ++i) {dst[i] += src1[i] * src2[i] * gain;}
+    }
+}
+template<>
+inline void v_multiply_and_add_with_gain(float *const __restrict__ dst,
+                                         const float *const __restrict__ src1,
+                                         const float *const __restrict__ src2,
+                                         const float gain,
+                                         const int count)
+{vector_kernels().multiplyAndAdd(dst, src1, src2, gain, count);}
+/**
+ * The synthesis counterpart of v_window_shift_and_fold: take FFT
+ * output of srcSize samples, rotate it back by half of dstSize
+ * (unfolding it by repetition if dstSize is the larger), multiply by
+ * window and gain, and add the result to dst, in a single pass
+ * without an intermediate frame buffer.
+ */
+template<typename T>
+inline void v_unfold_window_and_add(T *const  dst,
+                                    const int dstSize,
+                                    const T *const  src,
+                                    const int srcSize,
+                                    const T *const  window,
+                                    const T gain = T(1))
+{
+    int j = (srcSize - dstSize / 2) % srcSize;
+    if (j < 0) j += srcSize;
+    for (int i = 0; i < dstSize; ) {
+        const int n = std::min(dstSize - i, srcSize - j);
+        v_multiply_and_add_with_gain(dst + i, src + j, window + i, gain, n);
+        i += n;
+        j = 0;
+    }
+}
 template<typename T>
 inline T v_sum(const T *const  src,
                const int count)
@@ -252,15 +419,6 @@ inline T v_sum(const T *const  src,
     for (int i = 0; i < count; ++i) {result += src[i];}
     return result;
 }
-template<>
-inline float v_sum(const float *const  src, const int count)
-{
-    v4sf accum = _mm_setzero_ps();
-    for(int i = 0; i+3<count; i+=4){accum = _mm_add_ps(accum,*(v4sf*)(src+i));}
-    accum = _mm_hadd_ps(accum,accum);
-    accum = _mm_hadd_ps(accum,accum);
-    return accum[0];
-}
 template<typename T>
 inline void v_log(T *const  dst,
                   const int count)
@@ -273,25 +431,8 @@ template<typename T>
 inline void v_exp(T *const  dst,const int count){for (int i = 0; i < count; ++i) {dst[i] = exp(dst[i]);}}
 
 template<>
-inline  void v_exp(float *const  dst, const int count)
-{
-    int i=0;
-    while(((intptr_t)(dst+i))&15){dst[i] = expf(dst[i]);i++;}
-    for(; i + 4 < count; i+=4 ){
-        *(v4sf*)(dst+i)=log_ps(*(v4sf*)(dst+i));
-    }
-    while(i<count){dst[i] = expf(dst[i]);}
-}
-template<>
-inline  void v_log(float *const  dst, const int count)
-{
-    int i=0;
-    while(((intptr_t)(dst+i))&15){dst[i] = logf(dst[i]);i++;}
-    for(; i + 4 < count; i+=4 ){
-        *(v4sf*)(dst+i) = log_ps(*(v4sf*)(dst+i));
-    }
-    while(i<count){dst[i] = logf(dst[i]);i++;}
-}
+inline void v_log(float *const  dst, const int count)
+{vector_kernels().log(dst, count);}
 
 #if defined HAVE_IPP
 template<>
@@ -327,6 +468,10 @@ inline void v_exp(double *const  dst,
     vvexp(tmp, dst, &count);
     v_copy(dst, tmp, count);
 }
+#else
+template<>
+inline void v_exp(float *const  dst, const int count)
+{vector_kernels().exp(dst, count);}
 #endif
 
 template<typename T>
@@ -66,87 +66,6 @@ inline void c_phasor(T *real, T *imag, T phase)
     }
 #endif
 }
-void
-inline v_polar_to_cartesian_pommier(float *const _real,
-                             float *const _imag,
-                             const float *const _mag,
-                             const float *const _phase,
-                             const int count){
-    int i = 0;
-    auto real  = (typeof(_real))__builtin_assume_aligned(_real,16); 
-    auto imag  = (typeof(_imag))__builtin_assume_aligned(_imag,16); 
-    auto mag   = (typeof(_mag))__builtin_assume_aligned(_mag,16); 
-    auto phase = (typeof(_phase))__builtin_assume_aligned(_phase,16); 
-    for (int i = 0; i + 3 < count; i += 4) {
-	v4sf fmag, fphase, fre, fim;
-        fmag = *(v4sf*)(mag+i);
-        fphase = *(v4sf*)(phase+i);
-	sincos_ps(fphase, &fim, &fre);
-        fim = _mm_mul_ps(fim, fmag);
-        fre = _mm_mul_ps(fre,fmag);
-        *(v4sf*)(real + i ) = fre;
-        *(v4sf*)(imag + i ) = fim;
-    }
-    while (i < count) {
-        float re, im;
-        c_phasor(&re, &im, phase[i]);
-        real[i] = re * mag[i];
-        imag[i] = im * mag[i];
-        ++i;
-    }
-}    
-void
-inline v_polar_interleaved_to_cartesian_inplace_pommier(float *const _srcdst,const int count){
-    int i;
-    int idx = 0, tidx = 0;
-    auto srcdst= (typeof(_srcdst))__builtin_assume_aligned(_srcdst,16); 
-    for (i = 0; i + 3 < count; i += 4) {
-	v4sf fmag, fphase, fre, fim;
-        for (int j = 0; j < 3; ++j) {
-            fmag[j] = srcdst[idx++];
-            fphase[j] = srcdst[idx++];
-        }
-	sincos_ps(fphase, &fim, &fre);
-        for (int j = 0; j < 3; ++j) {
-            srcdst[tidx++] = fre[j] * fmag[j];
-            srcdst[tidx++] = fim[j] * fmag[j];
-        }
-    }
-    while (i < count) {
-        float real, imag;
-        float mag = srcdst[idx++];
-        float phase = srcdst[idx++];
-        c_phasor(&real, &imag, phase);
-        srcdst[tidx++] = real * mag;
-        srcdst[tidx++] = imag * mag;
-        ++i;
-    }
-}    
-
-void
-inline v_polar_to_cartesian_interleaved_pommier(float *const dst,
-                                         const float *const mag,
-                                         const float *const phase,
-                                         const int count){
-    int i;
-    for (i = 0; i + 3 <= count; i += 4) {
-	v4sf fmag, fphase, fre, fim;
-        fmag = *(v4sf*)(mag+i);
-        fphase = *(v4sf*)(phase+i);
-	sincos_ps(fphase, &fim, &fre);
-        fim = _mm_mul_ps(fim, fmag);
-        fre = _mm_mul_ps(fre,fmag);
-        *(v4sf*)(dst+(2*i))   = _mm_unpacklo_ps(fre,fim);
-        *(v4sf*)(dst+(2*i+4)) = _mm_unpackhi_ps(fre,fim);
-    }
-    while (i < count) {
-        float real, imag;
-        c_phasor(&real, &imag, phase[i]);
-        dst[2*i+0] = real * mag[i];
-        dst[2*i+1] = imag * mag[i];
-        ++i;
-    }
-}
 #ifdef USE_APPROXIMATE_ATAN2
 template<typename T>
 inline T approximate_atan2(T  imag, T  real){
@@ -225,24 +144,18 @@ inline void v_polar_to_cartesian(float *const real,
                                  float *const imag,
                                  const float *const mag,
                                  const float *const phase,
-                                 const int count){
-    v_polar_to_cartesian_pommier(real, imag, mag, phase, count);
-}
+                                 const int count)
+{vector_kernels().polarToCartesian(real, imag, mag, phase, count);}
 template<>
 inline void v_polar_interleaved_to_cartesian_inplace(float *const srcdst,
                                                      const int count)
-{
-    v_polar_interleaved_to_cartesian_inplace_pommier(srcdst, count);
-}
-
+{vector_kernels().polarInterleavedToCartesianInplace(srcdst, count);}
 template<>
 inline void v_polar_to_cartesian_interleaved(float *const dst,
                                              const float *const mag,
                                              const float *const phase,
                                              const int count)
-{
-    v_polar_to_cartesian_interleaved_pommier(dst, mag, phase, count);
-}
+{vector_kernels().polarToCartesianInterleaved(dst, mag, phase, count);}
 template<typename S, typename T> // S source, T target
 void v_cartesian_to_polar(T *const mag,
                           T *const phase,
@@ -277,21 +190,18 @@ inline void v_cartesian_to_polar_interleaved_inplace(T *const srcdst,
     }
 }
 template<>
-inline void v_cartesian_to_polar(float *const _mag,
-                                 float *const _phase,
-                                 const float *const _real,
-                                 const float *const _imag,
-                                 const int count){
-    int i;
-    auto mag = (typeof(_mag))__builtin_assume_aligned(_mag,16);
-    auto phase = (typeof(_phase))__builtin_assume_aligned(_phase,16);
-    auto real  = (typeof(_real))__builtin_assume_aligned(_real,16);
-    auto imag  = (typeof(_imag))__builtin_assume_aligned(_imag,16);
-    for(i=0;i+4<count;i+=4){
-        _approx_magphase_ps ( (v4sf*)(mag + i), (v4sf*)(phase+i), *(v4sf*)(real+i),*(v4sf*)(imag+i));
-    }
-    while(i<count){c_magphase(mag+i, phase+i, real[i],imag[i]);}
-}
+inline void v_cartesian_to_polar(float *const mag,
+                                 float *const phase,
+                                 const float *const real,
+                                 const float *const imag,
+                                 const int count)
+{vector_kernels().cartesianToPolar(mag, phase, real, imag, count);}
+template<>
+inline void v_cartesian_interleaved_to_polar(float *const mag,
+                                             float *const phase,
+                                             const float *const src,
+                                             const int count)
+{vector_kernels().cartesianInterleavedToPolar(mag, phase, src, count);}
 }
 #endif
 
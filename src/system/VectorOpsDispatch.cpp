@@ -0,0 +1,188 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+// The library is built with -ffast-math, but the range reductions in
+// the kernels depend on their subtractions being done in the order
+// written.  This comes before any include so that everything inlined
+// into the kernels, std::min and std::max included, is compiled with
+// the same options: GCC won't inline across a difference.
+#ifdef __GNUC__
+#pragma GCC optimize("no-associative-math")
+#endif
+
+#include "VectorOpsDispatch.h"
+
+#include "sysutils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined __GNUC__ && !defined __clang__ && (defined __x86_64__ || defined __i386__)
+#define RUBBERS_VECTOR_DISPATCH 1
+#endif
+
+namespace Rubbers {
+
+namespace baseline {
+#include "VectorKernels.h"
+}
+
+#ifdef RUBBERS_VECTOR_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2 {
+#include "VectorKernels.h"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512dq,avx512bw,avx512vl,avx2,fma,prefer-vector-width=512")
+namespace avx512 {
+#include "VectorKernels.h"
+}
+#pragma GCC pop_options
+
+#endif
+
+static bool
+supported(VectorLevel level)
+{
+#ifdef RUBBERS_VECTOR_DISPATCH
+    __builtin_cpu_init();
+    switch (level) {
+    case VectorLevelBaseline:
+        return true;
+    case VectorLevelAVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case VectorLevelAVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+            __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+    }
+    return false;
+#else
+    return level == VectorLevelBaseline;
+#endif
+}
+
+static VectorLevel
+select()
+{
+    auto limit = VectorLevelAVX512;
+    if (const char *env = getenv("RUBBERS_VECTOR_LEVEL")) {
+        if (!strcmp(env, "sse2") || !strcmp(env, "baseline")) {
+            limit = VectorLevelBaseline;
+        } else if (!strcmp(env, "avx2")) {
+            limit = VectorLevelAVX2;
+        }
+    }
+    for (int level = limit; level > VectorLevelBaseline; --level) {
+        if (supported(VectorLevel(level))) return VectorLevel(level);
+    }
+    return VectorLevelBaseline;
+}
+
+VectorLevel
+vector_level()
+{
+    static const VectorLevel level = select();
+    return level;
+}
+
+VectorAccuracy
+vector_accuracy()
+{
+#ifdef USE_APPROXIMATE_ATAN2
+    auto accuracy = VectorAccuracyFast;
+#else
+    auto accuracy = VectorAccuracyAccurate;
+#endif
+    if (const char *env = getenv("RUBBERS_VECTOR_ACCURACY")) {
+        if (!strcmp(env, "fast")) {
+            accuracy = VectorAccuracyFast;
+        } else if (!strcmp(env, "accurate")) {
+            accuracy = VectorAccuracyAccurate;
+        }
+    }
+    return accuracy;
+}
+
+const VectorKernels *
+vector_kernels_for(VectorLevel level, VectorAccuracy accuracy)
+{
+    if (!supported(level)) return nullptr;
+    const bool fast = (accuracy == VectorAccuracyFast);
+    switch (level) {
+#ifdef RUBBERS_VECTOR_DISPATCH
+    case VectorLevelAVX512:
+        return fast ? &avx512::fastKernels : &avx512::accurateKernels;
+    case VectorLevelAVX2:
+        return fast ? &avx2::fastKernels : &avx2::accurateKernels;
+#endif
+    default:
+        return fast ? &baseline::fastKernels : &baseline::accurateKernels;
+    }
+}
+
+const VectorKernels &
+vector_kernels(VectorAccuracy accuracy)
+{
+    static const VectorKernels &fast =
+        *vector_kernels_for(vector_level(), VectorAccuracyFast);
+    static const VectorKernels &accurate =
+        *vector_kernels_for(vector_level(), VectorAccuracyAccurate);
+    return (accuracy == VectorAccuracyFast) ? fast : accurate;
+}
+
+const VectorKernels &
+vector_kernels()
+{
+    static const VectorKernels &kernels = vector_kernels(vector_accuracy());
+    return kernels;
+}
+
+const char *
+vector_level_name(VectorLevel level)
+{
+    switch (level) {
+#if defined __x86_64__ || defined __i386__
+    case VectorLevelBaseline: return "sse2";
+#else
+    case VectorLevelBaseline: return "baseline";
+#endif
+    case VectorLevelAVX2: return "avx2";
+    case VectorLevelAVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+const char *
+vector_accuracy_name(VectorAccuracy accuracy)
+{
+    return (accuracy == VectorAccuracyFast) ? "fast" : "accurate";
+}
+
+}
@@ -0,0 +1,107 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2014 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef _RUBBERBAND_VECTOR_OPS_DISPATCH_H_
+#define _RUBBERBAND_VECTOR_OPS_DISPATCH_H_
+
+namespace Rubbers {
+
+/**
+ * The instruction sets the float kernels behind VectorOps and
+ * VectorOpsComplex are built for.  The library itself is built for a
+ * baseline target (SSE2 on x86-64), and the best of these that the
+ * CPU supports is chosen once, the first time any of them is used.
+ * Setting RUBBERS_VECTOR_LEVEL to sse2, avx2 or avx512 in the
+ * environment caps the choice, for comparison or to work around a
+ * misbehaving host.
+ */
+enum VectorLevel {
+    VectorLevelBaseline,
+    VectorLevelAVX2,
+    VectorLevelAVX512
+};
+
+/**
+ * The accuracy tiers for sincos and atan2, and so for the polar and
+ * cartesian conversions built on them (see VectorKernels.h for the
+ * error bounds).  The default is fast in builds that define
+ * USE_APPROXIMATE_ATAN2 and accurate otherwise; setting
+ * RUBBERS_VECTOR_ACCURACY to fast or accurate in the environment
+ * overrides it.  FFT can also be told which to use per instance.
+ */
+enum VectorAccuracy {
+    VectorAccuracyFast,
+    VectorAccuracyAccurate
+};
+
+struct VectorKernels {
+    void (*add)(float *dst, const float *src, int count);
+    void (*multiply)(float *dst, const float *src, int count);
+    void (*multiplyTo)(float *dst, const float *src1, const float *src2, int count);
+    void (*multiplyGather)(float *dst, const float *src, const int *index, int count);
+    void (*multiplyAndAdd)(float *dst, const float *src1, const float *src2,
+                           float gain, int count);
+    void (*windowRun)(float *dst, float *src, const float *window,
+                      const float *filter, int count, bool add);
+    void (*exp)(float *srcdst, int count);
+    void (*log)(float *srcdst, int count);
+    void (*sincos)(float *s, float *c, const float *x, int count);
+    void (*atan2)(float *dst, const float *y, const float *x, int count);
+    void (*polarToCartesian)(float *real, float *imag, const float *mag,
+                             const float *phase, int count);
+    void (*polarToCartesianInterleaved)(float *dst, const float *mag,
+                                        const float *phase, int count);
+    void (*polarInterleavedToCartesianInplace)(float *srcdst, int count);
+    void (*cartesianToPolar)(float *mag, float *phase, const float *real,
+                             const float *imag, int count);
+    void (*cartesianInterleavedToPolar)(float *mag, float *phase,
+                                        const float *src, int count);
+};
+
+/**
+ * The kernels for the selected level, at the default accuracy or at
+ * the one given.  The first call makes the selection and is not
+ * real-time safe; RubbersStretcher makes it on construction.
+ */
+extern const VectorKernels &vector_kernels();
+extern const VectorKernels &vector_kernels(VectorAccuracy accuracy);
+
+/**
+ * The selected level and default accuracy.
+ */
+extern VectorLevel vector_level();
+extern VectorAccuracy vector_accuracy();
+
+/**
+ * The kernels for a given level, or nullptr if this build or CPU
+ * cannot run them.  For benchmarks and comparisons.
+ */
+extern const VectorKernels *vector_kernels_for(VectorLevel level,
+                                               VectorAccuracy accuracy);
+
+extern const char *vector_level_name(VectorLevel level);
+extern const char *vector_accuracy_name(VectorAccuracy accuracy);
+
+}
+
+#endif